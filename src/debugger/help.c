@@ -18,6 +18,7 @@ help_print(const char* command_name)
 			" x,  examine      Show all properties of an object and their attributes        \n"
 			" f,  frame        Select the stack frame used for, e.g. 'eval' and 'var'       \n"
 			" l,  list         Show source text around the line of code being debugged      \n"
+			" pr, profile      Start or stop the JS profiler, or save what it has sampled   \n"
 			" s,  stepover     Run the next line of code                                    \n"
 			" si, stepin       Run the next line of code, stepping into functions           \n"
 			" so, stepout      Run until the current function call returns                  \n"
@@ -134,6 +135,19 @@ help_print(const char* command_name)
 			"    list <lines> <file:line> - list <lines> LOC around <file:line>             \n"
 		);
 	}
+	else if (strcmp(command_name, "profile") == 0) {
+		printf(
+			"Control the target's sampling JS profiler.  While it runs, the profiler records\n"
+			"the JS call stack at regular intervals.  The samples can be saved at any time  \n"
+			"in the collapsed-stack format used by flamegraph.pl and speedscope.  The file  \n"
+			"is written by the target, so <file> is relative to where spherun was started.  \n\n"
+			"SYNTAX:                                                                        \n"
+			"    profile        - show whether the profiler is running and how many samples \n"
+			"    profile on     - discard any samples and start profiling                   \n"
+			"    profile off    - stop profiling, keeping the samples taken so far          \n"
+			"    profile <file> - write the samples taken so far to <file>                  \n"
+		);
+	}
 	else if (strcmp(command_name, "stepin") == 0) {
 		printf(
 			"Execute the next line of source code.  If a function is called, execution will \n"
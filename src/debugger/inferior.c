@@ -390,6 +390,31 @@ inferior_pause(inferior_t* obj)
 	return true;
 }
 
+bool
+inferior_profile(inferior_t* obj, const char* op, bool* out_is_running, int* out_num_samples, int* out_num_stacks)
+{
+	message_t* msg;
+
+	msg = message_new(MESSAGE_REQ);
+	message_add_int(msg, REQ_APPREQUEST);
+	message_add_int(msg, APPREQ_PROFILE);
+	if (op != NULL)
+		message_add_string(msg, op);
+	if (!(msg = inferior_request(obj, msg)))
+		goto on_error;
+	if (message_tag(msg) == MESSAGE_ERR)
+		goto on_error;
+	*out_is_running = message_get_int(msg, 0) != 0;
+	*out_num_samples = message_get_int(msg, 1);
+	*out_num_stacks = message_get_int(msg, 2);
+	message_free(msg);
+	return true;
+
+on_error:
+	message_free(msg);
+	return false;
+}
+
 message_t*
 inferior_request(inferior_t* obj, message_t* msg)
 {
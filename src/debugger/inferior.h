@@ -35,6 +35,7 @@ bool               inferior_clear_breakpoint (inferior_t* obj, int handle);
 void               inferior_detach           (inferior_t* obj);
 dvalue_t*          inferior_eval             (inferior_t* obj, const char* expr, int frame, bool* out_is_error);
 bool               inferior_pause            (inferior_t* obj);
+bool               inferior_profile          (inferior_t* obj, const char* op, bool* out_is_running, int* out_num_samples, int* out_num_stacks);
 message_t*         inferior_request          (inferior_t* obj, message_t* msg);
 bool               inferior_resume           (inferior_t* obj, resume_op_t op);
 
@@ -72,6 +72,7 @@ enum apprequest
 	APPREQ_NOP,
 	APPREQ_GAME_INFO,
 	APPREQ_SOURCE,
+	APPREQ_PROFILE,
 };
 
 message_t*      message_new          (message_tag_t tag);
@@ -48,6 +48,7 @@ command_db[] =
 	"examine",    "x",  "s",
 	"frame",      "f",  "~n",
 	"list",       "l",  "~nf",
+	"profile",    "pr", "~s",
 	"stepover",   "s",  "",
 	"stepin",     "si", "",
 	"stepout",    "so", "",
@@ -70,6 +71,7 @@ static void        handle_eval       (session_t* obj, command_t* cmd, bool is_ve
 static void        handle_frame      (session_t* obj, command_t* cmd);
 static void        handle_help       (session_t* obj, command_t* cmd);
 static void        handle_list       (session_t* obj, command_t* cmd);
+static void        handle_profile    (session_t* obj, command_t* cmd);
 static void        handle_resume     (session_t* obj, command_t* cmd, resume_op_t op);
 static void        handle_up_down    (session_t* obj, command_t* cmd, int direction);
 static void        handle_vars       (session_t* obj, command_t* cmd);
@@ -283,6 +285,8 @@ do_command_line(session_t* obj)
 		handle_frame(obj, command);
 	else if (strcmp(verb, "list") == 0)
 		handle_list(obj, command);
+	else if (strcmp(verb, "profile") == 0)
+		handle_profile(obj, command);
 	else if (strcmp(verb, "stepover") == 0)
 		handle_resume(obj, command, OP_STEP_OVER);
 	else if (strcmp(verb, "stepin") == 0)
@@ -560,6 +564,29 @@ handle_list(session_t* obj, command_t* cmd)
 	}
 }
 
+static void
+handle_profile(session_t* obj, command_t* cmd)
+{
+	bool        is_running;
+	int         num_samples;
+	int         num_stacks;
+	const char* op = NULL;
+
+	if (command_len(cmd) >= 2)
+		op = command_get_string(cmd, 1);
+	if (!inferior_profile(obj->inferior, op, &is_running, &num_samples, &num_stacks)) {
+		if (op != NULL && strcmp(op, "on") != 0 && strcmp(op, "off") != 0)
+			printf("unable to write the profile to `%s`.\n", op);
+		else
+			printf("SSJ was unable to control the profiler.\n");
+		return;
+	}
+	if (op != NULL && strcmp(op, "on") != 0 && strcmp(op, "off") != 0)
+		printf("wrote %d samples to `%s` on the target.\n", num_samples, op);
+	printf("profiler is %s, %d samples over %d unique stacks.\n",
+		is_running ? "running" : "stopped", num_samples, num_stacks);
+}
+
 static void
 handle_up_down(session_t* obj, command_t* cmd, int direction)
 {
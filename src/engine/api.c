@@ -54,6 +54,7 @@ static duk_ret_t js_EvaluateSystemScript (duk_context* ctx);
 static duk_ret_t js_EvaluateScript       (duk_context* ctx);
 static duk_ret_t js_IsSkippedFrame       (duk_context* ctx);
 static duk_ret_t js_GetFrameRate         (duk_context* ctx);
+static duk_ret_t js_GetFrameStats        (duk_context* ctx);
 static duk_ret_t js_GetGameManifest      (duk_context* ctx);
 static duk_ret_t js_GetGameList          (duk_context* ctx);
 static duk_ret_t js_GetMaxFrameSkips     (duk_context* ctx);
@@ -81,6 +82,40 @@ static duk_ret_t js_UnskipFrame          (duk_context* ctx);
 
 static duk_ret_t duk_mod_search (duk_context* ctx);
 
+// every native object carries a small header in a hidden buffer property,
+// holding the id of the class it was created for and its native pointer.
+// checking an object's type is then a single property lookup and an integer
+// compare, rather than reading the class name back and comparing strings.
+// class names are resolved to ids through a table keyed by the address of the
+// name, so each name string is only ever looked up by strcmp() once.
+
+struct sphere_class
+{
+	const char* name;
+	void*       prototype;
+	bool        has_finalizer;
+};
+
+struct class_name
+{
+	const char* name;
+	int         class_id;
+};
+
+struct obj_header
+{
+	int   class_id;
+	void* udata;
+};
+
+static int                find_class     (const char* name);
+static struct obj_header* get_obj_header (duk_context* ctx, duk_idx_t index);
+static bool               grow_names     (void);
+
+static struct class_name* s_class_names = NULL;
+static vector_t*          s_classes;
+static size_t             s_names_size = 0;
+static size_t             s_num_names = 0;
 static vector_t*  s_extensions;
 static void*      s_print_ptr;
 static lstring_t* s_user_agent;
@@ -129,6 +164,7 @@ initialize_api(duk_context* ctx)
 	duk_pop(ctx);
 
 	// stash an object to hold prototypes for built-in objects
+	s_classes = vector_new(sizeof(struct sphere_class));
 	duk_push_global_stash(ctx);
 	duk_push_object(ctx);
 	duk_put_prop_string(ctx, -2, "prototypes");
@@ -150,6 +186,7 @@ initialize_api(duk_context* ctx)
 	api_register_method(ctx, NULL, "RequireSystemScript", js_RequireSystemScript);
 	api_register_method(ctx, NULL, "IsSkippedFrame", js_IsSkippedFrame);
 	api_register_method(ctx, NULL, "GetFrameRate", js_GetFrameRate);
+	api_register_method(ctx, NULL, "GetFrameStats", js_GetFrameStats);
 	api_register_method(ctx, NULL, "GetGameManifest", js_GetGameManifest);
 	api_register_method(ctx, NULL, "GetGameList", js_GetGameList);
 	api_register_method(ctx, NULL, "GetMaxFrameSkips", js_GetMaxFrameSkips);
@@ -202,6 +239,11 @@ shutdown_api(void)
 {
 	console_log(1, "shutting down Sphere API");
 
+	vector_free(s_classes);
+	free(s_class_names);
+	s_class_names = NULL;
+	s_names_size = 0;
+	s_num_names = 0;
 	lstr_free(s_user_agent);
 }
 
@@ -233,9 +275,17 @@ api_register_const(duk_context* ctx, const char* name, double value)
 	duk_pop(ctx);
 }
 
-void
+int
 api_register_ctor(duk_context* ctx, const char* name, duk_c_function fn, duk_c_function finalizer)
 {
+	// registers a native class and returns its id, which is what object headers
+	// store.
+	// note: `name` is kept as-is in the class table and must outlive the API.
+	//       in practice it's always a string literal.
+
+	int                 class_id;
+	struct sphere_class new_class;
+
 	duk_push_global_object(ctx);
 	duk_push_c_function(ctx, fn, DUK_VARARGS);
 	duk_push_string(ctx, "name");
@@ -244,12 +294,15 @@ api_register_ctor(duk_context* ctx, const char* name, duk_c_function fn, duk_c_f
 
 	// create a prototype. Duktape won't assign one for us.
 	duk_push_object(ctx);
-	duk_push_string(ctx, name);
-	duk_put_prop_string(ctx, -2, "\xFF" "ctor");
 	if (finalizer != NULL) {
 		duk_push_c_function(ctx, finalizer, DUK_VARARGS);
 		duk_put_prop_string(ctx, -2, "\xFF" "dtor");
 	}
+	new_class.name = name;
+	new_class.prototype = duk_get_heapptr(ctx, -1);
+	new_class.has_finalizer = finalizer != NULL;
+	class_id = (int)vector_len(s_classes);
+	vector_push(s_classes, &new_class);
 
 	// save the prototype in the prototype stash. for full compatibility with
 	// Sphere 1.5, we have to allow native objects to be created through the
@@ -272,6 +325,7 @@ api_register_ctor(duk_context* ctx, const char* name, duk_c_function fn, duk_c_f
 		| DUK_DEFPROP_SET_WRITABLE
 		| DUK_DEFPROP_SET_CONFIGURABLE);
 	duk_pop(ctx);
+	return class_id;
 }
 
 bool
@@ -416,53 +470,145 @@ duk_error_ni(duk_context* ctx, int blame_offset, duk_errcode_t err_code, const c
 duk_bool_t
 duk_is_sphere_obj(duk_context* ctx, duk_idx_t index, const char* ctor_name)
 {
-	const char* obj_ctor_name;
-	duk_bool_t  result;
+	struct obj_header* header;
 
-	index = duk_require_normalize_index(ctx, index);
-	if (!duk_is_object_coercible(ctx, index))
+	if (!(header = get_obj_header(ctx, index)))
 		return 0;
-
-	duk_get_prop_string(ctx, index, "\xFF" "ctor");
-	obj_ctor_name = duk_safe_to_string(ctx, -1);
-	result = strcmp(obj_ctor_name, ctor_name) == 0;
-	duk_pop(ctx);
-	return result;
+	return header->class_id == find_class(ctor_name);
 }
 
 void
 duk_push_sphere_obj(duk_context* ctx, const char* ctor_name, void* udata)
 {
-	duk_idx_t obj_index;
-
+	int                  class_id;
+	struct obj_header*   header;
+	duk_idx_t            obj_index;
+	struct sphere_class* p_class;
+
+	if ((class_id = find_class(ctor_name)) < 0)
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "internal error: no such class `%s`", ctor_name);
+	p_class = vector_get(s_classes, class_id);
 	duk_push_object(ctx);
 	obj_index = duk_normalize_index(ctx, -1);
-	duk_push_pointer(ctx, udata);
+	header = duk_push_fixed_buffer(ctx, sizeof(struct obj_header));
+	header->class_id = class_id;
+	header->udata = udata;
 	duk_put_prop_string(ctx, -2, "\xFF" "udata");
-	duk_push_global_stash(ctx);
-	duk_get_prop_string(ctx, -1, "prototypes");
-	duk_get_prop_string(ctx, -1, ctor_name);
-	if (duk_get_prop_string(ctx, -1, "\xFF" "dtor")) {
+	duk_push_heapptr(ctx, p_class->prototype);
+	if (p_class->has_finalizer) {
+		duk_get_prop_string(ctx, -1, "\xFF" "dtor");
 		duk_set_finalizer(ctx, obj_index);
 	}
-	else
-		duk_pop(ctx);
 	duk_set_prototype(ctx, obj_index);
-	duk_pop_2(ctx);
 }
 
 void*
 duk_require_sphere_obj(duk_context* ctx, duk_idx_t index, const char* ctor_name)
 {
-	void* udata;
+	struct obj_header* header;
 
-	index = duk_require_normalize_index(ctx, index);
-	if (!duk_is_sphere_obj(ctx, index, ctor_name))
+	if (!(header = get_obj_header(ctx, index)) || header->class_id != find_class(ctor_name))
 		duk_error(ctx, DUK_ERR_TYPE_ERROR, "expected a %s object", ctor_name);
+	return header->udata;
+}
+
+void
+duk_set_sphere_udata(duk_context* ctx, duk_idx_t index, void* udata)
+{
+	struct obj_header* header;
+
+	if (header = get_obj_header(ctx, index))
+		header->udata = udata;
+}
+
+static int
+find_class(const char* name)
+{
+	// class names are nearly always string literals, so the same few pointers
+	// come through here over and over.  the first time a pointer is seen it's
+	// matched against the class table by name and the id is remembered.  after
+	// that it's a hash lookup on the address alone.  misses aren't remembered,
+	// as the class may not have been registered yet.
+
+	int                  class_id = -1;
+	size_t               index;
+	struct sphere_class* p_class;
+	struct class_name*   p_name;
+
+	iter_t iter;
+
+	if (s_names_size > 0) {
+		index = ((uintptr_t)name >> 3) & (s_names_size - 1);
+		while ((p_name = &s_class_names[index])->name != NULL) {
+			if (p_name->name == name)
+				return p_name->class_id;
+			index = (index + 1) & (s_names_size - 1);
+		}
+	}
+	iter = vector_enum(s_classes);
+	while (p_class = vector_next(&iter)) {
+		if (strcmp(p_class->name, name) == 0) {
+			class_id = (int)iter.index;
+			break;
+		}
+	}
+	if (class_id < 0)
+		return -1;
+	if ((s_num_names + 1) * 2 > s_names_size && !grow_names())
+		return class_id;
+	index = ((uintptr_t)name >> 3) & (s_names_size - 1);
+	while (s_class_names[index].name != NULL)
+		index = (index + 1) & (s_names_size - 1);
+	s_class_names[index].name = name;
+	s_class_names[index].class_id = class_id;
+	++s_num_names;
+	return class_id;
+}
+
+static struct obj_header*
+get_obj_header(duk_context* ctx, duk_idx_t index)
+{
+	// the header buffer is kept alive by the object it belongs to, so the
+	// pointer remains valid after the property is popped.
+
+	struct obj_header* header;
+	duk_size_t         size;
+
+	if (!duk_is_object(ctx, index))
+		return NULL;
 	duk_get_prop_string(ctx, index, "\xFF" "udata");
-	udata = duk_get_pointer(ctx, -1);
+	header = duk_get_buffer(ctx, -1, &size);
 	duk_pop(ctx);
-	return udata;
+	return size == sizeof(struct obj_header) ? header : NULL;
+}
+
+static bool
+grow_names(void)
+{
+	// the name table uses open addressing with linear probing and is kept at
+	// most half full.
+
+	size_t             index;
+	struct class_name* new_names;
+	size_t             new_size;
+
+	size_t i;
+
+	new_size = s_names_size > 0 ? s_names_size * 2 : 64;
+	if (!(new_names = calloc(new_size, sizeof(struct class_name))))
+		return false;
+	for (i = 0; i < s_names_size; ++i) {
+		if (s_class_names[i].name == NULL)
+			continue;
+		index = ((uintptr_t)s_class_names[i].name >> 3) & (new_size - 1);
+		while (new_names[index].name != NULL)
+			index = (index + 1) & (new_size - 1);
+		new_names[index] = s_class_names[i];
+	}
+	free(s_class_names);
+	s_class_names = new_names;
+	s_names_size = new_size;
+	return true;
 }
 
 static duk_ret_t
@@ -644,6 +790,26 @@ js_GetFrameRate(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_GetFrameStats(duk_context* ctx)
+{
+	frame_stats_t stats;
+
+	stats = screen_get_frame_stats(g_screen);
+	duk_push_object(ctx);
+	duk_push_int(ctx, stats.num_frames); duk_put_prop_string(ctx, -2, "frames");
+	duk_push_int(ctx, stats.num_late); duk_put_prop_string(ctx, -2, "late");
+	duk_push_number(ctx, stats.min_time * 1000.0); duk_put_prop_string(ctx, -2, "min");
+	duk_push_number(ctx, stats.max_time * 1000.0); duk_put_prop_string(ctx, -2, "max");
+	duk_push_number(ctx, stats.mean_time * 1000.0); duk_put_prop_string(ctx, -2, "mean");
+	duk_push_number(ctx, stats.p95_time * 1000.0); duk_put_prop_string(ctx, -2, "p95");
+	duk_push_number(ctx, stats.p99_time * 1000.0); duk_put_prop_string(ctx, -2, "p99");
+	duk_push_number(ctx, stats.jitter * 1000.0); duk_put_prop_string(ctx, -2, "jitter");
+	duk_push_number(ctx, stats.mean_binds); duk_put_prop_string(ctx, -2, "binds");
+	duk_push_number(ctx, stats.mean_switches); duk_put_prop_string(ctx, -2, "switches");
+	return 1;
+}
+
 static duk_ret_t
 js_GetGameManifest(duk_context* ctx)
 {
@@ -5,10 +5,30 @@
 #include "script.h"
 #include "vector.h"
 
+#define MAX_WORKERS 8
+
+typedef
+struct job
+{
+	async_work_fn_t   work;
+	async_finish_fn_t finish;
+	void*             udata;
+} job_t;
+
+static bool  start_workers (void);
+static void* run_worker    (ALLEGRO_THREAD* thread, void* arg);
+
 static duk_ret_t js_DispatchScript (duk_context* ctx);
 
-static unsigned int s_next_script_id = 1;
-static vector_t*    s_scripts;
+static vector_t*       s_done_jobs = NULL;
+static ALLEGRO_COND*   s_job_cond = NULL;
+static ALLEGRO_MUTEX*  s_job_mutex = NULL;
+static bool            s_is_stopping = false;
+static unsigned int    s_next_script_id = 1;
+static int             s_num_workers = 0;
+static vector_t*       s_pending_jobs = NULL;
+static vector_t*       s_scripts;
+static ALLEGRO_THREAD* s_workers[MAX_WORKERS];
 
 bool
 initialize_async(void)
@@ -16,20 +36,75 @@ initialize_async(void)
 	console_log(1, "initializing async manager");
 	if (!(s_scripts = vector_new(sizeof(script_t*))))
 		return false;
+	if (!(s_pending_jobs = vector_new(sizeof(job_t))))
+		return false;
+	if (!(s_done_jobs = vector_new(sizeof(job_t))))
+		return false;
+	if (!(s_job_mutex = al_create_mutex()))
+		return false;
+	if (!(s_job_cond = al_create_cond()))
+		return false;
 	return true;
 }
 
 void
 shutdown_async(void)
 {
+	iter_t iter;
+	job_t* job;
+
+	int i;
+
 	console_log(1, "shutting down async manager");
+
+	// stop the worker pool.  any job a worker is busy with is allowed to finish,
+	// but everything left over is cancelled.  by the time we get here the JS heap
+	// is already gone, so finish callbacks must be told not to touch it.
+	if (s_num_workers > 0) {
+		al_lock_mutex(s_job_mutex);
+		s_is_stopping = true;
+		al_broadcast_cond(s_job_cond);
+		al_unlock_mutex(s_job_mutex);
+		for (i = 0; i < s_num_workers; ++i) {
+			al_join_thread(s_workers[i], NULL);
+			al_destroy_thread(s_workers[i]);
+		}
+	}
+	if (s_pending_jobs != NULL) {
+		iter = vector_enum(s_pending_jobs);
+		while (job = vector_next(&iter))
+			job->finish(job->udata, true);
+	}
+	if (s_done_jobs != NULL) {
+		iter = vector_enum(s_done_jobs);
+		while (job = vector_next(&iter))
+			job->finish(job->udata, true);
+	}
+	vector_free(s_pending_jobs);
+	vector_free(s_done_jobs);
+	if (s_job_cond != NULL)
+		al_destroy_cond(s_job_cond);
+	if (s_job_mutex != NULL)
+		al_destroy_mutex(s_job_mutex);
 	vector_free(s_scripts);
+
+	// the engine is initialized again on restart, so leave everything in a
+	// state where the pool can be started up fresh.
+	s_pending_jobs = NULL;
+	s_done_jobs = NULL;
+	s_job_cond = NULL;
+	s_job_mutex = NULL;
+	s_scripts = NULL;
+	s_num_workers = 0;
+	s_is_stopping = false;
 }
 
 void
 update_async(void)
 {
 	iter_t     iter;
+	job_t      job;
+	int        num_jobs;
 	script_t** p_script;
 	vector_t*  vector;
 	
@@ -43,6 +118,48 @@ update_async(void)
 		}
 		vector_free(vector);
 	}
+
+	// run the main-thread half of any jobs the worker pool has finished.  jobs
+	// are taken off the queue one at a time, so if a finish callback throws, the
+	// rest stay queued for the next update.  only the jobs already done on entry
+	// are run, since a callback may queue more work.
+	if (s_num_workers > 0) {
+		al_lock_mutex(s_job_mutex);
+		num_jobs = (int)vector_len(s_done_jobs);
+		al_unlock_mutex(s_job_mutex);
+		while (num_jobs-- > 0) {
+			al_lock_mutex(s_job_mutex);
+			job = *(job_t*)vector_get(s_done_jobs, 0);
+			vector_remove(s_done_jobs, 0);
+			al_unlock_mutex(s_job_mutex);
+			job.finish(job.udata, false);
+		}
+	}
+}
+
+bool
+queue_async_job(async_work_fn_t work, async_finish_fn_t finish, void* udata)
+{
+	// queues a job for the worker pool.  `work` is called on a worker thread and
+	// must not touch Duktape or any other engine state; `finish` is called later
+	// on the main thread from update_async().  if the engine shuts down first,
+	// `finish` is called with `is_cancelled` set, after the JS heap is gone.
+
+	job_t job;
+	bool  is_ok;
+
+	if (s_pending_jobs == NULL)
+		return false;
+	if (s_num_workers == 0 && !start_workers())
+		return false;
+	job.work = work;
+	job.finish = finish;
+	job.udata = udata;
+	al_lock_mutex(s_job_mutex);
+	is_ok = vector_push(s_pending_jobs, &job);
+	al_signal_cond(s_job_cond);
+	al_unlock_mutex(s_job_mutex);
+	return is_ok;
 }
 
 bool
@@ -60,6 +177,58 @@ init_async_api(void)
 	api_register_method(g_duk, NULL, "DispatchScript", js_DispatchScript);
 }
 
+static bool
+start_workers(void)
+{
+	// the pool is only started the first time a job is queued, so games which
+	// never load anything asynchronously don't pay for idle threads.
+
+	int num_workers;
+
+	num_workers = 2;
+#if ALLEGRO_VERSION >= 5 && ALLEGRO_SUB_VERSION >= 2
+	num_workers = al_get_cpu_count() - 1;
+#endif
+	num_workers = num_workers < 1 ? 1
+		: num_workers > MAX_WORKERS ? MAX_WORKERS
+		: num_workers;
+	console_log(1, "starting async worker pool [%d threads]", num_workers);
+	while (s_num_workers < num_workers) {
+		if (!(s_workers[s_num_workers] = al_create_thread(run_worker, NULL)))
+			break;
+		al_start_thread(s_workers[s_num_workers++]);
+	}
+	if (s_num_workers == 0)
+		console_log(0, "unable to start async worker pool");
+	return s_num_workers > 0;
+}
+
+static void*
+run_worker(ALLEGRO_THREAD* thread, void* arg)
+{
+	job_t job;
+
+	al_lock_mutex(s_job_mutex);
+	for (;;) {
+		while (vector_len(s_pending_jobs) == 0 && !s_is_stopping)
+			al_wait_cond(s_job_cond, s_job_mutex);
+		if (s_is_stopping)
+			break;
+		job = *(job_t*)vector_get(s_pending_jobs, 0);
+		vector_remove(s_pending_jobs, 0);
+		al_unlock_mutex(s_job_mutex);
+		job.work(job.udata);
+		al_lock_mutex(s_job_mutex);
+		if (!vector_push(s_done_jobs, &job)) {
+			// this is only reached if memory is exhausted, so there's not much we
+			// can do.  leak the job rather than crash.
+			console_log(0, "unable to queue finished async job");
+		}
+	}
+	al_unlock_mutex(s_job_mutex);
+	return NULL;
+}
+
 static duk_ret_t
 js_DispatchScript(duk_context* ctx)
 {
@@ -3,9 +3,13 @@
 
 #include "script.h"
 
+typedef void (* async_work_fn_t)   (void* udata);
+typedef void (* async_finish_fn_t) (void* udata, bool is_cancelled);
+
 bool initialize_async   (void);
 void shutdown_async     (void);
 void update_async       (void);
+bool queue_async_job    (async_work_fn_t work, async_finish_fn_t finish, void* udata);
 bool queue_async_script (script_t* script);
 
 void init_async_api (void);
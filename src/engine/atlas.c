@@ -3,41 +3,314 @@
 
 #include "atlas.h"
 
+// images are packed using a bottom-left skyline: each page keeps a list of
+// horizontal segments tracing the top edge of everything placed on it so far,
+// and a new image goes wherever its bottom edge would end up lowest.  images
+// are placed tallest first, which keeps the skyline flat and wastes far less
+// space than a grid of max_width x max_height cells when sizes are mixed.
+// anything that won't fit on the current page without going over the maximum
+// texture size spills over onto a new page.
+//
+// small atlas pages don't get a texture of their own.  they're carved out of
+// large shared pages instead (using the same skyline method), so that sprites,
+// tiles and text from many different assets all come from one or two textures
+// and Allegro can keep batching across them.  space on a shared page isn't
+// reclaimed piecemeal: images loaded from it keep the page alive, and only once
+// nothing but the atlas manager holds on to a page can it be reused.
+//
+// if the caller provides a hash of each image's pixels, images identical to an
+// earlier one aren't given space of their own: they're aliased to the earlier
+// image's slot and come back from atlas_load() as a second view of it.
+
+#define MAX_PAGE_SIZE    4096
+#define MAX_SHARED_SIZE  512
+#define SHARED_PAGE_SIZE 2048
+
 struct atlas
 {
-	unsigned int  id;
-	image_t*      image;
-	rect_t        size;
-	int           pitch;
-	int           max_width, max_height;
-	image_lock_t* lock;
+	unsigned int   id;
+	int*           aliases;
+	bool*          is_slot_shared;
+	int            num_images;
+	int            num_pages;
+	image_t**      pages;
+	image_lock_t** locks;
+	int*           page_indices;
+	rect_t*        rects;
 };
 
+struct shared_page
+{
+	image_t*        image;
+	int             num_nodes;
+	struct skyline* nodes;
+};
+
+struct image_hash
+{
+	uint64_t hash;
+	int      index;
+};
+
+struct skyline
+{
+	int x;
+	int y;
+	int width;
+};
+
+static image_t* alloc_shared    (int width, int height);
+static int      compare_hashes  (const void* in_a, const void* in_b);
+static int      compare_heights (const void* in_a, const void* in_b);
+static bool     fit_skyline     (const struct skyline* nodes, int num_nodes, int index, int width, int height, int page_width, int page_height, int* out_y);
+static image_t* load_alias      (atlas_t* atlas, sfs_file_t* file, int index, int width, int height);
+static int      place_skyline   (struct skyline* nodes, int num_nodes, int index, int x, int y, int width, int height);
+static void     reset_shared    (struct shared_page* page);
+
 static unsigned int s_next_atlas_id = 0;
+static unsigned int s_num_private_pages = 0;
+static unsigned int s_num_shared_pages = 0;
+static vector_t*    s_shared_pages = NULL;
+
+void
+initialize_atlases(void)
+{
+	console_log(1, "initializing atlas manager");
+	s_shared_pages = vector_new(sizeof(struct shared_page));
+}
+
+void
+shutdown_atlases(void)
+{
+	iter_t              iter;
+	struct shared_page* page;
+
+	console_log(1, "shutting down atlas manager");
+	console_log(2, "    objects created: %u", s_next_atlas_id);
+	console_log(2, "    pages on shared textures: %u", s_num_shared_pages);
+	console_log(2, "    pages with own texture: %u", s_num_private_pages);
+	console_log(2, "    shared textures: %u", s_shared_pages != NULL ? vector_len(s_shared_pages) : 0);
+	if (s_shared_pages == NULL)
+		return;
+	iter = vector_enum(s_shared_pages);
+	while (page = vector_next(&iter)) {
+		free_image(page->image);
+		free(page->nodes);
+	}
+	vector_free(s_shared_pages);
+	s_shared_pages = NULL;
+}
 
 atlas_t*
 atlas_new(int num_images, int max_width, int max_height)
 {
-	atlas_t* atlas;
-
-	console_log(4, "creating atlas #%u at %ix%i per image", s_next_atlas_id,
-		max_width, max_height);
-	
-	atlas = calloc(1, sizeof(atlas_t));
-	atlas->pitch = ceil(sqrt(num_images));
-	atlas->max_width = max_width;
-	atlas->max_height = max_height;
-	atlas->size = new_rect(0, 0, atlas->pitch * atlas->max_width, atlas->pitch * atlas->max_height);
-	if (!(atlas->image = create_image(atlas->size.x2, atlas->size.y2)))
+	atlas_t* atlas = NULL;
+	int*     heights;
+	int*     widths;
+
+	int i;
+
+	widths = malloc(num_images * sizeof(int));
+	heights = malloc(num_images * sizeof(int));
+	if (widths != NULL && heights != NULL) {
+		for (i = 0; i < num_images; ++i) {
+			widths[i] = max_width;
+			heights[i] = max_height;
+		}
+		atlas = atlas_new_packed(num_images, widths, heights, NULL);
+	}
+	free(widths);
+	free(heights);
+	return atlas;
+}
+
+atlas_t*
+atlas_new_packed(int num_images, const int* widths, const int* heights, const uint64_t* hashes)
+{
+	atlas_t*           atlas = NULL;
+	int                best_index;
+	int                best_y;
+	struct image_hash* by_hash = NULL;
+	int                index;
+	int                max_size = MAX_PAGE_SIZE;
+	int                max_width = 0;
+	struct skyline*    nodes = NULL;
+	int                num_aliases = 0;
+	int                num_nodes;
+	int*               order = NULL;
+	int                page;
+	int                page_width;
+	int                total_area = 0;
+	rect_t*            rect;
+	size_t             saved_size = 0;
+	int                used_width, used_height;
+	int                y;
+
+	int i, j;
+
+	console_log(4, "creating atlas #%u for %i images", s_next_atlas_id, num_images);
+
+	if (al_get_current_display() != NULL)
+		max_size = fmin(max_size, al_get_display_option(al_get_current_display(), ALLEGRO_MAX_BITMAP_SIZE));
+	if (num_images <= 0)
+		goto on_error;
+	if (!(atlas = calloc(1, sizeof(atlas_t))))
+		goto on_error;
+	atlas->num_images = num_images;
+	if (!(atlas->rects = calloc(num_images, sizeof(rect_t))))
+		goto on_error;
+	if (!(atlas->page_indices = calloc(num_images, sizeof(int))))
 		goto on_error;
-	
+	if (!(atlas->aliases = malloc(num_images * sizeof(int))))
+		goto on_error;
+	if (!(atlas->is_slot_shared = calloc(num_images, sizeof(bool))))
+		goto on_error;
+	if (!(order = malloc(num_images * 2 * sizeof(int))))
+		goto on_error;
+	for (i = 0; i < num_images; ++i)
+		atlas->aliases[i] = -1;
+
+	// find duplicates by sorting on the pixel hashes.  runs of equal hashes
+	// are in index order, so each duplicate is aliased to the first of its kind.
+	if (hashes != NULL) {
+		if (!(by_hash = malloc(num_images * sizeof(struct image_hash))))
+			goto on_error;
+		for (i = 0; i < num_images; ++i) {
+			by_hash[i].hash = hashes[i];
+			by_hash[i].index = i;
+		}
+		qsort(by_hash, num_images, sizeof(struct image_hash), compare_hashes);
+		for (i = 0, j = 0; i < num_images; ++i) {
+			if (by_hash[i].hash != by_hash[j].hash)
+				j = i;
+			index = by_hash[i].index;
+			if (i == j || widths[index] != widths[by_hash[j].index] || heights[index] != heights[by_hash[j].index])
+				continue;
+			atlas->aliases[index] = by_hash[j].index;
+			atlas->is_slot_shared[index] = true;
+			atlas->is_slot_shared[by_hash[j].index] = true;
+			saved_size += (size_t)widths[index] * heights[index] * 4;
+			++num_aliases;
+		}
+		free(by_hash);
+		by_hash = NULL;
+	}
+	for (i = 0; i < num_images; ++i) {
+		if (widths[i] > max_size || heights[i] > max_size)
+			goto on_error;
+		order[i * 2] = i;
+		order[i * 2 + 1] = heights[i];
+		if (atlas->aliases[i] >= 0)
+			continue;
+		max_width = fmax(max_width, widths[i]);
+		total_area += widths[i] * heights[i];
+	}
+	qsort(order, num_images, sizeof(int) * 2, compare_heights);
+
+	// aim for a roughly square page.  the skyline never holds more segments
+	// than there are pixel columns, or images on the page plus one.
+	page_width = fmin(fmax(ceil(sqrt(total_area)), max_width), max_size);
+	if (!(nodes = malloc((num_images + 1) * sizeof(struct skyline))))
+		goto on_error;
+	page = -1;
+	num_nodes = 0;
+	for (i = 0; i < num_images; ++i) {
+		index = order[i * 2];
+		if (atlas->aliases[index] >= 0)
+			continue;
+		if (widths[index] <= 0 || heights[index] <= 0) {
+			atlas->rects[index] = new_rect(0, 0, 0, 0);
+			atlas->page_indices[index] = page >= 0 ? page : 0;
+			continue;
+		}
+		best_index = -1;
+		best_y = INT_MAX;
+		for (j = 0; j < num_nodes; ++j) {
+			if (!fit_skyline(nodes, num_nodes, j, widths[index], heights[index], page_width, max_size, &y))
+				continue;
+			if (y < best_y) {
+				best_index = j;
+				best_y = y;
+			}
+		}
+		if (best_index == -1) {
+			// doesn't fit, start a new page
+			++page;
+			nodes[0].x = 0;
+			nodes[0].y = 0;
+			nodes[0].width = page_width;
+			num_nodes = 1;
+			best_index = 0;
+			best_y = 0;
+		}
+		rect = &atlas->rects[index];
+		*rect = new_rect(nodes[best_index].x, best_y,
+			nodes[best_index].x + widths[index], best_y + heights[index]);
+		atlas->page_indices[index] = page;
+		num_nodes = place_skyline(nodes, num_nodes, best_index,
+			rect->x1, rect->y1, widths[index], heights[index]);
+	}
+	atlas->num_pages = page >= 0 ? page + 1 : 1;  // at least one page, even if every image is empty
+	for (i = 0; i < num_images; ++i) {
+		if ((index = atlas->aliases[i]) < 0)
+			continue;
+		atlas->rects[i] = atlas->rects[index];
+		atlas->page_indices[i] = atlas->page_indices[index];
+	}
+	if (num_aliases > 0) {
+		console_log(2, "    %i of %i images are duplicates, %.1f KB saved", num_aliases, num_images,
+			saved_size / 1024.0);
+	}
+
+	// now that we know where everything goes, create the page textures.  each
+	// page is trimmed to the area actually used.
+	if (!(atlas->pages = calloc(atlas->num_pages, sizeof(image_t*))))
+		goto on_error;
+	if (!(atlas->locks = calloc(atlas->num_pages, sizeof(image_lock_t*))))
+		goto on_error;
+	for (page = 0; page < atlas->num_pages; ++page) {
+		used_width = used_height = 1;
+		for (i = 0; i < num_images; ++i) {
+			if (atlas->page_indices[i] != page)
+				continue;
+			used_width = fmax(used_width, atlas->rects[i].x2);
+			used_height = fmax(used_height, atlas->rects[i].y2);
+		}
+		if (used_width <= MAX_SHARED_SIZE && used_height <= MAX_SHARED_SIZE)
+			atlas->pages[page] = alloc_shared(used_width, used_height);
+		if (atlas->pages[page] == NULL) {
+			if (!(atlas->pages[page] = create_image(used_width, used_height)))
+				goto on_error;
+			++s_num_private_pages;
+		}
+		else
+			++s_num_shared_pages;
+	}
+	if (atlas->num_pages > 1) {
+		console_log(4, "    spilled onto %i pages of max %ix%i", atlas->num_pages,
+			page_width, max_size);
+	}
+	free(nodes);
+	free(order);
 	atlas->id = s_next_atlas_id++;
 	return atlas;
 
 on_error:
 	console_log(4, "failed to create atlas #%u", s_next_atlas_id++);
+	free(by_hash);
+	free(nodes);
+	free(order);
 	if (atlas != NULL) {
-		free_image(atlas->image);
+		if (atlas->pages != NULL) {
+			for (i = 0; i < atlas->num_pages; ++i)
+				free_image(atlas->pages[i]);
+		}
+		free(atlas->pages);
+		free(atlas->locks);
+		free(atlas->aliases);
+		free(atlas->is_slot_shared);
+		free(atlas->page_indices);
+		free(atlas->rects);
 		free(atlas);
 	}
 	return NULL;
@@ -46,76 +319,341 @@ on_error:
 void
 atlas_free(atlas_t* atlas)
 {
+	int i;
+
+	if (atlas == NULL)
+		return;
+
 	console_log(4, "disposing atlas #%u no longer in use", atlas->id);
-	
-	if (atlas->lock != NULL)
-		unlock_image(atlas->image, atlas->lock);
-	free_image(atlas->image);
+	for (i = 0; i < atlas->num_pages; ++i) {
+		if (atlas->locks[i] != NULL)
+			unlock_image(atlas->pages[i], atlas->locks[i]);
+		free_image(atlas->pages[i]);
+	}
+	free(atlas->pages);
+	free(atlas->locks);
+	free(atlas->aliases);
+	free(atlas->is_slot_shared);
+	free(atlas->page_indices);
+	free(atlas->rects);
 	free(atlas);
 }
 
+bool
+atlas_hash_image(sfs_file_t* file, int width, int height, uint64_t* out_hash)
+{
+	// reads width x height pixels from the file and hashes them (64-bit FNV-1a),
+	// for passing to atlas_new_packed().  the file position is left just past
+	// the pixel data either way.
+
+	uint8_t  buffer[4096];
+	uint64_t hash = 14695981039346656037ULL;
+	size_t   size;
+	size_t   size_left;
+
+	size_t i;
+
+	size_left = (size_t)width * height * 4;
+	while (size_left > 0) {
+		size = size_left < sizeof buffer ? size_left : sizeof buffer;
+		if (sfs_fread(buffer, size, 1, file) != 1)
+			return false;
+		for (i = 0; i < size; ++i)
+			hash = (hash ^ buffer[i]) * 1099511628211ULL;
+		size_left -= size;
+	}
+	*out_hash = hash;
+	return true;
+}
+
 image_t*
-atlas_image(const atlas_t* atlas)
+atlas_image(const atlas_t* atlas, int page)
+{
+	return atlas->pages[page];
+}
+
+bool
+atlas_is_slot_shared(const atlas_t* atlas, int image_index)
 {
-	return atlas->image;
+	return atlas->is_slot_shared[image_index];
+}
+
+int
+atlas_num_pages(const atlas_t* atlas)
+{
+	return atlas->num_pages;
+}
+
+int
+atlas_page(const atlas_t* atlas, int image_index)
+{
+	return atlas->page_indices[image_index];
 }
 
 float_rect_t
 atlas_uv(const atlas_t* atlas, int image_index)
 {
-	float        atlas_height;
-	float        atlas_width;
-	float_rect_t uv;
-	
-	atlas_width = get_image_width(atlas->image);
-	atlas_height = get_image_height(atlas->image);
-	uv.x1 = (image_index % atlas->pitch) * atlas->max_width;
-	uv.y1 = (image_index / atlas->pitch) * atlas->max_height;
-	uv.x2 = uv.x1 + atlas->max_width;
-	uv.y2 = uv.y1 + atlas->max_height;
-	return uv;
+	const rect_t* rect;
+
+	rect = &atlas->rects[image_index];
+	return new_float_rect(rect->x1, rect->y1, rect->x2, rect->y2);
 }
 
 rect_t
 atlas_xy(const atlas_t* atlas, int image_index)
 {
-	float  atlas_height;
-	float  atlas_width;
-	rect_t xy;
-
-	atlas_width = get_image_width(atlas->image);
-	atlas_height = get_image_height(atlas->image);
-	xy.x1 = (image_index % atlas->pitch) * atlas->max_width;
-	xy.y1 = (image_index / atlas->pitch) * atlas->max_height;
-	xy.x2 = xy.x1 + atlas->max_width;
-	xy.y2 = xy.y1 + atlas->max_height;
-	return xy;
+	return atlas->rects[image_index];
 }
 
 void
 atlas_lock(atlas_t* atlas)
 {
+	int i;
+
 	console_log(4, "locking atlas #%u for direct access", atlas->id);
-	atlas->lock = lock_image(atlas->image);
+	for (i = 0; i < atlas->num_pages; ++i)
+		atlas->locks[i] = lock_image(atlas->pages[i]);
 }
 
 void
 atlas_unlock(atlas_t* atlas)
 {
+	int i;
+
 	console_log(4, "unlocking atlas #%u", atlas->id);
-	unlock_image(atlas->image, atlas->lock);
-	atlas->lock = NULL;
+	for (i = 0; i < atlas->num_pages; ++i) {
+		if (atlas->locks[i] != NULL)
+			unlock_image(atlas->pages[i], atlas->locks[i]);
+		atlas->locks[i] = NULL;
+	}
 }
 
 image_t*
 atlas_load(atlas_t* atlas, sfs_file_t* file, int index, int width, int height)
 {
-	int off_x, off_y;
-	
-	if (width > atlas->max_width || height > atlas->max_height)
+	rect_t* rect;
+
+	if (index < 0 || index >= atlas->num_images)
+		return NULL;
+	rect = &atlas->rects[index];
+	if (width > rect->x2 - rect->x1 || height > rect->y2 - rect->y1)
+		return NULL;
+	if (atlas->aliases[index] >= 0)
+		return load_alias(atlas, file, index, width, height);
+	return read_subimage(file, atlas->pages[atlas->page_indices[index]],
+		rect->x1, rect->y1, width, height);
+}
+
+static image_t*
+load_alias(atlas_t* atlas, sfs_file_t* file, int index, int width, int height)
+{
+	// the pixels were already loaded for the image this one duplicates, but
+	// they're read again and compared anyway so that a hash collision can't
+	// ever show the wrong image.  if they differ, the image gets its own
+	// texture instead.
+
+	long          file_pos;
+	image_t*      image;
+	image_lock_t* lock;
+	image_t*      page;
+	rect_t*       rect;
+	color_t*      row = NULL;
+	bool          is_match = true;
+
+	int i_y;
+
+	file_pos = sfs_ftell(file);
+	rect = &atlas->rects[index];
+	page = atlas->pages[atlas->page_indices[index]];
+	if (!(row = malloc(width * sizeof(color_t))))
+		goto on_error;
+	if (!(lock = lock_image(page)))
+		goto on_error;
+	for (i_y = 0; i_y < height; ++i_y) {
+		if (sfs_fread(row, width * sizeof(color_t), 1, file) != 1)
+			break;
+		if (memcmp(row, &lock->pixels[rect->x1 + (rect->y1 + i_y) * lock->pitch], width * sizeof(color_t)) != 0)
+			is_match = false;
+	}
+	unlock_image(page, lock);
+	free(row);
+	row = NULL;
+	if (i_y < height)
+		goto on_error;
+	if (is_match)
+		return create_subimage(page, rect->x1, rect->y1, width, height);
+	console_log(3, "hash collision in atlas #%u, image %i loaded separately", atlas->id, index);
+	sfs_fseek(file, file_pos, SFS_SEEK_SET);
+	if (!(image = read_image(file, width, height)))
+		goto on_error;
+	return image;
+
+on_error:
+	free(row);
+	sfs_fseek(file, file_pos, SFS_SEEK_SET);
+	return NULL;
+}
+
+static image_t*
+alloc_shared(int width, int height)
+{
+	// finds room for a width x height area on one of the shared pages, creating
+	// a new page if none of them have any left.  there's a 1-pixel gap between
+	// areas so filtering doesn't pull in texels from a neighbor.  pages nobody
+	// else references anymore are wiped first.
+
+	int                 best_index;
+	int                 best_y = INT_MAX;
+	image_t*            image;
+	int                 page_size;
+	struct shared_page  new_page;
+	struct shared_page* page = NULL;
+	int                 y;
+
+	int i, j;
+
+	if (s_shared_pages == NULL)
 		return NULL;
-	if (index >= atlas->pitch * atlas->pitch) return NULL;
-	off_x = index % atlas->pitch * atlas->max_width;
-	off_y = index / atlas->pitch * atlas->max_height;
-	return read_subimage(file, atlas->image, off_x, off_y, width, height);
+	width += 1;
+	height += 1;
+	for (i = 0; i < (int)vector_len(s_shared_pages); ++i) {
+		page = vector_get(s_shared_pages, i);
+		if (get_image_refcount(page->image) == 1)
+			reset_shared(page);
+		page_size = get_image_width(page->image);
+		best_index = -1;
+		for (j = 0; j < page->num_nodes; ++j) {
+			if (!fit_skyline(page->nodes, page->num_nodes, j, width, height, page_size, page_size, &y))
+				continue;
+			if (y < best_y) {
+				best_index = j;
+				best_y = y;
+			}
+		}
+		if (best_index >= 0)
+			break;
+	}
+	if (i == (int)vector_len(s_shared_pages)) {
+		// no room anywhere, add a new page
+		page_size = SHARED_PAGE_SIZE;
+		if (al_get_current_display() != NULL)
+			page_size = fmin(page_size, al_get_display_option(al_get_current_display(), ALLEGRO_MAX_BITMAP_SIZE));
+		console_log(3, "creating %ix%i shared atlas page #%i", page_size, page_size, i);
+		memset(&new_page, 0, sizeof(struct shared_page));
+		if (!(new_page.nodes = malloc((page_size + 1) * sizeof(struct skyline))))
+			return NULL;
+		if (!(new_page.image = create_image(page_size, page_size))) {
+			free(new_page.nodes);
+			return NULL;
+		}
+		reset_shared(&new_page);
+		if (!vector_push(s_shared_pages, &new_page)) {
+			free_image(new_page.image);
+			free(new_page.nodes);
+			return NULL;
+		}
+		page = vector_get(s_shared_pages, i);
+		best_index = 0;
+		best_y = 0;
+	}
+	if (!(image = create_subimage(page->image, page->nodes[best_index].x, best_y, width - 1, height - 1)))
+		return NULL;
+	page->num_nodes = place_skyline(page->nodes, page->num_nodes, best_index,
+		page->nodes[best_index].x, best_y, width, height);
+	return image;
+}
+
+static int
+compare_hashes(const void* in_a, const void* in_b)
+{
+	const struct image_hash* a = in_a;
+	const struct image_hash* b = in_b;
+
+	if (a->hash != b->hash)
+		return a->hash < b->hash ? -1 : 1;
+	return a->index - b->index;
+}
+
+static int
+compare_heights(const void* in_a, const void* in_b)
+{
+	// sorts (index, height) pairs tallest first, keeping images of the same
+	// height in their original order so uniform sets come out as a grid.
+
+	const int* a = in_a;
+	const int* b = in_b;
+
+	return a[1] != b[1] ? b[1] - a[1] : a[0] - b[0];
+}
+
+static bool
+fit_skyline(const struct skyline* nodes, int num_nodes, int index, int width, int height, int page_width, int page_height, int* out_y)
+{
+	// finds the lowest y at which a width x height rect starting at the left
+	// edge of the given segment would rest on the skyline.
+
+	int width_left;
+	int y;
+
+	if (nodes[index].x + width > page_width)
+		return false;
+	y = nodes[index].y;
+	width_left = width;
+	while (width_left > 0) {
+		y = fmax(y, nodes[index].y);
+		if (y + height > page_height)
+			return false;
+		width_left -= nodes[index].width;
+		++index;
+	}
+	*out_y = y;
+	return true;
+}
+
+static int
+place_skyline(struct skyline* nodes, int num_nodes, int index, int x, int y, int width, int height)
+{
+	// raises the skyline over a newly placed rect, returning the new number of
+	// segments.  any segments now hidden underneath it are shortened or removed
+	// and neighbors left at the same height are merged.
+
+	int shrink;
+
+	int i;
+
+	memmove(&nodes[index + 1], &nodes[index], (num_nodes - index) * sizeof(struct skyline));
+	nodes[index].x = x;
+	nodes[index].y = y + height;
+	nodes[index].width = width;
+	++num_nodes;
+	for (i = index + 1; i < num_nodes; ++i) {
+		if (nodes[i].x >= nodes[i - 1].x + nodes[i - 1].width)
+			break;
+		shrink = nodes[i - 1].x + nodes[i - 1].width - nodes[i].x;
+		nodes[i].x += shrink;
+		nodes[i].width -= shrink;
+		if (nodes[i].width > 0)
+			break;
+		memmove(&nodes[i], &nodes[i + 1], (num_nodes - i - 1) * sizeof(struct skyline));
+		--num_nodes;
+		--i;
+	}
+	for (i = 0; i < num_nodes - 1; ++i) {
+		if (nodes[i].y != nodes[i + 1].y)
+			continue;
+		nodes[i].width += nodes[i + 1].width;
+		memmove(&nodes[i + 1], &nodes[i + 2], (num_nodes - i - 2) * sizeof(struct skyline));
+		--num_nodes;
+		--i;
+	}
+	return num_nodes;
+}
+
+static void
+reset_shared(struct shared_page* page)
+{
+	page->nodes[0].x = 0;
+	page->nodes[0].y = 0;
+	page->nodes[0].width = get_image_width(page->image);
+	page->num_nodes = 1;
 }
@@ -5,12 +5,20 @@
 
 typedef struct atlas atlas_t;
 
-atlas_t*     atlas_new    (int num_images, int max_width, int max_height);
-void         atlas_free   (atlas_t* atlas);
-image_t*     atlas_image  (const atlas_t* atlas);
-rect_t       atlas_xy     (const atlas_t* atlas, int image_index);
-image_t*     atlas_load   (atlas_t* atlas, sfs_file_t* file, int index, int width, int height);
-void         atlas_lock   (atlas_t* atlas);
-void         atlas_unlock (atlas_t* atlas);
+void         initialize_atlases   (void);
+void         shutdown_atlases     (void);
+atlas_t*     atlas_new            (int num_images, int max_width, int max_height);
+atlas_t*     atlas_new_packed     (int num_images, const int* widths, const int* heights, const uint64_t* hashes);
+void         atlas_free           (atlas_t* atlas);
+bool         atlas_hash_image     (sfs_file_t* file, int width, int height, uint64_t* out_hash);
+image_t*     atlas_image          (const atlas_t* atlas, int page);
+bool         atlas_is_slot_shared (const atlas_t* atlas, int image_index);
+int          atlas_num_pages      (const atlas_t* atlas);
+int          atlas_page           (const atlas_t* atlas, int image_index);
+float_rect_t atlas_uv             (const atlas_t* atlas, int image_index);
+rect_t       atlas_xy             (const atlas_t* atlas, int image_index);
+image_t*     atlas_load           (atlas_t* atlas, sfs_file_t* file, int index, int width, int height);
+void         atlas_lock           (atlas_t* atlas);
+void         atlas_unlock         (atlas_t* atlas);
 
 #endif // MINISPHERE__ATLAS_H__INCLUDED
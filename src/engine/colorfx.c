@@ -0,0 +1,1137 @@
+#include "minisphere.h"
+#include "colorfx.h"
+
+#include "color.h"
+
+// these are the row kernels for the per-pixel effects in image.c (color
+// matrices, lookup tables and color replacement) and the blend modes used by
+// the software rasterizer in raster.c.  every kernel has a portable C version,
+// and SSE2, AVX2 and NEON versions are picked at runtime based on what the CPU
+// supports.  the SIMD versions must produce output identical to the C ones, so
+// if you change the math in one, change it in all of them.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COLORFX_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define COLORFX_AVX2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_FUNC
+#else
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define COLORFX_NEON
+#include <arm_neon.h>
+#endif
+
+// the float kernels for color matrices are only exact while every intermediate sum
+// fits in a float's 24-bit mantissa.  anything with coefficients larger than this
+// (which no sane effect uses) takes the C path instead.
+#define MAX_FLOAT_COEFF  21000
+#define MAX_FLOAT_OFFSET (1 << 30)
+
+// rounded division by 255, exact for 0 <= x <= 255 * 255.  this is what Allegro's
+// blender gives for 8-bit channels, so software and hardware surfaces agree.
+#define DIV255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+#define FILL_CHUNK_SIZE 64
+
+struct kernels
+{
+	const char* isa;
+	void        (*blend_row)   (color_t* dest, const color_t* src, int count, blend_mode_t mode);
+	void        (*lerp_row)    (color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2);
+	void        (*lookup_row)  (color_t* pixels, int count, const colorfx_lut_t* lut);
+	void        (*matrix_row)  (color_t* pixels, int count, const colormatrix_t* matrix);
+	void        (*replace_row) (color_t* pixels, int count, color_t color, color_t new_color);
+	void        (*tint_row)    (color_t* pixels, int count, color_t mask);
+};
+
+static bool     is_float_safe     (const colormatrix_t* matrix);
+static uint32_t pack_color        (color_t color);
+static void     select_kernels    (void);
+static void     unpack_matrix     (const colormatrix_t* matrix, double out_coeffs[12]);
+static void     blend_row_c       (color_t* dest, const color_t* src, int count, blend_mode_t mode);
+static void     lerp_span_c       (color_t* pixels, int start, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2);
+static void     lerp_row_c        (color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2);
+static void     lookup_row_c      (color_t* pixels, int count, const colorfx_lut_t* lut);
+static void     matrix_row_c      (color_t* pixels, int count, const colormatrix_t* matrix);
+static void     replace_row_c     (color_t* pixels, int count, color_t color, color_t new_color);
+static void     tint_row_c        (color_t* pixels, int count, color_t mask);
+#if defined(COLORFX_SSE2)
+static void     blend_row_sse2    (color_t* dest, const color_t* src, int count, blend_mode_t mode);
+static void     lerp_row_sse2     (color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2);
+static void     matrix_row_sse2   (color_t* pixels, int count, const colormatrix_t* matrix);
+static void     replace_row_sse2  (color_t* pixels, int count, color_t color, color_t new_color);
+static void     tint_row_sse2     (color_t* pixels, int count, color_t mask);
+#endif
+#if defined(COLORFX_AVX2)
+static bool     have_avx2         (void);
+static void     blend_row_avx2    (color_t* dest, const color_t* src, int count, blend_mode_t mode);
+static void     lerp_row_avx2     (color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2);
+static void     lookup_row_avx2   (color_t* pixels, int count, const colorfx_lut_t* lut);
+static void     matrix_row_avx2   (color_t* pixels, int count, const colormatrix_t* matrix);
+static void     replace_row_avx2  (color_t* pixels, int count, color_t color, color_t new_color);
+static void     tint_row_avx2     (color_t* pixels, int count, color_t mask);
+#endif
+#if defined(COLORFX_NEON)
+static void     blend_row_neon    (color_t* dest, const color_t* src, int count, blend_mode_t mode);
+static void     matrix_row_neon   (color_t* pixels, int count, const colormatrix_t* matrix);
+static void     replace_row_neon  (color_t* pixels, int count, color_t color, color_t new_color);
+static void     tint_row_neon     (color_t* pixels, int count, color_t mask);
+#endif
+
+static bool           s_have_kernels = false;
+static struct kernels s_kernels;
+
+const char*
+colorfx_isa(void)
+{
+	if (!s_have_kernels)
+		select_kernels();
+	return s_kernels.isa;
+}
+
+void
+colorfx_blend_row(color_t* dest, const color_t* src, int count, blend_mode_t mode)
+{
+	// blends a row of source pixels onto `dest` using one of the Surface blend
+	// modes.  `dest` and `src` may be the same row but must not otherwise overlap.
+
+	if (!s_have_kernels)
+		select_kernels();
+	if (mode == BLEND_REPLACE)
+		memmove(dest, src, count * sizeof(color_t));
+	else
+		s_kernels.blend_row(dest, src, count, mode);
+}
+
+void
+colorfx_fill_row(color_t* dest, int count, color_t color, blend_mode_t mode)
+{
+	color_t chunk[FILL_CHUNK_SIZE];
+	int     size;
+
+	int i;
+
+	if (!s_have_kernels)
+		select_kernels();
+	if (mode == BLEND_REPLACE) {
+		for (i = 0; i < count; ++i)
+			dest[i] = color;
+		return;
+	}
+	size = count < FILL_CHUNK_SIZE ? count : FILL_CHUNK_SIZE;
+	for (i = 0; i < size; ++i)
+		chunk[i] = color;
+	for (i = 0; i < count; i += size)
+		s_kernels.blend_row(&dest[i], chunk, count - i < size ? count - i : size, mode);
+}
+
+void
+colorfx_init_lut(colorfx_lut_t* lut, const uint8_t red_lu[256], const uint8_t green_lu[256], const uint8_t blue_lu[256], const uint8_t alpha_lu[256])
+{
+	// the word tables hold each lookup result already shifted into its channel's
+	// position, so a SIMD kernel can OR four lookups together to get a pixel.
+
+	int i;
+
+	memcpy(lut->bytes[0], red_lu, 256);
+	memcpy(lut->bytes[1], green_lu, 256);
+	memcpy(lut->bytes[2], blue_lu, 256);
+	memcpy(lut->bytes[3], alpha_lu, 256);
+	for (i = 0; i < 256; ++i) {
+		lut->words[0][i] = pack_color(color_new(red_lu[i], 0, 0, 0));
+		lut->words[1][i] = pack_color(color_new(0, green_lu[i], 0, 0));
+		lut->words[2][i] = pack_color(color_new(0, 0, blue_lu[i], 0));
+		lut->words[3][i] = pack_color(color_new(0, 0, 0, alpha_lu[i]));
+	}
+}
+
+void
+colorfx_lerp_row(color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2)
+{
+	// transforms a row of pixels by a color matrix which is linearly interpolated
+	// from `mat_1` at the first pixel to `mat_2` at the last.
+
+	if (!s_have_kernels)
+		select_kernels();
+	if (count < 2)
+		lerp_row_c(pixels, count, mat_1, mat_2);
+	else
+		s_kernels.lerp_row(pixels, count, mat_1, mat_2);
+}
+
+void
+colorfx_lookup_row(color_t* pixels, int count, const colorfx_lut_t* lut)
+{
+	if (!s_have_kernels)
+		select_kernels();
+	s_kernels.lookup_row(pixels, count, lut);
+}
+
+void
+colorfx_matrix_row(color_t* pixels, int count, const colormatrix_t* matrix)
+{
+	if (!s_have_kernels)
+		select_kernels();
+	if (is_float_safe(matrix))
+		s_kernels.matrix_row(pixels, count, matrix);
+	else
+		matrix_row_c(pixels, count, matrix);
+}
+
+void
+colorfx_replace_row(color_t* pixels, int count, color_t color, color_t new_color)
+{
+	if (!s_have_kernels)
+		select_kernels();
+	s_kernels.replace_row(pixels, count, color, new_color);
+}
+
+void
+colorfx_tint_row(color_t* pixels, int count, color_t mask)
+{
+	// multiplies every channel by the matching channel of `mask`, the same way a
+	// tinted bitmap is drawn.
+
+	if (!s_have_kernels)
+		select_kernels();
+	s_kernels.tint_row(pixels, count, mask);
+}
+
+static bool
+is_float_safe(const colormatrix_t* matrix)
+{
+	const int coeffs[] = {
+		matrix->rr, matrix->rg, matrix->rb,
+		matrix->gr, matrix->gg, matrix->gb,
+		matrix->br, matrix->bg, matrix->bb,
+	};
+
+	int i;
+
+	if (abs(matrix->rn) > MAX_FLOAT_OFFSET || abs(matrix->gn) > MAX_FLOAT_OFFSET
+	    || abs(matrix->bn) > MAX_FLOAT_OFFSET)
+	{
+		return false;
+	}
+	for (i = 0; i < 9; ++i) {
+		if (abs(coeffs[i]) > MAX_FLOAT_COEFF)
+			return false;
+	}
+	return true;
+}
+
+static uint32_t
+pack_color(color_t color)
+{
+	uint32_t value;
+
+	memcpy(&value, &color, sizeof(uint32_t));
+	return value;
+}
+
+static void
+select_kernels(void)
+{
+	s_kernels.isa = "C";
+	s_kernels.blend_row = blend_row_c;
+	s_kernels.lerp_row = lerp_row_c;
+	s_kernels.lookup_row = lookup_row_c;
+	s_kernels.matrix_row = matrix_row_c;
+	s_kernels.replace_row = replace_row_c;
+	s_kernels.tint_row = tint_row_c;
+	if (is_cpu_little_endian()) {
+#if defined(COLORFX_SSE2)
+		s_kernels.isa = "SSE2";
+		s_kernels.blend_row = blend_row_sse2;
+		s_kernels.lerp_row = lerp_row_sse2;
+		s_kernels.matrix_row = matrix_row_sse2;
+		s_kernels.replace_row = replace_row_sse2;
+		s_kernels.tint_row = tint_row_sse2;
+#endif
+#if defined(COLORFX_AVX2)
+		if (have_avx2()) {
+			s_kernels.isa = "AVX2";
+			s_kernels.blend_row = blend_row_avx2;
+			s_kernels.lerp_row = lerp_row_avx2;
+			s_kernels.lookup_row = lookup_row_avx2;
+			s_kernels.matrix_row = matrix_row_avx2;
+			s_kernels.replace_row = replace_row_avx2;
+			s_kernels.tint_row = tint_row_avx2;
+		}
+#endif
+#if defined(COLORFX_NEON)
+		s_kernels.isa = "NEON";
+		s_kernels.blend_row = blend_row_neon;
+		s_kernels.matrix_row = matrix_row_neon;
+		s_kernels.replace_row = replace_row_neon;
+		s_kernels.tint_row = tint_row_neon;
+#endif
+	}
+	console_log(2, "using %s kernels for Surface effects and blending", s_kernels.isa);
+	s_have_kernels = true;
+}
+
+static void
+unpack_matrix(const colormatrix_t* matrix, double out_coeffs[12])
+{
+	out_coeffs[0] = matrix->rn; out_coeffs[1] = matrix->rr;
+	out_coeffs[2] = matrix->rg; out_coeffs[3] = matrix->rb;
+	out_coeffs[4] = matrix->gn; out_coeffs[5] = matrix->gr;
+	out_coeffs[6] = matrix->gg; out_coeffs[7] = matrix->gb;
+	out_coeffs[8] = matrix->bn; out_coeffs[9] = matrix->br;
+	out_coeffs[10] = matrix->bg; out_coeffs[11] = matrix->bb;
+}
+
+static void
+blend_row_c(color_t* dest, const color_t* src, int count, blend_mode_t mode)
+{
+	color_t* d;
+	color_t  s;
+
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		d = &dest[i];
+		s = src[i];
+		switch (mode) {
+		case BLEND_BLEND:
+			d->r = DIV255(s.r * s.alpha + d->r * (255 - s.alpha));
+			d->g = DIV255(s.g * s.alpha + d->g * (255 - s.alpha));
+			d->b = DIV255(s.b * s.alpha + d->b * (255 - s.alpha));
+			d->alpha = d->alpha + DIV255(s.alpha * (255 - d->alpha));
+			break;
+		case BLEND_REPLACE:
+			*d = s;
+			break;
+		case BLEND_RGB_ONLY:
+			d->r = s.r; d->g = s.g; d->b = s.b;
+			break;
+		case BLEND_ALPHA_ONLY:
+			d->alpha = s.alpha;
+			break;
+		case BLEND_ADD:
+			d->r = d->r + s.r < 255 ? d->r + s.r : 255;
+			d->g = d->g + s.g < 255 ? d->g + s.g : 255;
+			d->b = d->b + s.b < 255 ? d->b + s.b : 255;
+			d->alpha = d->alpha + s.alpha < 255 ? d->alpha + s.alpha : 255;
+			break;
+		case BLEND_SUBTRACT:
+			d->r = d->r > s.r ? d->r - s.r : 0;
+			d->g = d->g > s.g ? d->g - s.g : 0;
+			d->b = d->b > s.b ? d->b - s.b : 0;
+			d->alpha = d->alpha > s.alpha ? d->alpha - s.alpha : 0;
+			break;
+		case BLEND_MULTIPLY:
+			d->r = DIV255(s.r * d->r);
+			d->g = DIV255(s.g * d->g);
+			d->b = DIV255(s.b * d->b);
+			break;
+		case BLEND_AVERAGE:
+			d->r = (s.r + d->r + 1) >> 1;
+			d->g = (s.g + d->g + 1) >> 1;
+			d->b = (s.b + d->b + 1) >> 1;
+			d->alpha = (s.alpha + d->alpha + 1) >> 1;
+			break;
+		case BLEND_INVERT:
+			d->r = DIV255(d->r * (255 - s.r));
+			d->g = DIV255(d->g * (255 - s.g));
+			d->b = DIV255(d->b * (255 - s.b));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void
+lerp_span_c(color_t* pixels, int start, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2)
+{
+	colormatrix_t matrix;
+
+	int i;
+
+	for (i = start; i < count; ++i) {
+		matrix = count > 1
+			? colormatrix_lerp(*mat_1, *mat_2, count - 1 - i, i)
+			: *mat_1;
+		pixels[i] = color_transform(pixels[i], matrix);
+	}
+}
+
+static void
+lerp_row_c(color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2)
+{
+	lerp_span_c(pixels, 0, count, mat_1, mat_2);
+}
+
+static void
+lookup_row_c(color_t* pixels, int count, const colorfx_lut_t* lut)
+{
+	color_t* pixel;
+
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		pixel = &pixels[i];
+		pixel->r = lut->bytes[0][pixel->r];
+		pixel->g = lut->bytes[1][pixel->g];
+		pixel->b = lut->bytes[2][pixel->b];
+		pixel->alpha = lut->bytes[3][pixel->alpha];
+	}
+}
+
+static void
+matrix_row_c(color_t* pixels, int count, const colormatrix_t* matrix)
+{
+	int i;
+
+	for (i = 0; i < count; ++i)
+		pixels[i] = color_transform(pixels[i], *matrix);
+}
+
+static void
+replace_row_c(color_t* pixels, int count, color_t color, color_t new_color)
+{
+	color_t* pixel;
+
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		pixel = &pixels[i];
+		if (pixel->r == color.r && pixel->g == color.g && pixel->b == color.b
+		    && pixel->alpha == color.alpha)
+		{
+			*pixel = new_color;
+		}
+	}
+}
+
+static void
+tint_row_c(color_t* pixels, int count, color_t mask)
+{
+	color_t* pixel;
+
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		pixel = &pixels[i];
+		pixel->r = DIV255(pixel->r * mask.r);
+		pixel->g = DIV255(pixel->g * mask.g);
+		pixel->b = DIV255(pixel->b * mask.b);
+		pixel->alpha = DIV255(pixel->alpha * mask.alpha);
+	}
+}
+
+#if defined(COLORFX_SSE2)
+static __m128i
+div255_sse2(__m128i x)
+{
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static __m128i
+mul_sse2(__m128i a, __m128i b)
+{
+	// per-byte DIV255(a * b)
+
+	__m128i hi;
+	__m128i lo;
+	__m128i zero;
+
+	zero = _mm_setzero_si128();
+	lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+	hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+	return _mm_packus_epi16(lo, hi);
+}
+
+static __m128i
+blend_half_sse2(__m128i d, __m128i s)
+{
+	// BLEND_BLEND for two pixels unpacked to 16 bits per channel
+
+	__m128i a;
+	__m128i alpha;
+	__m128i da;
+	__m128i is_alpha;
+	__m128i max;
+	__m128i rgb;
+
+	max = _mm_set1_epi16(255);
+	is_alpha = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	da = _mm_shufflehi_epi16(_mm_shufflelo_epi16(d, 0xFF), 0xFF);
+	rgb = div255_sse2(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(max, a))));
+	alpha = _mm_add_epi16(d, div255_sse2(_mm_mullo_epi16(s, _mm_sub_epi16(max, da))));
+	return _mm_or_si128(_mm_andnot_si128(is_alpha, rgb), _mm_and_si128(is_alpha, alpha));
+}
+
+static void
+blend_row_sse2(color_t* dest, const color_t* src, int count, blend_mode_t mode)
+{
+	__m128i alpha_mask;
+	__m128i d;
+	__m128i s;
+	__m128i zero;
+
+	int i;
+
+	alpha_mask = _mm_set1_epi32(0xFF000000);
+	zero = _mm_setzero_si128();
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = _mm_loadu_si128((const __m128i*)&src[i]);
+		d = _mm_loadu_si128((const __m128i*)&dest[i]);
+		switch (mode) {
+		case BLEND_BLEND:
+			d = _mm_packus_epi16(
+				blend_half_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero)),
+				blend_half_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero)));
+			break;
+		case BLEND_RGB_ONLY:
+			d = _mm_or_si128(_mm_andnot_si128(alpha_mask, s), _mm_and_si128(alpha_mask, d));
+			break;
+		case BLEND_ALPHA_ONLY:
+			d = _mm_or_si128(_mm_and_si128(alpha_mask, s), _mm_andnot_si128(alpha_mask, d));
+			break;
+		case BLEND_ADD:
+			d = _mm_adds_epu8(d, s);
+			break;
+		case BLEND_SUBTRACT:
+			d = _mm_subs_epu8(d, s);
+			break;
+		case BLEND_MULTIPLY:
+			d = _mm_or_si128(_mm_andnot_si128(alpha_mask, mul_sse2(d, s)), _mm_and_si128(alpha_mask, d));
+			break;
+		case BLEND_AVERAGE:
+			d = _mm_avg_epu8(d, s);
+			break;
+		case BLEND_INVERT:
+			s = _mm_xor_si128(s, _mm_set1_epi32(-1));
+			d = _mm_or_si128(_mm_andnot_si128(alpha_mask, mul_sse2(d, s)), _mm_and_si128(alpha_mask, d));
+			break;
+		default:
+			break;
+		}
+		_mm_storeu_si128((__m128i*)&dest[i], d);
+	}
+	blend_row_c(&dest[i], &src[i], count - i, mode);
+}
+
+static __m128i
+transform_sse2(const __m128 rgb[3], const __m128 coeffs[3], __m128i offset)
+{
+	// computes `offset + (kr * r + kg * g + kb * b) / 255` for one channel of four
+	// pixels, truncated and clamped to [0,255] exactly as color_transform() does.
+
+	__m128i max;
+	__m128i over;
+	__m128  sum;
+	__m128i value;
+
+	sum = _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(coeffs[0], rgb[0]),
+		_mm_mul_ps(coeffs[1], rgb[1])),
+		_mm_mul_ps(coeffs[2], rgb[2]));
+	value = _mm_add_epi32(offset, _mm_cvttps_epi32(_mm_div_ps(sum, _mm_set1_ps(255.0f))));
+	value = _mm_andnot_si128(_mm_cmplt_epi32(value, _mm_setzero_si128()), value);
+	max = _mm_set1_epi32(255);
+	over = _mm_cmpgt_epi32(value, max);
+	return _mm_or_si128(_mm_andnot_si128(over, value), _mm_and_si128(over, max));
+}
+
+static __m128d
+transform_sse2_pd(const __m128d rgb[3], const __m128d coeffs[4])
+{
+	// double-precision version of transform_sse2() for two pixels with
+	// per-pixel coefficients.  coeffs[0] is the offset.
+
+	__m128d sum;
+	__m128d value;
+
+	sum = _mm_add_pd(_mm_add_pd(
+		_mm_mul_pd(coeffs[1], rgb[0]),
+		_mm_mul_pd(coeffs[2], rgb[1])),
+		_mm_mul_pd(coeffs[3], rgb[2]));
+	value = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(sum, _mm_set1_pd(255.0))));
+	value = _mm_add_pd(coeffs[0], value);
+	return _mm_min_pd(_mm_max_pd(value, _mm_setzero_pd()), _mm_set1_pd(255.0));
+}
+
+static void
+lerp_row_sse2(color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2)
+{
+	__m128i alpha_mask;
+	__m128i channels[3];
+	__m128d coeffs[12];
+	double  k1[12], k2[12];
+	__m128i mask;
+	__m128i px;
+	__m128d rgb[3];
+	__m128d sigma;
+	__m128d weight_1, weight_2;
+
+	int i, j;
+
+	unpack_matrix(mat_1, k1);
+	unpack_matrix(mat_2, k2);
+	mask = _mm_set1_epi32(0xFF);
+	alpha_mask = _mm_slli_epi32(mask, 24);
+	sigma = _mm_set1_pd(count - 1);
+	for (i = 0; i + 2 <= count; i += 2) {
+		// interpolate the matrix for both pixels.  this is the same integer division
+		// colormatrix_lerp() does, carried out in doubles which represent every
+		// intermediate value exactly.
+		weight_2 = _mm_set_pd(i + 1, i);
+		weight_1 = _mm_sub_pd(sigma, weight_2);
+		for (j = 0; j < 12; ++j) {
+			coeffs[j] = _mm_add_pd(
+				_mm_mul_pd(_mm_set1_pd(k1[j]), weight_1),
+				_mm_mul_pd(_mm_set1_pd(k2[j]), weight_2));
+			coeffs[j] = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_div_pd(coeffs[j], sigma)));
+		}
+		px = _mm_loadl_epi64((const __m128i*)&pixels[i]);
+		rgb[0] = _mm_cvtepi32_pd(_mm_and_si128(px, mask));
+		rgb[1] = _mm_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+		rgb[2] = _mm_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+		channels[0] = _mm_cvttpd_epi32(transform_sse2_pd(rgb, &coeffs[0]));
+		channels[1] = _mm_cvttpd_epi32(transform_sse2_pd(rgb, &coeffs[4]));
+		channels[2] = _mm_cvttpd_epi32(transform_sse2_pd(rgb, &coeffs[8]));
+		px = _mm_or_si128(_mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+			_mm_or_si128(_mm_slli_epi32(channels[2], 16), _mm_and_si128(px, alpha_mask)));
+		_mm_storel_epi64((__m128i*)&pixels[i], px);
+	}
+	lerp_span_c(pixels, i, count, mat_1, mat_2);
+}
+
+static void
+matrix_row_sse2(color_t* pixels, int count, const colormatrix_t* matrix)
+{
+	__m128i alpha_mask;
+	__m128i channels[3];
+	__m128  coeffs[9];
+	__m128i mask;
+	__m128i offsets[3];
+	__m128i px;
+	__m128  rgb[3];
+
+	int i;
+
+	coeffs[0] = _mm_set1_ps(matrix->rr); coeffs[1] = _mm_set1_ps(matrix->rg); coeffs[2] = _mm_set1_ps(matrix->rb);
+	coeffs[3] = _mm_set1_ps(matrix->gr); coeffs[4] = _mm_set1_ps(matrix->gg); coeffs[5] = _mm_set1_ps(matrix->gb);
+	coeffs[6] = _mm_set1_ps(matrix->br); coeffs[7] = _mm_set1_ps(matrix->bg); coeffs[8] = _mm_set1_ps(matrix->bb);
+	offsets[0] = _mm_set1_epi32(matrix->rn);
+	offsets[1] = _mm_set1_epi32(matrix->gn);
+	offsets[2] = _mm_set1_epi32(matrix->bn);
+	mask = _mm_set1_epi32(0xFF);
+	alpha_mask = _mm_slli_epi32(mask, 24);
+	for (i = 0; i + 4 <= count; i += 4) {
+		px = _mm_loadu_si128((const __m128i*)&pixels[i]);
+		rgb[0] = _mm_cvtepi32_ps(_mm_and_si128(px, mask));
+		rgb[1] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+		rgb[2] = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+		channels[0] = transform_sse2(rgb, &coeffs[0], offsets[0]);
+		channels[1] = transform_sse2(rgb, &coeffs[3], offsets[1]);
+		channels[2] = transform_sse2(rgb, &coeffs[6], offsets[2]);
+		px = _mm_or_si128(_mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+			_mm_or_si128(_mm_slli_epi32(channels[2], 16), _mm_and_si128(px, alpha_mask)));
+		_mm_storeu_si128((__m128i*)&pixels[i], px);
+	}
+	matrix_row_c(&pixels[i], count - i, matrix);
+}
+
+static void
+replace_row_sse2(color_t* pixels, int count, color_t color, color_t new_color)
+{
+	__m128i is_match;
+	__m128i key;
+	__m128i px;
+	__m128i value;
+
+	int i;
+
+	key = _mm_set1_epi32(pack_color(color));
+	value = _mm_set1_epi32(pack_color(new_color));
+	for (i = 0; i + 4 <= count; i += 4) {
+		px = _mm_loadu_si128((const __m128i*)&pixels[i]);
+		is_match = _mm_cmpeq_epi32(px, key);
+		px = _mm_or_si128(_mm_andnot_si128(is_match, px), _mm_and_si128(is_match, value));
+		_mm_storeu_si128((__m128i*)&pixels[i], px);
+	}
+	replace_row_c(&pixels[i], count - i, color, new_color);
+}
+
+static void
+tint_row_sse2(color_t* pixels, int count, color_t mask)
+{
+	__m128i px;
+	__m128i tint;
+
+	int i;
+
+	tint = _mm_set1_epi32(pack_color(mask));
+	for (i = 0; i + 4 <= count; i += 4) {
+		px = _mm_loadu_si128((const __m128i*)&pixels[i]);
+		_mm_storeu_si128((__m128i*)&pixels[i], mul_sse2(px, tint));
+	}
+	tint_row_c(&pixels[i], count - i, mask);
+}
+#endif
+
+#if defined(COLORFX_AVX2)
+static bool
+have_avx2(void)
+{
+#if defined(_MSC_VER)
+	int info[4];
+
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))  // OSXSAVE, AVX
+		return false;
+	if ((_xgetbv(0) & 0x6) != 0x6)  // OS must preserve YMM registers
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+static AVX2_FUNC __m256i
+div255_avx2(__m256i x)
+{
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static AVX2_FUNC __m256i
+mul_avx2(__m256i a, __m256i b)
+{
+	__m256i hi;
+	__m256i lo;
+	__m256i zero;
+
+	zero = _mm256_setzero_si256();
+	lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)));
+	hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)));
+	return _mm256_packus_epi16(lo, hi);
+}
+
+static AVX2_FUNC __m256i
+blend_half_avx2(__m256i d, __m256i s)
+{
+	__m256i a;
+	__m256i alpha;
+	__m256i da;
+	__m256i is_alpha;
+	__m256i max;
+	__m256i rgb;
+
+	max = _mm256_set1_epi16(255);
+	is_alpha = _mm256_set1_epi64x((long long)0xFFFF000000000000ULL);
+	a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+	da = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(d, 0xFF), 0xFF);
+	rgb = div255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, _mm256_sub_epi16(max, a))));
+	alpha = _mm256_add_epi16(d, div255_avx2(_mm256_mullo_epi16(s, _mm256_sub_epi16(max, da))));
+	return _mm256_blendv_epi8(rgb, alpha, is_alpha);
+}
+
+static AVX2_FUNC void
+blend_row_avx2(color_t* dest, const color_t* src, int count, blend_mode_t mode)
+{
+	__m256i alpha_mask;
+	__m256i d;
+	__m256i s;
+	__m256i zero;
+
+	int i;
+
+	alpha_mask = _mm256_set1_epi32(0xFF000000);
+	zero = _mm256_setzero_si256();
+	for (i = 0; i + 8 <= count; i += 8) {
+		s = _mm256_loadu_si256((const __m256i*)&src[i]);
+		d = _mm256_loadu_si256((const __m256i*)&dest[i]);
+		switch (mode) {
+		case BLEND_BLEND:
+			d = _mm256_packus_epi16(
+				blend_half_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero)),
+				blend_half_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero)));
+			break;
+		case BLEND_RGB_ONLY:
+			d = _mm256_blendv_epi8(s, d, alpha_mask);
+			break;
+		case BLEND_ALPHA_ONLY:
+			d = _mm256_blendv_epi8(d, s, alpha_mask);
+			break;
+		case BLEND_ADD:
+			d = _mm256_adds_epu8(d, s);
+			break;
+		case BLEND_SUBTRACT:
+			d = _mm256_subs_epu8(d, s);
+			break;
+		case BLEND_MULTIPLY:
+			d = _mm256_blendv_epi8(mul_avx2(d, s), d, alpha_mask);
+			break;
+		case BLEND_AVERAGE:
+			d = _mm256_avg_epu8(d, s);
+			break;
+		case BLEND_INVERT:
+			s = _mm256_xor_si256(s, _mm256_set1_epi32(-1));
+			d = _mm256_blendv_epi8(mul_avx2(d, s), d, alpha_mask);
+			break;
+		default:
+			break;
+		}
+		_mm256_storeu_si256((__m256i*)&dest[i], d);
+	}
+	blend_row_c(&dest[i], &src[i], count - i, mode);
+}
+
+static AVX2_FUNC __m256i
+transform_avx2(const __m256 rgb[3], const __m256 coeffs[3], __m256i offset)
+{
+	__m256  sum;
+	__m256i value;
+
+	sum = _mm256_add_ps(_mm256_add_ps(
+		_mm256_mul_ps(coeffs[0], rgb[0]),
+		_mm256_mul_ps(coeffs[1], rgb[1])),
+		_mm256_mul_ps(coeffs[2], rgb[2]));
+	value = _mm256_add_epi32(offset, _mm256_cvttps_epi32(_mm256_div_ps(sum, _mm256_set1_ps(255.0f))));
+	return _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+static AVX2_FUNC __m128i
+transform_avx2_pd(const __m256d rgb[3], const __m256d coeffs[4])
+{
+	__m256d sum;
+	__m256d value;
+
+	sum = _mm256_add_pd(_mm256_add_pd(
+		_mm256_mul_pd(coeffs[1], rgb[0]),
+		_mm256_mul_pd(coeffs[2], rgb[1])),
+		_mm256_mul_pd(coeffs[3], rgb[2]));
+	value = _mm256_round_pd(_mm256_div_pd(sum, _mm256_set1_pd(255.0)), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+	value = _mm256_add_pd(coeffs[0], value);
+	value = _mm256_min_pd(_mm256_max_pd(value, _mm256_setzero_pd()), _mm256_set1_pd(255.0));
+	return _mm256_cvttpd_epi32(value);
+}
+
+static AVX2_FUNC void
+lerp_row_avx2(color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2)
+{
+	__m128i alpha_mask;
+	__m128i channels[3];
+	__m256d coeffs[12];
+	double  k1[12], k2[12];
+	__m128i mask;
+	__m128i px;
+	__m256d rgb[3];
+	__m256d sigma;
+	__m256d weight_1, weight_2;
+
+	int i, j;
+
+	unpack_matrix(mat_1, k1);
+	unpack_matrix(mat_2, k2);
+	mask = _mm_set1_epi32(0xFF);
+	alpha_mask = _mm_slli_epi32(mask, 24);
+	sigma = _mm256_set1_pd(count - 1);
+	for (i = 0; i + 4 <= count; i += 4) {
+		weight_2 = _mm256_set_pd(i + 3, i + 2, i + 1, i);
+		weight_1 = _mm256_sub_pd(sigma, weight_2);
+		for (j = 0; j < 12; ++j) {
+			coeffs[j] = _mm256_add_pd(
+				_mm256_mul_pd(_mm256_set1_pd(k1[j]), weight_1),
+				_mm256_mul_pd(_mm256_set1_pd(k2[j]), weight_2));
+			coeffs[j] = _mm256_round_pd(_mm256_div_pd(coeffs[j], sigma), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+		}
+		px = _mm_loadu_si128((const __m128i*)&pixels[i]);
+		rgb[0] = _mm256_cvtepi32_pd(_mm_and_si128(px, mask));
+		rgb[1] = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(px, 8), mask));
+		rgb[2] = _mm256_cvtepi32_pd(_mm_and_si128(_mm_srli_epi32(px, 16), mask));
+		channels[0] = transform_avx2_pd(rgb, &coeffs[0]);
+		channels[1] = transform_avx2_pd(rgb, &coeffs[4]);
+		channels[2] = transform_avx2_pd(rgb, &coeffs[8]);
+		px = _mm_or_si128(_mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+			_mm_or_si128(_mm_slli_epi32(channels[2], 16), _mm_and_si128(px, alpha_mask)));
+		_mm_storeu_si128((__m128i*)&pixels[i], px);
+	}
+	lerp_span_c(pixels, i, count, mat_1, mat_2);
+}
+
+static AVX2_FUNC void
+lookup_row_avx2(color_t* pixels, int count, const colorfx_lut_t* lut)
+{
+	__m256i mask;
+	__m256i px;
+	__m256i value;
+
+	int i;
+
+	mask = _mm256_set1_epi32(0xFF);
+	for (i = 0; i + 8 <= count; i += 8) {
+		px = _mm256_loadu_si256((const __m256i*)&pixels[i]);
+		value = _mm256_i32gather_epi32((const int*)lut->words[0], _mm256_and_si256(px, mask), 4);
+		value = _mm256_or_si256(value, _mm256_i32gather_epi32((const int*)lut->words[1],
+			_mm256_and_si256(_mm256_srli_epi32(px, 8), mask), 4));
+		value = _mm256_or_si256(value, _mm256_i32gather_epi32((const int*)lut->words[2],
+			_mm256_and_si256(_mm256_srli_epi32(px, 16), mask), 4));
+		value = _mm256_or_si256(value, _mm256_i32gather_epi32((const int*)lut->words[3],
+			_mm256_srli_epi32(px, 24), 4));
+		_mm256_storeu_si256((__m256i*)&pixels[i], value);
+	}
+	lookup_row_c(&pixels[i], count - i, lut);
+}
+
+static AVX2_FUNC void
+matrix_row_avx2(color_t* pixels, int count, const colormatrix_t* matrix)
+{
+	__m256i alpha_mask;
+	__m256i channels[3];
+	__m256  coeffs[9];
+	__m256i mask;
+	__m256i offsets[3];
+	__m256i px;
+	__m256  rgb[3];
+
+	int i;
+
+	coeffs[0] = _mm256_set1_ps(matrix->rr); coeffs[1] = _mm256_set1_ps(matrix->rg); coeffs[2] = _mm256_set1_ps(matrix->rb);
+	coeffs[3] = _mm256_set1_ps(matrix->gr); coeffs[4] = _mm256_set1_ps(matrix->gg); coeffs[5] = _mm256_set1_ps(matrix->gb);
+	coeffs[6] = _mm256_set1_ps(matrix->br); coeffs[7] = _mm256_set1_ps(matrix->bg); coeffs[8] = _mm256_set1_ps(matrix->bb);
+	offsets[0] = _mm256_set1_epi32(matrix->rn);
+	offsets[1] = _mm256_set1_epi32(matrix->gn);
+	offsets[2] = _mm256_set1_epi32(matrix->bn);
+	mask = _mm256_set1_epi32(0xFF);
+	alpha_mask = _mm256_slli_epi32(mask, 24);
+	for (i = 0; i + 8 <= count; i += 8) {
+		px = _mm256_loadu_si256((const __m256i*)&pixels[i]);
+		rgb[0] = _mm256_cvtepi32_ps(_mm256_and_si256(px, mask));
+		rgb[1] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8), mask));
+		rgb[2] = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 16), mask));
+		channels[0] = transform_avx2(rgb, &coeffs[0], offsets[0]);
+		channels[1] = transform_avx2(rgb, &coeffs[3], offsets[1]);
+		channels[2] = transform_avx2(rgb, &coeffs[6], offsets[2]);
+		px = _mm256_or_si256(_mm256_or_si256(channels[0], _mm256_slli_epi32(channels[1], 8)),
+			_mm256_or_si256(_mm256_slli_epi32(channels[2], 16), _mm256_and_si256(px, alpha_mask)));
+		_mm256_storeu_si256((__m256i*)&pixels[i], px);
+	}
+	matrix_row_c(&pixels[i], count - i, matrix);
+}
+
+static AVX2_FUNC void
+replace_row_avx2(color_t* pixels, int count, color_t color, color_t new_color)
+{
+	__m256i key;
+	__m256i px;
+	__m256i value;
+
+	int i;
+
+	key = _mm256_set1_epi32(pack_color(color));
+	value = _mm256_set1_epi32(pack_color(new_color));
+	for (i = 0; i + 8 <= count; i += 8) {
+		px = _mm256_loadu_si256((const __m256i*)&pixels[i]);
+		px = _mm256_blendv_epi8(px, value, _mm256_cmpeq_epi32(px, key));
+		_mm256_storeu_si256((__m256i*)&pixels[i], px);
+	}
+	replace_row_c(&pixels[i], count - i, color, new_color);
+}
+
+static AVX2_FUNC void
+tint_row_avx2(color_t* pixels, int count, color_t mask)
+{
+	__m256i px;
+	__m256i tint;
+
+	int i;
+
+	tint = _mm256_set1_epi32(pack_color(mask));
+	for (i = 0; i + 8 <= count; i += 8) {
+		px = _mm256_loadu_si256((const __m256i*)&pixels[i]);
+		_mm256_storeu_si256((__m256i*)&pixels[i], mul_avx2(px, tint));
+	}
+	tint_row_c(&pixels[i], count - i, mask);
+}
+#endif
+
+#if defined(COLORFX_NEON)
+static uint8x16_t
+mul_neon(uint8x16_t a, uint8x16_t b)
+{
+	// per-byte DIV255(a * b).  vraddhn(x, (x + 128) >> 8) is exactly DIV255(x).
+
+	uint16x8_t hi;
+	uint16x8_t lo;
+
+	lo = vmull_u8(vget_low_u8(a), vget_low_u8(b));
+	hi = vmull_u8(vget_high_u8(a), vget_high_u8(b));
+	return vcombine_u8(
+		vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+		vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+}
+
+static uint8x16_t
+splat_alpha_neon(uint8x16_t px)
+{
+	return vreinterpretq_u8_u32(vmulq_u32(
+		vshrq_n_u32(vreinterpretq_u32_u8(px), 24), vdupq_n_u32(0x01010101)));
+}
+
+static void
+blend_row_neon(color_t* dest, const color_t* src, int count, blend_mode_t mode)
+{
+	uint8x16_t a;
+	uint8x16_t alpha;
+	uint8x16_t alpha_mask;
+	uint8x16_t d;
+	uint16x8_t hi;
+	uint16x8_t lo;
+	uint8x16_t max;
+	uint8x16_t rgb;
+	uint8x16_t s;
+
+	int i;
+
+	alpha_mask = vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000));
+	max = vdupq_n_u8(255);
+	for (i = 0; i + 4 <= count; i += 4) {
+		s = vld1q_u8((const uint8_t*)&src[i]);
+		d = vld1q_u8((const uint8_t*)&dest[i]);
+		switch (mode) {
+		case BLEND_BLEND:
+			a = splat_alpha_neon(s);
+			lo = vmlal_u8(vmull_u8(vget_low_u8(s), vget_low_u8(a)), vget_low_u8(d), vget_low_u8(vsubq_u8(max, a)));
+			hi = vmlal_u8(vmull_u8(vget_high_u8(s), vget_high_u8(a)), vget_high_u8(d), vget_high_u8(vsubq_u8(max, a)));
+			rgb = vcombine_u8(
+				vraddhn_u16(lo, vrshrq_n_u16(lo, 8)),
+				vraddhn_u16(hi, vrshrq_n_u16(hi, 8)));
+			alpha = vaddq_u8(d, mul_neon(s, vsubq_u8(max, splat_alpha_neon(d))));
+			d = vbslq_u8(alpha_mask, alpha, rgb);
+			break;
+		case BLEND_RGB_ONLY:
+			d = vbslq_u8(alpha_mask, d, s);
+			break;
+		case BLEND_ALPHA_ONLY:
+			d = vbslq_u8(alpha_mask, s, d);
+			break;
+		case BLEND_ADD:
+			d = vqaddq_u8(d, s);
+			break;
+		case BLEND_SUBTRACT:
+			d = vqsubq_u8(d, s);
+			break;
+		case BLEND_MULTIPLY:
+			d = vbslq_u8(alpha_mask, d, mul_neon(d, s));
+			break;
+		case BLEND_AVERAGE:
+			d = vrhaddq_u8(d, s);
+			break;
+		case BLEND_INVERT:
+			d = vbslq_u8(alpha_mask, d, mul_neon(d, vmvnq_u8(s)));
+			break;
+		default:
+			break;
+		}
+		vst1q_u8((uint8_t*)&dest[i], d);
+	}
+	blend_row_c(&dest[i], &src[i], count - i, mode);
+}
+
+static void
+matrix_row_neon(color_t* pixels, int count, const colormatrix_t* matrix)
+{
+	uint32x4_t  alpha_mask;
+	int32x4_t   channels[3];
+	float32x4_t coeffs[9];
+	float32x4_t divisor;
+	uint32x4_t  mask;
+	int32x4_t   max;
+	int32x4_t   offsets[3];
+	uint32x4_t  px;
+	float32x4_t rgb[3];
+	float32x4_t sum;
+	int32x4_t   zero;
+
+	int i, j;
+
+	coeffs[0] = vdupq_n_f32(matrix->rr); coeffs[1] = vdupq_n_f32(matrix->rg); coeffs[2] = vdupq_n_f32(matrix->rb);
+	coeffs[3] = vdupq_n_f32(matrix->gr); coeffs[4] = vdupq_n_f32(matrix->gg); coeffs[5] = vdupq_n_f32(matrix->gb);
+	coeffs[6] = vdupq_n_f32(matrix->br); coeffs[7] = vdupq_n_f32(matrix->bg); coeffs[8] = vdupq_n_f32(matrix->bb);
+	offsets[0] = vdupq_n_s32(matrix->rn);
+	offsets[1] = vdupq_n_s32(matrix->gn);
+	offsets[2] = vdupq_n_s32(matrix->bn);
+	mask = vdupq_n_u32(0xFF);
+	alpha_mask = vshlq_n_u32(mask, 24);
+	divisor = vdupq_n_f32(255.0f);
+	max = vdupq_n_s32(255);
+	zero = vdupq_n_s32(0);
+	for (i = 0; i + 4 <= count; i += 4) {
+		px = vld1q_u32((const uint32_t*)&pixels[i]);
+		rgb[0] = vcvtq_f32_u32(vandq_u32(px, mask));
+		rgb[1] = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(px, 8), mask));
+		rgb[2] = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(px, 16), mask));
+		for (j = 0; j < 3; ++j) {
+			sum = vaddq_f32(vaddq_f32(
+				vmulq_f32(coeffs[j * 3 + 0], rgb[0]),
+				vmulq_f32(coeffs[j * 3 + 1], rgb[1])),
+				vmulq_f32(coeffs[j * 3 + 2], rgb[2]));
+			channels[j] = vaddq_s32(offsets[j], vcvtq_s32_f32(vdivq_f32(sum, divisor)));
+			channels[j] = vminq_s32(vmaxq_s32(channels[j], zero), max);
+		}
+		px = vorrq_u32(
+			vorrq_u32(vreinterpretq_u32_s32(channels[0]), vshlq_n_u32(vreinterpretq_u32_s32(channels[1]), 8)),
+			vorrq_u32(vshlq_n_u32(vreinterpretq_u32_s32(channels[2]), 16), vandq_u32(px, alpha_mask)));
+		vst1q_u32((uint32_t*)&pixels[i], px);
+	}
+	matrix_row_c(&pixels[i], count - i, matrix);
+}
+
+static void
+replace_row_neon(color_t* pixels, int count, color_t color, color_t new_color)
+{
+	uint32x4_t key;
+	uint32x4_t px;
+	uint32x4_t value;
+
+	int i;
+
+	key = vdupq_n_u32(pack_color(color));
+	value = vdupq_n_u32(pack_color(new_color));
+	for (i = 0; i + 4 <= count; i += 4) {
+		px = vld1q_u32((const uint32_t*)&pixels[i]);
+		px = vbslq_u32(vceqq_u32(px, key), value, px);
+		vst1q_u32((uint32_t*)&pixels[i], px);
+	}
+	replace_row_c(&pixels[i], count - i, color, new_color);
+}
+
+static void
+tint_row_neon(color_t* pixels, int count, color_t mask)
+{
+	uint8x16_t px;
+	uint8x16_t tint;
+
+	int i;
+
+	tint = vreinterpretq_u8_u32(vdupq_n_u32(pack_color(mask)));
+	for (i = 0; i + 4 <= count; i += 4) {
+		px = vld1q_u8((const uint8_t*)&pixels[i]);
+		vst1q_u8((uint8_t*)&pixels[i], mul_neon(px, tint));
+	}
+	tint_row_c(&pixels[i], count - i, mask);
+}
+#endif
@@ -0,0 +1,24 @@
+#ifndef MINISPHERE__COLORFX_H__INCLUDED
+#define MINISPHERE__COLORFX_H__INCLUDED
+
+#include "color.h"
+#include "surface.h"
+
+typedef
+struct colorfx_lut
+{
+	uint8_t  bytes[4][256];
+	uint32_t words[4][256];
+} colorfx_lut_t;
+
+const char* colorfx_isa          (void);
+void        colorfx_blend_row    (color_t* dest, const color_t* src, int count, blend_mode_t mode);
+void        colorfx_fill_row     (color_t* dest, int count, color_t color, blend_mode_t mode);
+void        colorfx_init_lut     (colorfx_lut_t* lut, const uint8_t red_lu[256], const uint8_t green_lu[256], const uint8_t blue_lu[256], const uint8_t alpha_lu[256]);
+void        colorfx_lerp_row     (color_t* pixels, int count, const colormatrix_t* mat_1, const colormatrix_t* mat_2);
+void        colorfx_lookup_row   (color_t* pixels, int count, const colorfx_lut_t* lut);
+void        colorfx_matrix_row   (color_t* pixels, int count, const colormatrix_t* matrix);
+void        colorfx_replace_row  (color_t* pixels, int count, color_t color, color_t new_color);
+void        colorfx_tint_row     (color_t* pixels, int count, color_t mask);
+
+#endif // MINISPHERE__COLORFX_H__INCLUDED
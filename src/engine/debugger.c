@@ -1,4 +1,5 @@
 #include "minisphere.h"
+#include "profiler.h"
 #include "sockets.h"
 
 #include "debugger.h"
@@ -18,6 +19,7 @@ enum apprequest
 {
 	APPREQ_GAME_INFO = 0x01,
 	APPREQ_SOURCE = 0x02,
+	APPREQ_PROFILE = 0x03,
 };
 
 static const int TCP_DEBUG_PORT = 1208;
@@ -275,6 +277,7 @@ duk_cb_debug_request(duk_context* ctx, void* udata, duk_idx_t nvalues)
 {
 	void*       file_data;
 	const char* name;
+	const char* op;
 	int         request_id;
 	size_t      size;
 	int         x_size;
@@ -326,6 +329,30 @@ duk_cb_debug_request(duk_context* ctx, void* udata, duk_idx_t nvalues)
 		
 		duk_push_sprintf(ctx, "no source available for `%s`", name);
 		return -1;
+#if defined(MINISPHERE_SPHERUN)
+	case APPREQ_PROFILE:
+		// the optional argument is "on" to start a new profile, "off" to stop
+		// profiling or otherwise a filename to write the samples to.  either way
+		// the profiler's state is sent back.
+		if (nvalues >= 2) {
+			if (!(op = duk_get_string(ctx, -nvalues + 1))) {
+				duk_push_string(ctx, "invalid argument for Profile request");
+				return -1;
+			}
+			if (strcmp(op, "on") == 0)
+				start_profiler(NULL);
+			else if (strcmp(op, "off") == 0)
+				stop_profiler();
+			else if (!save_profile(op)) {
+				duk_push_sprintf(ctx, "unable to write profile to `%s`", op);
+				return -1;
+			}
+		}
+		duk_push_int(ctx, is_profiler_running() ? 1 : 0);
+		duk_push_int(ctx, get_profile_samples());
+		duk_push_int(ctx, get_profile_stacks());
+		return 3;
+#endif
 	default:
 		duk_push_sprintf(ctx, "invalid AppRequest command number `%d`", request_id);
 		return -1;
@@ -10,4 +10,18 @@
 #define DUK_USE_DEBUGGER_PAUSE_UNCAUGHT
 #define DUK_USE_DEBUGGER_INSPECT
 #define DUK_USE_INTERRUPT_COUNTER
+
+// the JS profiler samples the call stack from the exec timeout hook.  Duktape
+// only passes the heap udata, but the hook is expanded inside the executor
+// interrupt where `thr` is the interrupted thread, which is the one the
+// profiler needs to walk.  `thr->interrupt_init` is the number of instructions
+// run since the previous interrupt.  see profiler.c.
+// note: this relies on Duktape internals: the name `thr`, the private
+//       duk_hthread layout, and the hook being safe to call back into the VM
+//       from (the profiler calls Duktape.act() through duk_safe_call()).  none
+//       of that is part of the public API, so recheck it on every Duktape
+//       upgrade.
+int profiler_interrupt (void* thread, long num_instructions);
+#define DUK_USE_EXEC_TIMEOUT_CHECK(udata) \
+	profiler_interrupt((void*)thr, (long)thr->interrupt_init)
 #endif
@@ -660,7 +660,7 @@ js_KevFile_close(duk_context* ctx)
 	duk_pop(ctx);
 	kev_close(file);
 	duk_push_this(ctx);
-	duk_push_pointer(ctx, NULL); duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, NULL);
 	duk_pop(ctx);
 	return 0;
 }
@@ -844,8 +844,7 @@ js_RawFile_close(duk_context* ctx)
 
 	duk_push_this(ctx);
 	file = duk_require_sphere_obj(ctx, -1, "RawFile");
-	duk_push_pointer(ctx, NULL);
-	duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, NULL);
 	if (file == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "RawFile:close(): file was closed");
 	sfs_fclose(file);
@@ -1027,8 +1026,7 @@ js_FileStream_close(duk_context* ctx)
 
 	duk_push_this(ctx);
 	file = duk_require_sphere_obj(ctx, -1, "FileStream");
-	duk_push_pointer(ctx, NULL);
-	duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, NULL);
 	sfs_fclose(file);
 	return 0;
 }
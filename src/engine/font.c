@@ -25,30 +25,65 @@ static duk_ret_t js_Font_drawTextBox       (duk_context* ctx);
 static duk_ret_t js_Font_drawZoomedText    (duk_context* ctx);
 static duk_ret_t js_Font_wordWrapString    (duk_context* ctx);
 
-static void update_font_metrics (font_t* font);
+#define MAX_TEXT_LAYOUTS 64
+#define MAX_WRAP_RESULTS 32
 
 struct font
 {
 	unsigned int       refcount;
 	unsigned int       id;
+	image_t*           atlas;
 	int                height;
+	vector_t*          layouts;
 	int                min_width;
 	int                max_width;
 	uint32_t           num_glyphs;
 	struct font_glyph* glyphs;
+	vector_t*          wraps;
 };
 
 struct font_glyph
 {
 	int      width, height;
+	int      atlas_x, atlas_y;
 	image_t* image;
+	bool     is_in_atlas;
+};
+
+struct layout_glyph
+{
+	uint32_t cp;
+	int      x;
+};
+
+struct text_layout
+{
+	uint32_t             hash;
+	char*                text;
+	int                  width;
+	int                  num_glyphs;
+	struct layout_glyph* glyphs;
+	color_t              color;
+	int                  num_vertices;
+	ALLEGRO_VERTEX*      vertices;
+	int                  x, y;
 };
 
 struct wraptext
 {
-	int    num_lines;
-	char*  buffer;
-	size_t pitch;
+	unsigned int refcount;
+	uint32_t     hash;
+	char*        text;
+	int          width;
+	int          num_lines;
+	char*        buffer;
+	char**       lines;
+};
+
+struct wrap_line
+{
+	size_t start;
+	size_t end;
 };
 
 #pragma pack(push, 1)
@@ -68,24 +103,35 @@ struct rfn_glyph_header
 };
 #pragma pack(pop)
 
+static struct text_layout* create_text_layout  (const font_t* font, const char* text, uint32_t hash);
+static void                free_text_layout    (struct text_layout* layout);
+static void                clear_text_layouts  (font_t* font);
+static uint32_t            decode_glyph        (const font_t* font, const char* *inout_text);
+static struct text_layout* find_text_layout    (font_t* font, const char* text);
+static int                 measure_text        (const font_t* font, const char* text);
+static void                clear_wraps         (font_t* font);
+static wraptext_t*         wrap_text           (const font_t* font, const char* text, int width);
+static void                update_font_metrics (font_t* font);
+
 static unsigned int s_next_font_id = 0;
 
 font_t*
 load_font(const char* filename)
 {
-	image_t*                atlas = NULL;
-	int                     atlas_x, atlas_y;
-	int                     atlas_size_x, atlas_size_y;
+	atlas_t*                atlas = NULL;
 	sfs_file_t*             file;
 	font_t*                 font = NULL;
 	struct font_glyph*      glyph;
 	struct rfn_glyph_header glyph_hdr;
+	int*                    glyph_heights = NULL;
 	long                    glyph_start;
-	uint8_t*                grayscale;
+	int*                    glyph_widths = NULL;
+	rect_t                  glyph_xy;
+	uint8_t*                grayscale = NULL;
 	image_lock_t*           lock = NULL;
 	int                     max_x = 0, max_y = 0;
 	int                     min_width = INT_MAX;
-	int64_t                 n_glyphs_per_row;
+	image_t*                page = NULL;
 	int                     pixel_size;
 	struct rfn_header       rfn;
 	uint8_t                 *psrc;
@@ -104,6 +150,10 @@ load_font(const char* filename)
 	pixel_size = (rfn.version == 1) ? 1 : 4;
 	if (!(font->glyphs = calloc(rfn.num_chars, sizeof(struct font_glyph))))
 		goto on_error;
+	if (!(glyph_widths = malloc(rfn.num_chars * sizeof(int))))
+		goto on_error;
+	if (!(glyph_heights = malloc(rfn.num_chars * sizeof(int))))
+		goto on_error;
 
 	// pass 1: load glyph headers and find largest glyph
 	glyph_start = sfs_ftell(file);
@@ -115,55 +165,68 @@ load_font(const char* filename)
 		max_x = fmax(glyph_hdr.width, max_x);
 		max_y = fmax(glyph_hdr.height, max_y);
 		min_width = fmin(min_width, glyph_hdr.width);
-		glyph->width = glyph_hdr.width;
-		glyph->height = glyph_hdr.height;
+		glyph->width = glyph_widths[i] = glyph_hdr.width;
+		glyph->height = glyph_heights[i] = glyph_hdr.height;
 	}
 	font->num_glyphs = rfn.num_chars;
 	font->min_width = min_width;
 	font->max_width = max_x;
 	font->height = max_y;
 
-	// create glyph atlas
-	n_glyphs_per_row = ceil(sqrt(rfn.num_chars));
-	atlas_size_x = max_x * n_glyphs_per_row;
-	atlas_size_y = max_y * n_glyphs_per_row;
-	if ((atlas = create_image(atlas_size_x, atlas_size_y)) == NULL)
+	// create glyph atlas.  glyphs are packed by their actual size rather than
+	// in a grid of max_x x max_y cells, so one wide glyph doesn't blow up the
+	// texture.  batched drawing needs everything on one page; if the atlas
+	// spills over, glyphs past the first page are drawn one at a time.
+	if (!(atlas = atlas_new_packed(rfn.num_chars, glyph_widths, glyph_heights, NULL)))
 		goto on_error;
 
 	// pass 2: load glyph data
 	sfs_fseek(file, glyph_start, SFS_SEEK_SET);
-	if (!(lock = lock_image(atlas))) goto on_error;
+	atlas_lock(atlas);
 	for (i = 0; i < rfn.num_chars; ++i) {
 		glyph = &font->glyphs[i];
 		if (sfs_fread(&glyph_hdr, sizeof(struct rfn_glyph_header), 1, file) != 1)
 			goto on_error;
-		atlas_x = i % n_glyphs_per_row * max_x;
-		atlas_y = i / n_glyphs_per_row * max_y;
+		glyph_xy = atlas_xy(atlas, i);
+		glyph->atlas_x = glyph_xy.x1;
+		glyph->atlas_y = glyph_xy.y1;
+		glyph->is_in_atlas = atlas_page(atlas, i) == 0;
 		switch (rfn.version) {
 		case 1: // RFN v1: 8-bit grayscale glyphs
-			if (!(glyph->image = create_subimage(atlas, atlas_x, atlas_y, glyph_hdr.width, glyph_hdr.height)))
+			page = atlas_image(atlas, atlas_page(atlas, i));
+			if (!(glyph->image = create_subimage(page, glyph_xy.x1, glyph_xy.y1, glyph_hdr.width, glyph_hdr.height)))
+				goto on_error;
+			if (!(grayscale = malloc(glyph_hdr.width * glyph_hdr.height)))
 				goto on_error;
-			grayscale = malloc(glyph_hdr.width * glyph_hdr.height);
 			if (sfs_fread(grayscale, glyph_hdr.width * glyph_hdr.height, 1, file) != 1)
 				goto on_error;
+			if (!(lock = lock_image(page)))
+				goto on_error;
 			psrc = grayscale;
-			pdest = lock->pixels + atlas_x + atlas_y * lock->pitch;
+			pdest = lock->pixels + glyph_xy.x1 + glyph_xy.y1 * lock->pitch;
 			for (y = 0; y < glyph_hdr.height; ++y) {
 				for (x = 0; x < glyph_hdr.width; ++x)
 					pdest[x] = color_new(psrc[x], psrc[x], psrc[x], 255);
 				pdest += lock->pitch;
 				psrc += glyph_hdr.width;
 			}
+			unlock_image(page, lock);
+			lock = NULL;
+			free(grayscale);
+			grayscale = NULL;
 			break;
 		case 2: // RFN v2: 32-bit truecolor glyphs
-			if (!(glyph->image = read_subimage(file, atlas, atlas_x, atlas_y, glyph_hdr.width, glyph_hdr.height)))
+			if (!(glyph->image = atlas_load(atlas, file, i, glyph_hdr.width, glyph_hdr.height)))
 				goto on_error;
 			break;
 		}
 	}
-	unlock_image(atlas, lock);
+	atlas_unlock(atlas);
 	sfs_fclose(file);
-	free_image(atlas);
+	font->atlas = ref_image(atlas_image(atlas, 0));
+	atlas_free(atlas);
+	free(glyph_widths);
+	free(glyph_heights);
 	
 	font->id = s_next_font_id++;
 	return ref_font(font);
@@ -178,8 +241,11 @@ on_error:
 		free(font->glyphs);
 		free(font);
 	}
-	if (lock != NULL) unlock_image(atlas, lock);
-	if (atlas != NULL) free_image(atlas);
+	free(grayscale);
+	free(glyph_widths);
+	free(glyph_heights);
+	if (lock != NULL) unlock_image(page, lock);
+	atlas_free(atlas);
 	return NULL;
 }
 
@@ -210,7 +276,12 @@ clone_font(const font_t* src_font)
 		font->glyphs[i].image = ref_image(src_glyph->image);
 		font->glyphs[i].width = src_glyph->width;
 		font->glyphs[i].height = src_glyph->height;
+		font->glyphs[i].atlas_x = src_glyph->atlas_x;
+		font->glyphs[i].atlas_y = src_glyph->atlas_y;
+		font->glyphs[i].is_in_atlas = src_glyph->is_in_atlas;
 	}
+	if (src_font->atlas != NULL)
+		font->atlas = ref_image(src_font->atlas);
 
 	font->id = s_next_font_id++;
 	return ref_font(font);
@@ -243,9 +314,14 @@ free_font(font_t* font)
 		return;
 	
 	console_log(3, "disposing font #%u no longer in use", font->id);
+	clear_text_layouts(font);
+	clear_wraps(font);
+	vector_free(font->layouts);
+	vector_free(font->wraps);
 	for (i = 0; i < font->num_glyphs; ++i) {
 		free_image(font->glyphs[i].image);
 	}
+	free_image(font->atlas);
 	free(font->glyphs);
 	free(font);
 }
@@ -277,53 +353,13 @@ get_glyph_width(const font_t* font, int codepoint)
 }
 
 int
-get_text_width(const font_t* font, const char* text)
+get_text_width(font_t* font, const char* text)
 {
-	uint8_t  ch_byte;
-	uint32_t cp;
-	uint32_t utf8state;
-	int      width = 0;
-	
-	for (;;) {
-		utf8state = UTF8_ACCEPT;
-		while (utf8decode(&utf8state, &cp, ch_byte = *text++) > UTF8_REJECT);
-		if (utf8state == UTF8_REJECT && ch_byte == '\0')
-			--text;  // don't eat NUL terminator
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = utf8state == UTF8_ACCEPT
-			? cp < (uint32_t)font->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		if (cp == '\0') break;
-		width += font->glyphs[cp].width;
-	}
-	return width;
+	struct text_layout* layout;
+
+	if (!(layout = find_text_layout(font, text)))
+		return measure_text(font, text);
+	return layout->width;
 }
 
 void
@@ -337,222 +373,123 @@ set_glyph_image(font_t* font, int codepoint, image_t* image)
 	p_glyph->image = ref_image(image);
 	p_glyph->width = get_image_width(image);
 	p_glyph->height = get_image_height(image);
+	p_glyph->is_in_atlas = false;
 	update_font_metrics(font);
+	clear_text_layouts(font);
+	clear_wraps(font);
 	free_image(old_image);
 }
 
 void
-draw_text(const font_t* font, color_t color, int x, int y, text_align_t alignment, const char* text)
+draw_text(font_t* font, color_t color, int x, int y, text_align_t alignment, const char* text)
 {
-	uint8_t  ch_byte;
-	uint32_t cp;
-	int      tab_width;
-	uint32_t utf8state;
-	
+	bool                 is_drawing_held;
+	ALLEGRO_COLOR        native_color;
+	struct layout_glyph* glyph;
+	struct text_layout*  layout;
+	float                x_off, y_off;
+
+	int i;
+
+	if (!(layout = find_text_layout(font, text)))
+		return;
 	if (alignment == TEXT_ALIGN_CENTER)
-		x -= get_text_width(font, text) / 2;
+		x -= layout->width / 2;
 	else if (alignment == TEXT_ALIGN_RIGHT)
-		x -= get_text_width(font, text);
-	
-	tab_width = font->glyphs[' '].width * 3;
-	al_hold_bitmap_drawing(true);
-	for (;;) {
-		utf8state = UTF8_ACCEPT;
-		while (utf8decode(&utf8state, &cp, ch_byte = *text++) > UTF8_REJECT);
-		if (utf8state == UTF8_REJECT && ch_byte == '\0')
-			--text;  // don't eat NUL terminator
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = utf8state == UTF8_ACCEPT
-			? cp < (uint32_t)font->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		if (cp == '\0')
-			break;
-		else if (cp == '\t')
-			x += tab_width;
-		else {
-			draw_image_masked(font->glyphs[cp].image, color, x, y);
-			x += font->glyphs[cp].width;
+		x -= layout->width;
+
+	if (layout->vertices != NULL) {
+		// every glyph is in the atlas, so the whole string goes out in a single
+		// draw call.  the vertices are only touched when the text moves or the
+		// color changes, which for most HUD text is never.
+		if (x != layout->x || y != layout->y) {
+			x_off = x - layout->x;
+			y_off = y - layout->y;
+			for (i = 0; i < layout->num_vertices; ++i) {
+				layout->vertices[i].x += x_off;
+				layout->vertices[i].y += y_off;
+			}
+			layout->x = x;
+			layout->y = y;
+		}
+		if (memcmp(&color, &layout->color, sizeof(color_t)) != 0) {
+			native_color = nativecolor(color);
+			for (i = 0; i < layout->num_vertices; ++i)
+				layout->vertices[i].color = native_color;
+			layout->color = color;
+		}
+		// primitives aren't deferred, so anything held has to be drawn first
+		is_drawing_held = al_is_bitmap_drawing_held();
+		al_hold_bitmap_drawing(false);
+		al_draw_prim(layout->vertices, NULL, get_image_bitmap(font->atlas),
+			0, layout->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+		al_hold_bitmap_drawing(is_drawing_held);
+	}
+	else {
+		is_drawing_held = al_is_bitmap_drawing_held();
+		al_hold_bitmap_drawing(true);
+		for (i = 0; i < layout->num_glyphs; ++i) {
+			glyph = &layout->glyphs[i];
+			draw_image_masked(font->glyphs[glyph->cp].image, color, x + glyph->x, y);
 		}
+		al_hold_bitmap_drawing(is_drawing_held);
 	}
-	al_hold_bitmap_drawing(false);
 }
 
 wraptext_t*
-word_wrap_text(const font_t* font, const char* text, int width)
+word_wrap_text(font_t* font, const char* text, int width)
 {
-	char*       buffer = NULL;
-	uint8_t     ch_byte;
-	char*		carry;
-	size_t      ch_size;
-	uint32_t    cp;
-	int         glyph_width;
-	bool        is_line_end = false;
-	int         line_idx;
-	int         line_width;
-	int         max_lines = 10;
-	char*       last_break;
-	char*       last_space;
-	char*       last_tab;
-	char*       line_buffer;
-	size_t      line_length;
-	char*       new_buffer;
-	size_t      pitch;
-	uint32_t    utf8state;
-	wraptext_t* wraptext;
-	const char  *p, *start;
-
-	if (!(wraptext = calloc(1, sizeof(wraptext_t)))) goto on_error;
-	
-	// allocate initial buffer
-	get_font_metrics(font, &glyph_width, NULL, NULL);
-	pitch = 4 * (glyph_width > 0 ? width / glyph_width : width) + 3;
-	if (!(buffer = malloc(max_lines * pitch))) goto on_error;
-	if (!(carry = malloc(pitch))) goto on_error;
-
-	// run through one character at a time, carrying as necessary
-	line_buffer = buffer; line_buffer[0] = '\0';
-	line_idx = 0; line_width = 0; line_length = 0;
-	memset(line_buffer, 0, pitch);  // fill line with NULs
-	p = text;
-	do {
-		utf8state = UTF8_ACCEPT; start = p;
-		while (utf8decode(&utf8state, &cp, ch_byte = *p++) > UTF8_REJECT);
-		if (utf8state == UTF8_REJECT && ch_byte == '\0')
-			--p;  // don't eat NUL terminator
-		ch_size = p - start;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = utf8state == UTF8_ACCEPT
-			? cp < (uint32_t)font->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		switch (cp) {
-		case '\n': case '\r':  // explicit newline
-			if (cp == '\r' && *p == '\n') ++text;  // CRLF
-			is_line_end = true;
-			break;
-		case '\t':  // tab
-			line_buffer[line_length++] = cp;
-			line_width += get_text_width(font, "   ");
-			is_line_end = false;
-			break;
-		case '\0':  // NUL terminator
-			is_line_end = line_length > 0;  // commit last line on EOT
-			break;
-		default:  // default case, copy character as-is
-			memcpy(line_buffer + line_length, start, ch_size);
-			line_length += ch_size;
-			line_width += get_glyph_width(font, cp);
-			is_line_end = false;
-		}
-		if (is_line_end) carry[0] = '\0';
-		if (line_width > width || line_length >= pitch - 1) {
-			// wrap width exceeded, carry current word to next line
-			is_line_end = true;
-			last_space = strrchr(line_buffer, ' ');
-			last_tab = strrchr(line_buffer, '\t');
-			last_break = last_space > last_tab ? last_space : last_tab;
-			if (last_break != NULL)  // word break (space or tab) found
-				strcpy(carry, last_break + 1);
-			else  // no word break, so just carry last character
-				sprintf(carry, "%c", line_buffer[line_length - 1]);
-			line_buffer[line_length - strlen(carry)] = '\0';
+	// text boxes tend to re-wrap the same paragraph every frame, so results are
+	// cached per font in LRU order, most recently used last.  the caller gets its
+	// own reference and should free it with free_wraptext() as usual.
+
+	uint32_t     hash;
+	iter_t       iter;
+	wraptext_t*  wraptext;
+	wraptext_t** p_wraptext;
+
+	if (font->wraps == NULL && !(font->wraps = vector_new(sizeof(wraptext_t*))))
+		return wrap_text(font, text, width);
+	hash = strhash(text);
+	iter = vector_enum(font->wraps);
+	while (p_wraptext = vector_next(&iter)) {
+		wraptext = *p_wraptext;
+		if (wraptext->hash != hash || wraptext->width != width || strcmp(wraptext->text, text) != 0)
+			continue;
+		if (iter.index < (ptrdiff_t)vector_len(font->wraps) - 1) {
+			iter_remove(&iter);
+			vector_push(font->wraps, &wraptext);
 		}
-		if (is_line_end) {
-			// do we need to enlarge the buffer?
-			if (++line_idx >= max_lines) {
-				max_lines *= 2;
-				if (!(new_buffer = realloc(buffer, max_lines * pitch)))
-					goto on_error;
-				buffer = new_buffer;
-				line_buffer = buffer + line_idx * pitch;
-			}
-			else
-				line_buffer += pitch;
-			
-			memset(line_buffer, 0, pitch);  // fill line with NULs
-
-			// copy carry text into new line
-			line_width = get_text_width(font, carry);
-			line_length = strlen(carry);
-			strcpy(line_buffer, carry);
-		}
-	} while (cp != '\0');
-	free(carry);
-	wraptext->num_lines = line_idx;
-	wraptext->buffer = buffer;
-	wraptext->pitch = pitch;
+		++wraptext->refcount;
+		return wraptext;
+	}
+	if (!(wraptext = wrap_text(font, text, width)))
+		return NULL;
+	wraptext->hash = hash;
+	if (vector_len(font->wraps) >= MAX_WRAP_RESULTS) {
+		free_wraptext(*(wraptext_t**)vector_get(font->wraps, 0));
+		vector_remove(font->wraps, 0);
+	}
+	if (vector_push(font->wraps, &wraptext))
+		++wraptext->refcount;
 	return wraptext;
-
-on_error:
-	free(buffer);
-	free(wraptext);
-	return NULL;
 }
 
 void
 free_wraptext(wraptext_t* wraptext)
 {
+	if (wraptext == NULL || --wraptext->refcount > 0)
+		return;
+	free(wraptext->lines);
 	free(wraptext->buffer);
+	free(wraptext->text);
 	free(wraptext);
 }
 
 const char*
 get_wraptext_line(const wraptext_t* wraptext, int line_index)
 {
-	return wraptext->buffer + line_index * wraptext->pitch;
+	return wraptext->lines[line_index];
 }
 
 int
@@ -561,6 +498,338 @@ get_wraptext_line_count(const wraptext_t* wraptext)
 	return wraptext->num_lines;
 }
 
+static struct text_layout*
+create_text_layout(const font_t* font, const char* text, uint32_t hash)
+{
+	const struct font_glyph* glyph;
+	int                      num_glyphs = 0;
+	const char*              p;
+	struct text_layout*      layout;
+	int                      tab_width;
+	ALLEGRO_VERTEX*          v;
+	int                      x = 0;
+	float                    x1, y1, x2, y2;
+	float                    u1, v1, u2, v2;
+
+	uint32_t cp;
+	int      i;
+
+	if (!(layout = calloc(1, sizeof(struct text_layout))))
+		return NULL;
+	if (!(layout->text = strdup(text)))
+		goto on_error;
+	layout->hash = hash;
+	if (!(layout->glyphs = malloc((strlen(text) + 1) * sizeof(struct layout_glyph))))
+		goto on_error;
+
+	// decode the string once, storing each glyph with its offset from the start
+	// of the text.  tabs advance the pen by three spaces but, to match Sphere,
+	// count as their own glyph in the width used for alignment.
+	tab_width = font->glyphs[' '].width * 3;
+	p = text;
+	while ((cp = decode_glyph(font, &p)) != '\0') {
+		layout->width += font->glyphs[cp].width;
+		if (cp == '\t') {
+			x += tab_width;
+			continue;
+		}
+		layout->glyphs[num_glyphs].cp = cp;
+		layout->glyphs[num_glyphs].x = x;
+		x += font->glyphs[cp].width;
+		++num_glyphs;
+	}
+	layout->num_glyphs = num_glyphs;
+
+	// if all the glyphs are still in the font atlas, build a triangle list for
+	// the entire string.  it's positioned at (0,0) in white to start with and
+	// draw_text() moves and recolors it as needed.
+	if (font->atlas == NULL || num_glyphs == 0)
+		return layout;
+	for (i = 0; i < num_glyphs; ++i) {
+		if (!font->glyphs[layout->glyphs[i].cp].is_in_atlas)
+			return layout;
+	}
+	if (!(layout->vertices = malloc(num_glyphs * 6 * sizeof(ALLEGRO_VERTEX))))
+		return layout;
+	layout->num_vertices = num_glyphs * 6;
+	layout->color = color_new(255, 255, 255, 255);
+	v = layout->vertices;
+	for (i = 0; i < num_glyphs; ++i) {
+		glyph = &font->glyphs[layout->glyphs[i].cp];
+		x1 = layout->glyphs[i].x; x2 = x1 + glyph->width;
+		y1 = 0.0; y2 = glyph->height;
+		u1 = glyph->atlas_x; u2 = u1 + glyph->width;
+		v1 = glyph->atlas_y; v2 = v1 + glyph->height;
+		v[0].x = x1; v[0].y = y1; v[0].u = u1; v[0].v = v1;
+		v[1].x = x2; v[1].y = y1; v[1].u = u2; v[1].v = v1;
+		v[2].x = x1; v[2].y = y2; v[2].u = u1; v[2].v = v2;
+		v[3].x = x2; v[3].y = y1; v[3].u = u2; v[3].v = v1;
+		v[4].x = x2; v[4].y = y2; v[4].u = u2; v[4].v = v2;
+		v[5].x = x1; v[5].y = y2; v[5].u = u1; v[5].v = v2;
+		v += 6;
+	}
+	for (i = 0; i < layout->num_vertices; ++i) {
+		layout->vertices[i].z = 0.0;
+		layout->vertices[i].color = al_map_rgba(255, 255, 255, 255);
+	}
+	return layout;
+
+on_error:
+	free_text_layout(layout);
+	return NULL;
+}
+
+static void
+free_text_layout(struct text_layout* layout)
+{
+	if (layout == NULL)
+		return;
+	free(layout->vertices);
+	free(layout->glyphs);
+	free(layout->text);
+	free(layout);
+}
+
+static void
+clear_text_layouts(font_t* font)
+{
+	iter_t               iter;
+	struct text_layout** p_layout;
+
+	if (font->layouts == NULL)
+		return;
+	iter = vector_enum(font->layouts);
+	while (p_layout = vector_next(&iter))
+		free_text_layout(*p_layout);
+	vector_clear(font->layouts);
+}
+
+static uint32_t
+decode_glyph(const font_t* font, const char* *inout_text)
+{
+	// decodes the next UTF-8 character and advances the text pointer past it,
+	// returning the index of the glyph to use.  RFN fonts are laid out in
+	// Windows-1252 order, so the code points in 0x80-0x9F are mapped back from
+	// Unicode.  anything the font doesn't have is drawn as 0x1A (SUB).
+
+	uint8_t     ch_byte;
+	uint32_t    cp;
+	const char* text;
+	uint32_t    utf8state;
+
+	text = *inout_text;
+	utf8state = UTF8_ACCEPT;
+	while (utf8decode(&utf8state, &cp, ch_byte = *text++) > UTF8_REJECT);
+	if (utf8state == UTF8_REJECT && ch_byte == '\0')
+		--text;  // don't eat NUL terminator
+	*inout_text = text;
+	if (utf8state != UTF8_ACCEPT)
+		return 0x1A;
+	switch (cp) {
+	case 0x20AC: cp = 128; break;
+	case 0x201A: cp = 130; break;
+	case 0x0192: cp = 131; break;
+	case 0x201E: cp = 132; break;
+	case 0x2026: cp = 133; break;
+	case 0x2020: cp = 134; break;
+	case 0x2021: cp = 135; break;
+	case 0x02C6: cp = 136; break;
+	case 0x2030: cp = 137; break;
+	case 0x0160: cp = 138; break;
+	case 0x2039: cp = 139; break;
+	case 0x0152: cp = 140; break;
+	case 0x017D: cp = 142; break;
+	case 0x2018: cp = 145; break;
+	case 0x2019: cp = 146; break;
+	case 0x201C: cp = 147; break;
+	case 0x201D: cp = 148; break;
+	case 0x2022: cp = 149; break;
+	case 0x2013: cp = 150; break;
+	case 0x2014: cp = 151; break;
+	case 0x02DC: cp = 152; break;
+	case 0x2122: cp = 153; break;
+	case 0x0161: cp = 154; break;
+	case 0x203A: cp = 155; break;
+	case 0x0153: cp = 156; break;
+	case 0x017E: cp = 158; break;
+	case 0x0178: cp = 159; break;
+	}
+	return cp < font->num_glyphs ? cp : 0x1A;
+}
+
+static struct text_layout*
+find_text_layout(font_t* font, const char* text)
+{
+	// looks up the layout for a string, creating it if it isn't cached.  the
+	// cache is kept in LRU order with the most recently used layout last.
+
+	uint32_t             hash;
+	iter_t               iter;
+	struct text_layout*  layout;
+	struct text_layout** p_layout;
+
+	if (font->layouts == NULL && !(font->layouts = vector_new(sizeof(struct text_layout*))))
+		return NULL;
+	hash = strhash(text);
+	iter = vector_enum(font->layouts);
+	while (p_layout = vector_next(&iter)) {
+		layout = *p_layout;
+		if (layout->hash != hash || strcmp(layout->text, text) != 0)
+			continue;
+		if (iter.index < (ptrdiff_t)vector_len(font->layouts) - 1) {
+			iter_remove(&iter);
+			vector_push(font->layouts, &layout);
+		}
+		return layout;
+	}
+	if (!(layout = create_text_layout(font, text, hash)))
+		return NULL;
+	if (vector_len(font->layouts) >= MAX_TEXT_LAYOUTS) {
+		free_text_layout(*(struct text_layout**)vector_get(font->layouts, 0));
+		vector_remove(font->layouts, 0);
+	}
+	if (!vector_push(font->layouts, &layout)) {
+		free_text_layout(layout);
+		return NULL;
+	}
+	return layout;
+}
+
+static int
+measure_text(const font_t* font, const char* text)
+{
+	uint32_t cp;
+	int      width = 0;
+
+	while ((cp = decode_glyph(font, &text)) != '\0')
+		width += font->glyphs[cp].width;
+	return width;
+}
+
+static void
+clear_wraps(font_t* font)
+{
+	iter_t       iter;
+	wraptext_t** p_wraptext;
+
+	if (font->wraps == NULL)
+		return;
+	iter = vector_enum(font->wraps);
+	while (p_wraptext = vector_next(&iter))
+		free_wraptext(*p_wraptext);
+	vector_clear(font->wraps);
+}
+
+static wraptext_t*
+wrap_text(const font_t* font, const char* text, int width)
+{
+	// wraps text in a single pass.  the characters which end up on a line are
+	// copied to `stream` as they're read, so a line is just a range of it.  when a
+	// line gets too wide it's broken after the last space or tab, or before the
+	// last character if there isn't one, and whatever follows becomes the start
+	// of the next line.  explicit newlines always end a line.
+
+	size_t           break_end = 0;
+	int              break_width = 0;
+	size_t           ch_size;
+	char*            buffer;
+	bool             has_break = false;
+	size_t           last_char;
+	struct wrap_line line = { 0, 0 };
+	int              line_width = 0;
+	vector_t*        lines = NULL;
+	const char*      p;
+	const char*      start;
+	char*            stream = NULL;
+	size_t           stream_len = 0;
+	int              tab_width;
+	wraptext_t*      wraptext = NULL;
+
+	uint32_t cp;
+	int      i;
+
+	if (!(wraptext = calloc(1, sizeof(wraptext_t))))
+		goto on_error;
+	if (!(wraptext->text = strdup(text)))
+		goto on_error;
+	if (!(stream = malloc(strlen(text) + 1)))
+		goto on_error;
+	if (!(lines = vector_new(sizeof(struct wrap_line))))
+		goto on_error;
+	tab_width = measure_text(font, "   ");
+	p = text;
+	for (;;) {
+		start = p;
+		if ((cp = decode_glyph(font, &p)) == '\0')
+			break;
+		if (cp == '\n' || cp == '\r') {
+			if (cp == '\r' && *p == '\n')
+				++p;  // CRLF
+			line.end = stream_len;
+			if (!vector_push(lines, &line))
+				goto on_error;
+			line.start = stream_len;
+			line_width = 0;
+			has_break = false;
+			continue;
+		}
+		ch_size = p - start;
+		last_char = stream_len;
+		memcpy(stream + stream_len, start, ch_size);
+		stream_len += ch_size;
+		line_width += cp == '\t' ? tab_width : font->glyphs[cp].width;
+		if (cp == ' ' || cp == '\t') {
+			has_break = true;
+			break_end = stream_len;
+			break_width = line_width;
+		}
+		if (line_width > width && (has_break || last_char > line.start)) {
+			line.end = has_break ? break_end : last_char;
+			if (!vector_push(lines, &line))
+				goto on_error;
+			line.start = line.end;
+			line_width = has_break ? line_width - break_width : font->glyphs[cp].width;
+			has_break = false;
+		}
+	}
+	if (stream_len > line.start) {
+		line.end = stream_len;
+		if (!vector_push(lines, &line))
+			goto on_error;
+	}
+
+	// copy the lines out of the stream, each with its own NUL terminator
+	wraptext->num_lines = (int)vector_len(lines);
+	if (!(wraptext->buffer = malloc(stream_len + wraptext->num_lines + 1)))
+		goto on_error;
+	if (!(wraptext->lines = malloc((wraptext->num_lines + 1) * sizeof(char*))))
+		goto on_error;
+	buffer = wraptext->buffer;
+	for (i = 0; i < wraptext->num_lines; ++i) {
+		line = *(struct wrap_line*)vector_get(lines, i);
+		memcpy(buffer, stream + line.start, line.end - line.start);
+		wraptext->lines[i] = buffer;
+		buffer += line.end - line.start;
+		*buffer++ = '\0';
+	}
+	wraptext->width = width;
+	wraptext->refcount = 1;
+	vector_free(lines);
+	free(stream);
+	return wraptext;
+
+on_error:
+	vector_free(lines);
+	free(stream);
+	if (wraptext != NULL) {
+		free(wraptext->lines);
+		free(wraptext->buffer);
+		free(wraptext->text);
+		free(wraptext);
+	}
+	return NULL;
+}
+
 static void
 update_font_metrics(font_t* font)
 {
@@ -887,7 +1156,8 @@ js_Font_wordWrapString(duk_context* ctx)
 	duk_push_this(ctx);
 	font = duk_require_sphere_obj(ctx, -1, "Font");
 	duk_pop(ctx);
-	wraptext = word_wrap_text(font, text, width);
+	if (!(wraptext = word_wrap_text(font, text, width)))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Font:wordWrapString(): unable to wrap text");
 	num_lines = get_wraptext_line_count(wraptext);
 	duk_push_array(ctx);
 	for (i = 0; i < num_lines; ++i) {
@@ -23,11 +23,11 @@ int         get_font_line_height (const font_t* font);
 void        get_font_metrics     (const font_t* font, int* min_width, int* max_width, int* out_line_height);
 image_t*    get_glyph_image      (const font_t* font, int codepoint);
 int         get_glyph_width      (const font_t* font, int codepoint);
-int         get_text_width       (const font_t* font, const char* text);
+int         get_text_width       (font_t* font, const char* text);
 void        set_glyph_image      (font_t* font, int codepoint, image_t* image);
-void        draw_text            (const font_t* font, color_t mask, int x, int y, text_align_t alignment, const char* text);
+void        draw_text            (font_t* font, color_t mask, int x, int y, text_align_t alignment, const char* text);
 
-wraptext_t* word_wrap_text          (const font_t* font, const char* text, int width);
+wraptext_t* word_wrap_text          (font_t* font, const char* text, int width);
 void        free_wraptext           (wraptext_t* wraptext);
 const char* get_wraptext_line       (const wraptext_t* wraptext, int line_index);
 int         get_wraptext_line_count (const wraptext_t* wraptext);
@@ -6,34 +6,52 @@
 
 #include "galileo.h"
 
-static duk_ret_t js_GetDefaultShaderProgram (duk_context* ctx);
-static duk_ret_t js_new_Group               (duk_context* ctx);
-static duk_ret_t js_Group_finalize          (duk_context* ctx);
-static duk_ret_t js_Group_get_shader        (duk_context* ctx);
-static duk_ret_t js_Group_get_transform     (duk_context* ctx);
-static duk_ret_t js_Group_set_shader        (duk_context* ctx);
-static duk_ret_t js_Group_set_transform     (duk_context* ctx);
-static duk_ret_t js_Group_draw              (duk_context* ctx);
-static duk_ret_t js_Group_setFloat          (duk_context* ctx);
-static duk_ret_t js_Group_setInt            (duk_context* ctx);
-static duk_ret_t js_Group_setMatrix         (duk_context* ctx);
-static duk_ret_t js_new_Shape               (duk_context* ctx);
-static duk_ret_t js_Shape_finalize          (duk_context* ctx);
-static duk_ret_t js_Shape_get_texture       (duk_context* ctx);
-static duk_ret_t js_Shape_set_texture       (duk_context* ctx);
-static duk_ret_t js_Shape_draw              (duk_context* ctx);
-static duk_ret_t js_new_Transform           (duk_context* ctx);
-static duk_ret_t js_Transform_finalize      (duk_context* ctx);
-static duk_ret_t js_Transform_compose       (duk_context* ctx);
-static duk_ret_t js_Transform_identity      (duk_context* ctx);
-static duk_ret_t js_Transform_rotate        (duk_context* ctx);
-static duk_ret_t js_Transform_scale         (duk_context* ctx);
-static duk_ret_t js_Transform_translate     (duk_context* ctx);
-
-static void assign_default_uv   (shape_t* shape);
-static void free_cached_uniform (group_t* group, const char* name);
-static bool have_vertex_buffer  (const shape_t* shape);
-static void render_shape        (shape_t* shape);
+static duk_ret_t js_GetDefaultShaderProgram    (duk_context* ctx);
+static duk_ret_t js_new_Group                  (duk_context* ctx);
+static duk_ret_t js_Group_finalize             (duk_context* ctx);
+static duk_ret_t js_Group_get_drawCalls        (duk_context* ctx);
+static duk_ret_t js_Group_get_orderIndependent (duk_context* ctx);
+static duk_ret_t js_Group_get_shader           (duk_context* ctx);
+static duk_ret_t js_Group_get_transform        (duk_context* ctx);
+static duk_ret_t js_Group_set_orderIndependent (duk_context* ctx);
+static duk_ret_t js_Group_set_shader           (duk_context* ctx);
+static duk_ret_t js_Group_set_transform        (duk_context* ctx);
+static duk_ret_t js_Group_draw                 (duk_context* ctx);
+static duk_ret_t js_Group_setFloat             (duk_context* ctx);
+static duk_ret_t js_Group_setInt               (duk_context* ctx);
+static duk_ret_t js_Group_setMatrix            (duk_context* ctx);
+static duk_ret_t js_new_Shape                  (duk_context* ctx);
+static duk_ret_t js_Shape_finalize             (duk_context* ctx);
+static duk_ret_t js_Shape_get_texture          (duk_context* ctx);
+static duk_ret_t js_Shape_set_texture          (duk_context* ctx);
+static duk_ret_t js_Shape_draw                 (duk_context* ctx);
+static duk_ret_t js_Shape_drawInstances        (duk_context* ctx);
+static duk_ret_t js_Shape_setVertices          (duk_context* ctx);
+static duk_ret_t js_new_Transform              (duk_context* ctx);
+static duk_ret_t js_Transform_finalize         (duk_context* ctx);
+static duk_ret_t js_Transform_compose          (duk_context* ctx);
+static duk_ret_t js_Transform_identity         (duk_context* ctx);
+static duk_ret_t js_Transform_rotate           (duk_context* ctx);
+static duk_ret_t js_Transform_scale            (duk_context* ctx);
+static duk_ret_t js_Transform_transformPoints  (duk_context* ctx);
+static duk_ret_t js_Transform_translate        (duk_context* ctx);
+
+static void            assign_default_uv  (shape_t* shape);
+static bool            build_batches      (group_t* group);
+static int             compare_shapes     (const void* in_a, const void* in_b);
+static void            convert_vertices   (ALLEGRO_VERTEX* out, const vertex_t* vertices, int count);
+static void            free_batches       (group_t* group);
+static void            free_vertex_buffer (shape_t* shape);
+static bool            grow_instance_bufs (int num_vertices, int num_indices);
+static struct uniform* get_cached_uniform (group_t* group, const char* name);
+static int             get_batch_mode     (const shape_t* shape);
+static int             get_draw_mode      (const shape_t* shape);
+static bool            have_vertex_buffer (const shape_t* shape);
+static int             put_indices        (const shape_t* shape, int base, int* out_indices);
+static bool            read_js_vertex     (duk_context* ctx, duk_idx_t index, vertex_t* inout_vertex);
+static float*          require_floats     (duk_context* ctx, duk_idx_t index, int group_size, int* out_count, const char* fn_name);
+static void            render_shape       (shape_t* shape);
+static void            upload_dirty_range (shape_t* shape);
 
 enum uniform_type
 {
@@ -43,10 +61,29 @@ enum uniform_type
 	UNIFORM_FLOAT_VEC,
 	UNIFORM_MATRIX,
 };
+
+struct batch
+{
+	shape_t* shape;
+	image_t* texture;
+	int      draw_mode;
+	int      start;
+	int      num_indices;
+};
+
+struct shape_order
+{
+	shape_t* shape;
+	int      index;
+};
+
 struct uniform
 {
 	char              name[256];
+	uint32_t          hash;
 	enum uniform_type type;
+	unsigned int      shader_id;
+	int               slot;
 	union {
 		ALLEGRO_TRANSFORM mat_value;
 		int               int_value;
@@ -58,8 +95,12 @@ struct shape
 {
 	unsigned int           refcount;
 	unsigned int           id;
+	unsigned int           version;
 	image_t*               texture;
 	shape_type_t           type;
+	bool                   is_dynamic;
+	int                    dirty_start;
+	int                    dirty_end;
 	ALLEGRO_VERTEX*        sw_vbuf;
 	int                    max_vertices;
 	int                    num_vertices;
@@ -71,17 +112,27 @@ struct shape
 
 struct group
 {
-	unsigned int refcount;
-	unsigned int id;
-	shader_t*    shader;
-	vector_t*    shapes;
-	matrix_t*    transform;
-	vector_t*    uniforms;
+	unsigned int    refcount;
+	unsigned int    id;
+	shader_t*       shader;
+	vector_t*       shapes;
+	matrix_t*       transform;
+	vector_t*       uniforms;
+	bool            is_unordered;
+	vector_t*       batches;
+	unsigned int    batch_stamp;
+	ALLEGRO_VERTEX* batch_vertices;
+	int*            batch_indices;
+	int             num_draw_calls;
 };
 
-static shader_t*    s_def_shader = NULL;
-static unsigned int s_next_group_id = 0;
-static unsigned int s_next_shape_id = 0;
+static shader_t*       s_def_shader = NULL;
+static int*            s_instance_indices = NULL;
+static ALLEGRO_VERTEX* s_instance_vertices = NULL;
+static int             s_max_instance_indices = 0;
+static int             s_max_instance_vertices = 0;
+static unsigned int    s_next_group_id = 0;
+static unsigned int    s_next_shape_id = 0;
 
 void
 initialize_galileo(void)
@@ -94,6 +145,8 @@ shutdown_galileo(void)
 {
 	console_log(1, "shutting down Galileo");
 	shader_free(s_def_shader);
+	free(s_instance_vertices);
+	free(s_instance_indices);
 }
 
 shader_t*
@@ -172,12 +225,25 @@ group_free(group_t* group)
 	while (i_shape = vector_next(&iter))
 		shape_free(*i_shape);
 	vector_free(group->shapes);
+	free_batches(group);
 	shader_free(group->shader);
 	matrix_free(group->transform);
 	vector_free(group->uniforms);
 	free(group);
 }
 
+int
+group_get_draw_calls(const group_t* group)
+{
+	return group->num_draw_calls;
+}
+
+bool
+group_get_order_independent(const group_t* group)
+{
+	return group->is_unordered;
+}
+
 shader_t*
 group_get_shader(const group_t* group)
 {
@@ -190,6 +256,19 @@ group_get_transform(const group_t* group)
 	return group->transform;
 }
 
+void
+group_set_order_independent(group_t* group, bool is_unordered)
+{
+	// when the order doesn't matter, shapes are sorted by texture before being
+	// batched.  this only works as expected if the shapes don't overlap or the
+	// result of blending them doesn't depend on the order.
+
+	if (is_unordered == group->is_unordered)
+		return;
+	group->is_unordered = is_unordered;
+	free_batches(group);
+}
+
 void
 group_set_shader(group_t* group, shader_t* shader)
 {
@@ -221,38 +300,74 @@ group_add_shape(group_t* group, shape_t* shape)
 }
 
 void
-group_draw(const group_t* group, image_t* surface)
+group_draw(group_t* group, image_t* surface)
 {
-	iter_t iter;
+	struct batch*   batch;
+	iter_t          iter;
 	struct uniform* p;
+	shader_t*       shader;
+	image_t*        texture;
 
 	if (surface != NULL)
-		al_set_target_bitmap(get_image_bitmap(surface));
+		al_set_target_bitmap(get_image_target(surface));
 	
 #if defined(MINISPHERE_USE_SHADERS)
 	if (are_shaders_active()) {
-		shader_use(group->shader != NULL ? group->shader : get_default_shader());
-		iter = vector_enum(group->uniforms);
-		while (p = vector_next(&iter)) {
-			switch (p->type) {
-			case UNIFORM_FLOAT:
-				al_set_shader_float(p->name, p->float_value);
-				break;
-			case UNIFORM_INT:
-				al_set_shader_int(p->name, p->int_value);
-				break;
-			case UNIFORM_MATRIX:
-				al_set_shader_matrix(p->name, &p->mat_value);
-				break;
+		// uniform locations are looked up once per shader and then remembered.
+		// the shader only sends a value to the GPU if it changed since the last
+		// time it was set, so redrawing a group with the same uniforms costs
+		// nothing extra.  there may be no default shader, in which case
+		// there's nothing to send them to.
+		shader = group->shader != NULL ? group->shader : get_default_shader();
+		shader_use(shader);
+		if (shader != NULL) {
+			iter = vector_enum(group->uniforms);
+			while (p = vector_next(&iter)) {
+				if (p->shader_id != shader_id(shader)) {
+					p->slot = shader_uniform(shader, p->name);
+					p->shader_id = shader_id(shader);
+				}
+				switch (p->type) {
+				case UNIFORM_FLOAT:
+					shader_put_float(shader, p->slot, p->float_value);
+					break;
+				case UNIFORM_INT:
+					shader_put_int(shader, p->slot, p->int_value);
+					break;
+				case UNIFORM_MATRIX:
+					shader_put_matrix(shader, p->slot, &p->mat_value);
+					break;
+				}
 			}
 		}
 	}
 #endif
 
 	screen_transform(g_screen, group->transform);
-	iter = vector_enum(group->shapes);
-	while (vector_next(&iter))
-		render_shape(*(shape_t**)iter.ptr);
+	group->num_draw_calls = 0;
+	if (build_batches(group)) {
+		iter = vector_enum(group->batches);
+		while (batch = vector_next(&iter)) {
+			if (batch->shape != NULL)
+				render_shape(batch->shape);
+			else {
+				texture = batch->texture;
+				al_draw_indexed_prim(group->batch_vertices, NULL,
+					texture != NULL ? get_image_bitmap(texture) : NULL,
+					&group->batch_indices[batch->start], batch->num_indices,
+					batch->draw_mode);
+			}
+			++group->num_draw_calls;
+		}
+	}
+	else {
+		// couldn't build the batches, draw the shapes one at a time
+		iter = vector_enum(group->shapes);
+		while (vector_next(&iter)) {
+			render_shape(*(shape_t**)iter.ptr);
+			++group->num_draw_calls;
+		}
+	}
 	screen_transform(g_screen, NULL);
 	
 #if defined(MINISPHERE_USE_SHADERS)
@@ -266,40 +381,34 @@ group_draw(const group_t* group, image_t* surface)
 void
 group_put_float(group_t* group, const char* name, float value)
 {
-	struct uniform unif;
+	struct uniform* unif;
 
-	free_cached_uniform(group, name);
-	strncpy(unif.name, name, 255);
-	unif.name[255] = '\0';
-	unif.type = UNIFORM_FLOAT;
-	unif.float_value = value;
-	vector_push(group->uniforms, &unif);
+	if (!(unif = get_cached_uniform(group, name)))
+		return;
+	unif->type = UNIFORM_FLOAT;
+	unif->float_value = value;
 }
 
 void
 group_put_int(group_t* group, const char* name, int value)
 {
-	struct uniform unif;
+	struct uniform* unif;
 
-	free_cached_uniform(group, name);
-	strncpy(unif.name, name, 255);
-	unif.name[255] = '\0';
-	unif.type = UNIFORM_INT;
-	unif.int_value = value;
-	vector_push(group->uniforms, &unif);
+	if (!(unif = get_cached_uniform(group, name)))
+		return;
+	unif->type = UNIFORM_INT;
+	unif->int_value = value;
 }
 
 void
 group_put_matrix(group_t* group, const char* name, const matrix_t* matrix)
 {
-	struct uniform unif;
+	struct uniform* unif;
 
-	free_cached_uniform(group, name);
-	strncpy(unif.name, name, 255);
-	unif.name[255] = '\0';
-	unif.type = UNIFORM_MATRIX;
-	al_copy_transform(&unif.mat_value, matrix_transform(matrix));
-	vector_push(group->uniforms, &unif);
+	if (!(unif = get_cached_uniform(group, name)))
+		return;
+	unif->type = UNIFORM_MATRIX;
+	al_copy_transform(&unif->mat_value, matrix_transform(matrix));
 }
 
 shape_t*
@@ -340,11 +449,7 @@ shape_free(shape_t* shape)
 		return;
 	console_log(4, "disposing shape #%u no longer in use", shape->id);
 	free_image(shape->texture);
-#ifdef MINISPHERE_USE_VERTEX_BUF
-	if (shape->vbuf != NULL)
-		al_destroy_vertex_buffer(shape->vbuf);
-#endif
-	free(shape->sw_vbuf);
+	free_vertex_buffer(shape);
 	free(shape->vertices);
 	free(shape);
 }
@@ -376,6 +481,38 @@ shape_texture(const shape_t* shape)
 	return shape->texture;
 }
 
+bool
+shape_is_dynamic(const shape_t* shape)
+{
+	return shape->is_dynamic;
+}
+
+int
+shape_num_vertices(const shape_t* shape)
+{
+	return shape->num_vertices;
+}
+
+vertex_t
+shape_get_vertex(const shape_t* shape, int index)
+{
+	return shape->vertices[index];
+}
+
+void
+shape_set_dynamic(shape_t* shape, bool is_dynamic)
+{
+	// the buffer has to be recreated with the new usage hint, which happens on
+	// the next draw.
+	
+	if (is_dynamic == shape->is_dynamic)
+		return;
+	console_log(3, "making shape #%u %s", shape->id, is_dynamic ? "dynamic" : "static");
+	shape->is_dynamic = is_dynamic;
+	++shape->version;
+	free_vertex_buffer(shape);
+}
+
 void
 shape_set_texture(shape_t* shape, image_t* texture)
 {
@@ -384,6 +521,7 @@ shape_set_texture(shape_t* shape, image_t* texture)
 	old_texture = shape->texture;
 	shape->texture = ref_image(texture);
 	free_image(old_texture);
+	++shape->version;
 	shape_upload(shape);
 }
 
@@ -402,14 +540,41 @@ shape_add_vertex(shape_t* shape, vertex_t vertex)
 	}
 	++shape->num_vertices;
 	shape->vertices[shape->num_vertices - 1] = vertex;
+	
+	// the vertex buffer is sized for the old vertex count, so it has to be
+	// rebuilt from scratch.
+	free_vertex_buffer(shape);
+	++shape->version;
 	return true;
 }
 
+void
+shape_set_vertex(shape_t* shape, int index, vertex_t vertex)
+{
+	// only the changed range is sent to the GPU, on the next draw.  changing
+	// vertices in a static shape still works, but the driver may have put its
+	// buffer somewhere that's slow to update.
+	// a dynamic shape is drawn from its own buffer rather than merged into a
+	// batch, so its vertices can change without the group rebuilding anything.
+	
+	shape->vertices[index] = vertex;
+	if (!shape->is_dynamic)
+		++shape->version;
+	if (shape->dirty_start >= shape->dirty_end) {
+		shape->dirty_start = index;
+		shape->dirty_end = index + 1;
+	}
+	else {
+		shape->dirty_start = fmin(index, shape->dirty_start);
+		shape->dirty_end = fmax(index + 1, shape->dirty_end);
+	}
+}
+
 void
 shape_draw(shape_t* shape, matrix_t* matrix, image_t* surface)
 {
 	if (surface != NULL)
-		al_set_target_bitmap(get_image_bitmap(surface));
+		al_set_target_bitmap(get_image_target(surface));
 	screen_transform(g_screen, matrix);
 	render_shape(shape);
 	screen_transform(g_screen, NULL);
@@ -418,24 +583,63 @@ shape_draw(shape_t* shape, matrix_t* matrix, image_t* surface)
 }
 
 void
-shape_upload(shape_t* shape)
+shape_draw_instances(shape_t* shape, const ALLEGRO_TRANSFORM* instances, int num_instances, matrix_t* matrix, image_t* surface)
 {
-	ALLEGRO_BITMAP* bitmap;
-	ALLEGRO_VERTEX* vertices = NULL;
+	// Allegro doesn't expose hardware instancing, so the copies are expanded on
+	// the CPU into one big list primitive and drawn with a single call.  that's
+	// still much cheaper than drawing the shape over and over, since the vertex
+	// data only has to be converted once and there's no per-draw overhead.
+
+	ALLEGRO_BITMAP*          bitmap;
+	int                      num_indices;
+	int                      num_vertices;
+	ALLEGRO_VERTEX*          out;
 
 	int i;
 
-	console_log(3, "uploading shape #%u vertices to GPU", shape->id);
-#ifdef MINISPHERE_USE_VERTEX_BUF
-	if (shape->vbuf != NULL)
-		al_destroy_vertex_buffer(shape->vbuf);
-#endif
-	free(shape->sw_vbuf); shape->sw_vbuf = NULL;
+	num_vertices = shape->num_vertices;
+	num_indices = put_indices(shape, 0, NULL);
+	if (num_instances <= 0 || num_indices == 0)
+		return;
+	if (num_instances > INT_MAX / num_indices || num_instances > INT_MAX / num_vertices)
+		return;
+	if (!grow_instance_bufs(num_vertices * num_instances, num_indices * num_instances))
+		return;
+
+	// the first copy is converted from the shape and then used as a template
+	// for the others.  it's transformed last, in place.
+	convert_vertices(s_instance_vertices, shape->vertices, num_vertices);
+	for (i = num_instances - 1; i >= 0; --i) {
+		out = &s_instance_vertices[i * num_vertices];
+		if (i > 0)
+			memcpy(out, s_instance_vertices, num_vertices * sizeof(ALLEGRO_VERTEX));
+		transform_points(&instances[i], &out[0].x, num_vertices, sizeof(ALLEGRO_VERTEX), 3);
+		put_indices(shape, i * num_vertices, &s_instance_indices[i * num_indices]);
+	}
+	
+	if (surface != NULL)
+		al_set_target_bitmap(get_image_target(surface));
+	screen_transform(g_screen, matrix);
 	bitmap = shape->texture != NULL ? get_image_bitmap(shape->texture) : NULL;
+	al_draw_indexed_prim(s_instance_vertices, NULL, bitmap, s_instance_indices,
+		num_indices * num_instances, get_batch_mode(shape));
+	screen_transform(g_screen, NULL);
+	if (surface != NULL)
+		al_set_target_backbuffer(screen_display(g_screen));
+}
+
+void
+shape_upload(shape_t* shape)
+{
+	ALLEGRO_VERTEX* vertices = NULL;
+
+	console_log(3, "uploading shape #%u vertices to GPU", shape->id);
+	free_vertex_buffer(shape);
 
 	// create a vertex buffer
 #ifdef MINISPHERE_USE_VERTEX_BUF
-	if (shape->vbuf = al_create_vertex_buffer(NULL, NULL, shape->num_vertices, ALLEGRO_PRIM_BUFFER_STATIC))
+	if (shape->vbuf = al_create_vertex_buffer(NULL, NULL, shape->num_vertices,
+		shape->is_dynamic ? ALLEGRO_PRIM_BUFFER_DYNAMIC : ALLEGRO_PRIM_BUFFER_STATIC))
 		vertices = al_lock_vertex_buffer(shape->vbuf, 0, shape->num_vertices, ALLEGRO_LOCK_WRITEONLY);
 #endif
 	if (vertices == NULL) {
@@ -447,14 +651,8 @@ shape_upload(shape_t* shape)
 	}
 
 	// upload vertices
-	for (i = 0; i < shape->num_vertices; ++i) {
-		vertices[i].x = shape->vertices[i].x;
-		vertices[i].y = shape->vertices[i].y;
-		vertices[i].z = shape->vertices[i].z;
-		vertices[i].color = nativecolor(shape->vertices[i].color);
-		vertices[i].u = shape->vertices[i].u;
-		vertices[i].v = shape->vertices[i].v;
-	}
+	convert_vertices(vertices, shape->vertices, shape->num_vertices);
+	shape->dirty_start = shape->dirty_end = 0;
 
 	// unlock hardware buffer, if applicable
 #ifdef MINISPHERE_USE_VERTEX_BUF
@@ -489,6 +687,235 @@ assign_default_uv(shape_t* shape)
 		shape->vertices[i].u = cos(phi) * M_SQRT1_2 + 0.5;
 		shape->vertices[i].v = sin(phi) * -M_SQRT1_2 + 0.5;
 	}
+	++shape->version;
+}
+
+static bool
+build_batches(group_t* group)
+{
+	// merges runs of adjacent shapes with the same texture and kind of primitive
+	// into one indexed draw.  strips, fans and loops are turned into lists so
+	// they can be merged too.  dynamic shapes are left alone, as they have their
+	// own buffer which is cheaper to update than rebuilding the batches.  the
+	// result is kept until one of the shapes changes.
+
+	struct batch        batch;
+	int                 batch_mode;
+	int                 index_count = 0;
+	int*                indices = NULL;
+	int                 num_shapes;
+	struct shape_order* order = NULL;
+	int                 run_end;
+	int                 run_indices;
+	int                 run_vertices;
+	shape_t*            shape;
+	unsigned int        stamp;
+	int                 vertex_count = 0;
+	ALLEGRO_VERTEX*     vertices = NULL;
+
+	int i, j;
+
+	// the version of a shape only ever goes up, so the sum changes whenever any
+	// of them does.  for dynamic shapes, it only changes when the texture,
+	// vertex count or dynamic flag does.
+	num_shapes = (int)vector_len(group->shapes);
+	stamp = num_shapes;
+	for (i = 0; i < num_shapes; ++i)
+		stamp += (*(shape_t**)vector_get(group->shapes, i))->version;
+	if (group->batches != NULL && stamp == group->batch_stamp)
+		return true;
+
+	console_log(4, "batching %i shapes in group #%u", num_shapes, group->id);
+	free_batches(group);
+	if (!(group->batches = vector_new(sizeof(struct batch))))
+		goto on_error;
+	if (!(order = malloc((num_shapes + 1) * sizeof(struct shape_order))))
+		goto on_error;
+	for (i = 0; i < num_shapes; ++i) {
+		shape = *(shape_t**)vector_get(group->shapes, i);
+		order[i].shape = shape;
+		order[i].index = i;
+		if (!shape->is_dynamic) {
+			vertex_count += shape->num_vertices;
+			index_count += put_indices(shape, 0, NULL);
+		}
+	}
+	if (group->is_unordered)
+		qsort(order, num_shapes, sizeof(struct shape_order), compare_shapes);
+	if (!(vertices = malloc((vertex_count + 1) * sizeof(ALLEGRO_VERTEX))))
+		goto on_error;
+	if (!(indices = malloc((index_count + 1) * sizeof(int))))
+		goto on_error;
+	
+	vertex_count = index_count = 0;
+	for (i = 0; i < num_shapes; i = run_end) {
+		shape = order[i].shape;
+		batch_mode = get_batch_mode(shape);
+		run_end = i + 1;
+		while (run_end < num_shapes && !shape->is_dynamic && shape->num_vertices > 0
+			&& !order[run_end].shape->is_dynamic
+			&& order[run_end].shape->num_vertices > 0
+			&& order[run_end].shape->texture == shape->texture
+			&& get_batch_mode(order[run_end].shape) == batch_mode)
+		{
+			++run_end;
+		}
+		memset(&batch, 0, sizeof(struct batch));
+		if (run_end - i == 1) {
+			if (shape->num_vertices == 0)
+				continue;
+			batch.shape = shape;
+		}
+		else {
+			batch.texture = shape->texture;
+			batch.draw_mode = batch_mode;
+			batch.start = index_count;
+			run_indices = 0;
+			for (j = i; j < run_end; ++j) {
+				run_vertices = order[j].shape->num_vertices;
+				convert_vertices(&vertices[vertex_count], order[j].shape->vertices, run_vertices);
+				run_indices += put_indices(order[j].shape, vertex_count, &indices[index_count + run_indices]);
+				vertex_count += run_vertices;
+			}
+			index_count += run_indices;
+			batch.num_indices = run_indices;
+		}
+		if (!vector_push(group->batches, &batch))
+			goto on_error;
+	}
+	free(order);
+	group->batch_vertices = vertices;
+	group->batch_indices = indices;
+	group->batch_stamp = stamp;
+	console_log(4, "    %i draw calls for %i shapes", (int)vector_len(group->batches), num_shapes);
+	return true;
+
+on_error:
+	free(order);
+	free(vertices);
+	free(indices);
+	free_batches(group);
+	return false;
+}
+
+static int
+compare_shapes(const void* in_a, const void* in_b)
+{
+	const struct shape_order* a = in_a;
+	const struct shape_order* b = in_b;
+	
+	int mode_a, mode_b;
+
+	// dynamic shapes aren't batched, so they're sorted last
+	if (a->shape->is_dynamic != b->shape->is_dynamic)
+		return a->shape->is_dynamic ? 1 : -1;
+	if (a->shape->texture != b->shape->texture)
+		return (uintptr_t)a->shape->texture < (uintptr_t)b->shape->texture ? -1 : 1;
+	mode_a = get_batch_mode(a->shape);
+	mode_b = get_batch_mode(b->shape);
+	if (mode_a != mode_b)
+		return mode_a - mode_b;
+	
+	// keep the sort stable
+	return a->index - b->index;
+}
+
+static void
+convert_vertices(ALLEGRO_VERTEX* out, const vertex_t* vertices, int count)
+{
+	// runs of vertices usually share a color (white, more often than not), so
+	// the last conversion is reused rather than calling nativecolor() for every
+	// vertex.
+	
+	color_t       last_color;
+	ALLEGRO_COLOR native_color;
+
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		if (i == 0 || memcmp(&vertices[i].color, &last_color, sizeof(color_t)) != 0) {
+			last_color = vertices[i].color;
+			native_color = nativecolor(last_color);
+		}
+		out[i].x = vertices[i].x;
+		out[i].y = vertices[i].y;
+		out[i].z = vertices[i].z;
+		out[i].color = native_color;
+		out[i].u = vertices[i].u;
+		out[i].v = vertices[i].v;
+	}
+}
+
+static void
+free_vertex_buffer(shape_t* shape)
+{
+#ifdef MINISPHERE_USE_VERTEX_BUF
+	if (shape->vbuf != NULL)
+		al_destroy_vertex_buffer(shape->vbuf);
+	shape->vbuf = NULL;
+#endif
+	free(shape->sw_vbuf);
+	shape->sw_vbuf = NULL;
+}
+
+static bool
+grow_instance_bufs(int num_vertices, int num_indices)
+{
+	// the buffers used for instanced drawing are kept between draws, since the
+	// same effect is usually drawn every frame.
+
+	int*            new_indices;
+	ALLEGRO_VERTEX* new_vertices;
+
+	if (num_vertices > s_max_instance_vertices) {
+		if (!(new_vertices = realloc(s_instance_vertices, num_vertices * sizeof(ALLEGRO_VERTEX))))
+			return false;
+		s_instance_vertices = new_vertices;
+		s_max_instance_vertices = num_vertices;
+	}
+	if (num_indices > s_max_instance_indices) {
+		if (!(new_indices = realloc(s_instance_indices, num_indices * sizeof(int))))
+			return false;
+		s_instance_indices = new_indices;
+		s_max_instance_indices = num_indices;
+	}
+	return true;
+}
+
+static int
+get_batch_mode(const shape_t* shape)
+{
+	// returns the list primitive a shape becomes when it's merged with others
+	
+	switch (get_draw_mode(shape)) {
+	case ALLEGRO_PRIM_LINE_LIST:
+	case ALLEGRO_PRIM_LINE_STRIP:
+	case ALLEGRO_PRIM_LINE_LOOP:
+		return ALLEGRO_PRIM_LINE_LIST;
+	case ALLEGRO_PRIM_TRIANGLE_LIST:
+	case ALLEGRO_PRIM_TRIANGLE_STRIP:
+	case ALLEGRO_PRIM_TRIANGLE_FAN:
+		return ALLEGRO_PRIM_TRIANGLE_LIST;
+	default:
+		return ALLEGRO_PRIM_POINT_LIST;
+	}
+}
+
+static int
+get_draw_mode(const shape_t* shape)
+{
+	if (shape->type == SHAPE_AUTO)
+		return shape->num_vertices == 1 ? ALLEGRO_PRIM_POINT_LIST
+			: shape->num_vertices == 2 ? ALLEGRO_PRIM_LINE_LIST
+			: ALLEGRO_PRIM_TRIANGLE_STRIP;
+	else
+		return shape->type == SHAPE_LINES ? ALLEGRO_PRIM_LINE_LIST
+			: shape->type == SHAPE_LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
+			: shape->type == SHAPE_LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
+			: shape->type == SHAPE_TRIANGLES ? ALLEGRO_PRIM_TRIANGLE_LIST
+			: shape->type == SHAPE_TRI_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
+			: shape->type == SHAPE_TRI_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
+			: ALLEGRO_PRIM_POINT_LIST;
 }
 
 static bool
@@ -502,16 +929,112 @@ have_vertex_buffer(const shape_t* shape)
 }
 
 static void
-free_cached_uniform(group_t* group, const char* name)
+free_batches(group_t* group)
 {
-	iter_t iter;
+	vector_free(group->batches);
+	free(group->batch_vertices);
+	free(group->batch_indices);
+	group->batches = NULL;
+	group->batch_vertices = NULL;
+	group->batch_indices = NULL;
+}
+
+static struct uniform*
+get_cached_uniform(group_t* group, const char* name)
+{
+	// finds the group's entry for a uniform, adding one if there isn't one yet.
+	// entries are updated in place, so the slot looked up for a uniform stays
+	// valid when its value changes.
+
+	uint32_t        hash;
+	iter_t          iter;
+	struct uniform  unif;
 	struct uniform* p;
 
+	hash = strhash(name);
 	iter = vector_enum(group->uniforms);
 	while (p = vector_next(&iter)) {
-		if (strcmp(p->name, name) == 0)
-			iter_remove(&iter);
+		if (p->hash == hash && strcmp(p->name, name) == 0)
+			return p;
 	}
+	memset(&unif, 0, sizeof(struct uniform));
+	strncpy(unif.name, name, 255);
+	unif.name[255] = '\0';
+	unif.hash = strhash(unif.name);
+	unif.slot = -1;
+	if (!vector_push(group->uniforms, &unif))
+		return NULL;
+	return vector_get(group->uniforms, vector_len(group->uniforms) - 1);
+}
+
+static int
+put_indices(const shape_t* shape, int base, int* out_indices)
+{
+	// writes the indices needed to draw a shape as part of a list primitive
+	// (see get_batch_mode()) and returns how many there are.  if `out_indices`
+	// is NULL, only counts them.
+
+	int count = 0;
+	int n;
+
+	int i;
+
+	n = shape->num_vertices;
+	switch (get_draw_mode(shape)) {
+	case ALLEGRO_PRIM_POINT_LIST:
+		for (i = 0; i < n; ++i, count += 1)
+			if (out_indices != NULL)
+				out_indices[count] = base + i;
+		break;
+	case ALLEGRO_PRIM_LINE_LIST:
+		for (i = 0; i + 1 < n; i += 2, count += 2)
+			if (out_indices != NULL) {
+				out_indices[count] = base + i;
+				out_indices[count + 1] = base + i + 1;
+			}
+		break;
+	case ALLEGRO_PRIM_LINE_STRIP:
+	case ALLEGRO_PRIM_LINE_LOOP:
+		for (i = 0; i + 1 < n; ++i, count += 2)
+			if (out_indices != NULL) {
+				out_indices[count] = base + i;
+				out_indices[count + 1] = base + i + 1;
+			}
+		if (get_draw_mode(shape) == ALLEGRO_PRIM_LINE_LOOP && n > 2) {
+			if (out_indices != NULL) {
+				out_indices[count] = base + n - 1;
+				out_indices[count + 1] = base;
+			}
+			count += 2;
+		}
+		break;
+	case ALLEGRO_PRIM_TRIANGLE_LIST:
+		for (i = 0; i + 2 < n; i += 3, count += 3)
+			if (out_indices != NULL) {
+				out_indices[count] = base + i;
+				out_indices[count + 1] = base + i + 1;
+				out_indices[count + 2] = base + i + 2;
+			}
+		break;
+	case ALLEGRO_PRIM_TRIANGLE_STRIP:
+		// every other triangle in a strip is wound backwards
+		for (i = 0; i + 2 < n; ++i, count += 3)
+			if (out_indices != NULL) {
+				out_indices[count] = base + i + (i % 2);
+				out_indices[count + 1] = base + i + 1 - (i % 2);
+				out_indices[count + 2] = base + i + 2;
+			}
+		break;
+	case ALLEGRO_PRIM_TRIANGLE_FAN:
+		for (i = 1; i + 1 < n; ++i, count += 3)
+			if (out_indices != NULL) {
+				out_indices[count] = base;
+				out_indices[count + 1] = base + i;
+				out_indices[count + 2] = base + i + 1;
+			}
+		break;
+	}
+	return count;
 }
 
 static void
@@ -525,18 +1048,9 @@ render_shape(shape_t* shape)
 
 	if (!have_vertex_buffer(shape))
 		shape_upload(shape);
-	if (shape->type == SHAPE_AUTO)
-		draw_mode = shape->num_vertices == 1 ? ALLEGRO_PRIM_POINT_LIST
-			: shape->num_vertices == 2 ? ALLEGRO_PRIM_LINE_LIST
-			: ALLEGRO_PRIM_TRIANGLE_STRIP;
-	else
-		draw_mode = shape->type == SHAPE_LINES ? ALLEGRO_PRIM_LINE_LIST
-			: shape->type == SHAPE_LINE_LOOP ? ALLEGRO_PRIM_LINE_LOOP
-			: shape->type == SHAPE_LINE_STRIP ? ALLEGRO_PRIM_LINE_STRIP
-			: shape->type == SHAPE_TRIANGLES ? ALLEGRO_PRIM_TRIANGLE_LIST
-			: shape->type == SHAPE_TRI_STRIP ? ALLEGRO_PRIM_TRIANGLE_STRIP
-			: shape->type == SHAPE_TRI_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
-			: ALLEGRO_PRIM_POINT_LIST;
+	else if (shape->dirty_start < shape->dirty_end)
+		upload_dirty_range(shape);
+	draw_mode = get_draw_mode(shape);
 	
 	bitmap = shape->texture != NULL ? get_image_bitmap(shape->texture) : NULL;
 #ifdef MINISPHERE_USE_VERTEX_BUF
@@ -549,12 +1063,90 @@ render_shape(shape_t* shape)
 #endif
 }
 
+static bool
+read_js_vertex(duk_context* ctx, duk_idx_t index, vertex_t* inout_vertex)
+{
+	// reads a vertex object from JavaScript.  properties which aren't present
+	// keep the value already in `inout_vertex`.  returns false if the object
+	// is missing either of its texture coordinates.
+	
+	bool has_uv = true;
+	
+	index = duk_require_normalize_index(ctx, index);
+	if (duk_get_prop_string(ctx, index, "x"))
+		inout_vertex->x = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "y"))
+		inout_vertex->y = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "z"))
+		inout_vertex->z = duk_require_number(ctx, -1);
+	if (duk_get_prop_string(ctx, index, "u"))
+		inout_vertex->u = duk_require_number(ctx, -1);
+	else
+		has_uv = false;
+	if (duk_get_prop_string(ctx, index, "v"))
+		inout_vertex->v = duk_require_number(ctx, -1);
+	else
+		has_uv = false;
+	if (duk_get_prop_string(ctx, index, "color"))
+		inout_vertex->color = duk_require_sphere_color(ctx, -1);
+	duk_pop_n(ctx, 6);
+	return has_uv;
+}
+
+static float*
+require_floats(duk_context* ctx, duk_idx_t index, int group_size, int* out_count, const char* fn_name)
+{
+	// gets the data of a Float32Array holding groups of `group_size` floats
+	// each, throwing if it's anything else.  the alignment and length are checked
+	// as well, since a script can change an object's prototype and any buffer
+	// would otherwise be read as floats.
+
+	float*     data;
+	duk_size_t size;
+
+	index = duk_require_normalize_index(ctx, index);
+	duk_get_global_string(ctx, "Float32Array");
+	if (!duk_is_function(ctx, -1) || !duk_instanceof(ctx, index, -1))
+		duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "%s: expected a Float32Array", fn_name);
+	duk_pop(ctx);
+	data = duk_require_buffer_data(ctx, index, &size);
+	if ((uintptr_t)data % sizeof(float) != 0 || size % (group_size * sizeof(float)) != 0)
+		duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "%s: Float32Array must be aligned and hold groups of %i floats", fn_name, group_size);
+	*out_count = (int)(size / (group_size * sizeof(float)));
+	return data;
+}
+
+static void
+upload_dirty_range(shape_t* shape)
+{
+	int             count;
+	ALLEGRO_VERTEX* vertices = NULL;
+
+	count = shape->dirty_end - shape->dirty_start;
+	console_log(4, "updating %i vertices in shape #%u", count, shape->id);
+#ifdef MINISPHERE_USE_VERTEX_BUF
+	if (shape->vbuf != NULL) {
+		if (!(vertices = al_lock_vertex_buffer(shape->vbuf, shape->dirty_start, count, ALLEGRO_LOCK_WRITEONLY))) {
+			shape_upload(shape);
+			return;
+		}
+		convert_vertices(vertices, &shape->vertices[shape->dirty_start], count);
+		al_unlock_vertex_buffer(shape->vbuf);
+	}
+#endif
+	if (vertices == NULL)
+		convert_vertices(&shape->sw_vbuf[shape->dirty_start], &shape->vertices[shape->dirty_start], count);
+	shape->dirty_start = shape->dirty_end = 0;
+}
+
 void
 init_galileo_api(void)
 {
 	api_register_function(g_duk, NULL, "GetDefaultShaderProgram", js_GetDefaultShaderProgram);
 
 	api_register_ctor(g_duk, "Group", js_new_Group, js_Group_finalize);
+	api_register_prop(g_duk, "Group", "drawCalls", js_Group_get_drawCalls, NULL);
+	api_register_prop(g_duk, "Group", "orderIndependent", js_Group_get_orderIndependent, js_Group_set_orderIndependent);
 	api_register_prop(g_duk, "Group", "shader", js_Group_get_shader, js_Group_set_shader);
 	api_register_prop(g_duk, "Group", "transform", js_Group_get_transform, js_Group_set_transform);
 	api_register_method(g_duk, "Group", "draw", js_Group_draw);
@@ -564,11 +1156,14 @@ init_galileo_api(void)
 	api_register_ctor(g_duk, "Shape", js_new_Shape, js_Shape_finalize);
 	api_register_prop(g_duk, "Shape", "texture", js_Shape_get_texture, js_Shape_set_texture);
 	api_register_method(g_duk, "Shape", "draw", js_Shape_draw);
+	api_register_method(g_duk, "Shape", "drawInstances", js_Shape_drawInstances);
+	api_register_method(g_duk, "Shape", "setVertices", js_Shape_setVertices);
 	api_register_ctor(g_duk, "Transform", js_new_Transform, js_Transform_finalize);
 	api_register_method(g_duk, "Transform", "compose", js_Transform_compose);
 	api_register_method(g_duk, "Transform", "identity", js_Transform_identity);
 	api_register_method(g_duk, "Transform", "rotate", js_Transform_rotate);
 	api_register_method(g_duk, "Transform", "scale", js_Transform_scale);
+	api_register_method(g_duk, "Transform", "transformPoints", js_Transform_transformPoints);
 	api_register_method(g_duk, "Transform", "translate", js_Transform_translate);
 
 	api_register_const(g_duk, "SHAPE_AUTO", SHAPE_AUTO);
@@ -622,6 +1217,30 @@ js_Group_finalize(duk_context* ctx)
 	return 0;
 }
 
+static duk_ret_t
+js_Group_get_drawCalls(duk_context* ctx)
+{
+	group_t* group;
+
+	duk_push_this(ctx);
+	group = duk_require_sphere_obj(ctx, -1, "Group");
+
+	duk_push_int(ctx, group_get_draw_calls(group));
+	return 1;
+}
+
+static duk_ret_t
+js_Group_get_orderIndependent(duk_context* ctx)
+{
+	group_t* group;
+
+	duk_push_this(ctx);
+	group = duk_require_sphere_obj(ctx, -1, "Group");
+
+	duk_push_boolean(ctx, group_get_order_independent(group));
+	return 1;
+}
+
 static duk_ret_t
 js_Group_get_shader(duk_context* ctx)
 {
@@ -650,6 +1269,20 @@ js_Group_get_transform(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_Group_set_orderIndependent(duk_context* ctx)
+{
+	group_t* group;
+	bool     is_unordered;
+
+	duk_push_this(ctx);
+	group = duk_require_sphere_obj(ctx, -1, "Group");
+	is_unordered = duk_require_boolean(ctx, 0);
+
+	group_set_order_independent(group, is_unordered);
+	return 0;
+}
+
 static duk_ret_t
 js_Group_set_shader(duk_context* ctx)
 {
@@ -758,11 +1391,11 @@ js_GetDefaultShaderProgram(duk_context* ctx)
 static duk_ret_t
 js_new_Shape(duk_context* ctx)
 {
+	bool         is_dynamic;
 	bool         is_missing_uv = false;
 	int          num_args;
 	size_t       num_vertices;
 	shape_t*     shape;
-	duk_idx_t    stack_idx;
 	image_t*     texture;
 	shape_type_t type;
 	vertex_t     vertex;
@@ -773,6 +1406,7 @@ js_new_Shape(duk_context* ctx)
 	duk_require_object_coercible(ctx, 0);
 	texture = !duk_is_null(ctx, 1) ? duk_require_sphere_obj(ctx, 1, "Image") : NULL;
 	type = num_args >= 3 ? duk_require_int(ctx, 2) : SHAPE_AUTO;
+	is_dynamic = num_args >= 4 ? duk_require_boolean(ctx, 3) : false;
 	
 	if (!duk_is_array(ctx, 0))
 		duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "Shape(): first argument must be an array");
@@ -780,25 +1414,15 @@ js_new_Shape(duk_context* ctx)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Shape(): invalid shape type constant");
 	if (!(shape = shape_new(type, texture)))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Shape(): unable to create shape object");
+	shape_set_dynamic(shape, is_dynamic);
 	num_vertices = duk_get_length(ctx, 0);
 	for (i = 0; i < num_vertices; ++i) {
 		duk_get_prop_index(ctx, 0, i);
-		stack_idx = duk_normalize_index(ctx, -1);
-		vertex.x = duk_get_prop_string(ctx, stack_idx, "x") ? duk_require_number(ctx, -1) : 0.0;
-		vertex.y = duk_get_prop_string(ctx, stack_idx, "y") ? duk_require_number(ctx, -1) : 0.0;
-		vertex.z = duk_get_prop_string(ctx, stack_idx, "z") ? duk_require_number(ctx, -1) : 0.0;
-		if (duk_get_prop_string(ctx, stack_idx, "u"))
-			vertex.u = duk_require_number(ctx, -1);
-		else
+		memset(&vertex, 0, sizeof(vertex_t));
+		vertex.color = color_new(255, 255, 255, 255);
+		if (!read_js_vertex(ctx, -1, &vertex))
 			is_missing_uv = true;
-		if (duk_get_prop_string(ctx, stack_idx, "v"))
-			vertex.v = duk_require_number(ctx, -1);
-		else
-			is_missing_uv = true;
-		vertex.color = duk_get_prop_string(ctx, stack_idx, "color")
-			? duk_require_sphere_color(ctx, -1)
-			: color_new(255, 255, 255, 255);
-		duk_pop_n(ctx, 6);
+		duk_pop(ctx);
 		shape_add_vertex(shape, vertex);
 	}
 	if (is_missing_uv)
@@ -866,6 +1490,89 @@ js_Shape_draw(duk_context* ctx)
 	return 0;
 }
 
+static duk_ret_t
+js_Shape_drawInstances(duk_context* ctx)
+{
+	float*             data;
+	ALLEGRO_TRANSFORM* instances;
+	int                num_args;
+	int                num_instances;
+	shape_t*           shape;
+	image_t*           surface = NULL;
+	matrix_t*          transform = NULL;
+
+	int i;
+
+	duk_push_this(ctx);
+	num_args = duk_get_top(ctx) - 1;
+	shape = duk_require_sphere_obj(ctx, -1, "Shape");
+	if (num_args >= 2)
+		transform = duk_require_sphere_obj(ctx, 1, "Transform");
+	if (num_args >= 3)
+		surface = duk_require_sphere_obj(ctx, 2, "Surface");
+	
+	// instances can be given either as an array of Transforms or as a
+	// Float32Array, 4 floats per instance: x, y, angle and scale.  the transforms are kept
+	// in a Duktape buffer so they're cleaned up if there's an error.
+	if (duk_is_array(ctx, 0)) {
+		num_instances = (int)duk_get_length(ctx, 0);
+		instances = duk_push_fixed_buffer(ctx, (num_instances + 1) * sizeof(ALLEGRO_TRANSFORM));
+		for (i = 0; i < num_instances; ++i) {
+			duk_get_prop_index(ctx, 0, i);
+			al_copy_transform(&instances[i],
+				matrix_transform(duk_require_sphere_obj(ctx, -1, "Transform")));
+			duk_pop(ctx);
+		}
+	}
+	else {
+		data = require_floats(ctx, 0, 4, &num_instances, "Shape:drawInstances()");
+		instances = duk_push_fixed_buffer(ctx, (num_instances + 1) * sizeof(ALLEGRO_TRANSFORM));
+		for (i = 0; i < num_instances; ++i) {
+			al_build_transform(&instances[i], data[i * 4], data[i * 4 + 1],
+				data[i * 4 + 3], data[i * 4 + 3], data[i * 4 + 2]);
+		}
+	}
+
+	if (screen_is_skipframe(g_screen))
+		return 0;
+	shader_use(get_default_shader());
+	shape_draw_instances(shape, instances, num_instances, transform, surface);
+	shader_use(NULL);
+	return 0;
+}
+
+static duk_ret_t
+js_Shape_setVertices(duk_context* ctx)
+{
+	size_t   num_vertices;
+	shape_t* shape;
+	int      start;
+	vertex_t vertex;
+
+	duk_uarridx_t i;
+
+	duk_push_this(ctx);
+	shape = duk_require_sphere_obj(ctx, -1, "Shape");
+	start = duk_require_int(ctx, 0);
+	duk_require_object_coercible(ctx, 1);
+
+	if (!duk_is_array(ctx, 1))
+		duk_error_ni(ctx, -1, DUK_ERR_TYPE_ERROR, "Shape:setVertices(): second argument must be an array");
+	num_vertices = duk_get_length(ctx, 1);
+	if (start < 0 || start + num_vertices > shape_num_vertices(shape))
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Shape:setVertices(): range is outside of shape (%i vertices)", shape_num_vertices(shape));
+	if (!shape_is_dynamic(shape))
+		shape_set_dynamic(shape, true);
+	for (i = 0; i < num_vertices; ++i) {
+		duk_get_prop_index(ctx, 1, i);
+		vertex = shape_get_vertex(shape, start + i);
+		read_js_vertex(ctx, -1, &vertex);
+		duk_pop(ctx);
+		shape_set_vertex(shape, start + i, vertex);
+	}
+	return 0;
+}
+
 static duk_ret_t
 js_new_Transform(duk_context* ctx)
 {
@@ -958,6 +1665,22 @@ js_Transform_scale(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_Transform_transformPoints(duk_context* ctx)
+{
+	float*    data;
+	matrix_t* matrix;
+	int       num_points;
+	
+	duk_push_this(ctx);
+	matrix = duk_require_sphere_obj(ctx, -1, "Transform");
+	data = require_floats(ctx, 0, 2, &num_points, "Transform:transformPoints()");
+
+	transform_points(matrix_transform(matrix), data, num_points, 2 * sizeof(float), 2);
+	duk_dup(ctx, 0);
+	return 1;
+}
+
 static duk_ret_t
 js_Transform_translate(duk_context* ctx)
 {
@@ -34,27 +34,36 @@ shader_t* get_default_shader (void);
 
 vertex_t vertex (float x, float y, float z, float u, float v, color_t color);
 
-group_t*     group_new           (shader_t* shader);
-group_t*     group_ref           (group_t* group);
-void         group_free          (group_t* group);
-shader_t*    group_get_shader    (const group_t* group);
-matrix_t*    group_get_transform (const group_t* group);
-void         group_set_shader    (group_t* group, shader_t* shader);
-void         group_set_transform (group_t* group, matrix_t* transform);
-bool         group_add_shape     (group_t* group, shape_t* shape);
-void         group_draw          (const group_t* group, image_t* surface);
-void         group_put_float     (group_t* group, const char* name, float value);
-void         group_put_int       (group_t* group, const char* name, int value);
-void         group_put_matrix    (group_t* group, const char* name, const matrix_t* matrix);
-shape_t*     shape_new           (shape_type_t type, image_t* texture);
-shape_t*     shape_ref           (shape_t* shape);
-void         shape_free          (shape_t* shape);
-float_rect_t shape_bounds        (const shape_t* shape);
-image_t*     shape_texture       (const shape_t* shape);
-void         shape_set_texture   (shape_t* shape, image_t* texture);
-bool         shape_add_vertex    (shape_t* shape, vertex_t vertex);
-void         shape_draw          (shape_t* shape, matrix_t* matrix, image_t* surface);
-void         shape_upload        (shape_t* shape);
+group_t*     group_new                   (shader_t* shader);
+group_t*     group_ref                   (group_t* group);
+void         group_free                  (group_t* group);
+int          group_get_draw_calls        (const group_t* group);
+bool         group_get_order_independent (const group_t* group);
+shader_t*    group_get_shader            (const group_t* group);
+matrix_t*    group_get_transform         (const group_t* group);
+void         group_set_order_independent (group_t* group, bool is_unordered);
+void         group_set_shader            (group_t* group, shader_t* shader);
+void         group_set_transform         (group_t* group, matrix_t* transform);
+bool         group_add_shape             (group_t* group, shape_t* shape);
+void         group_draw                  (group_t* group, image_t* surface);
+void         group_put_float             (group_t* group, const char* name, float value);
+void         group_put_int               (group_t* group, const char* name, int value);
+void         group_put_matrix            (group_t* group, const char* name, const matrix_t* matrix);
+shape_t*     shape_new                   (shape_type_t type, image_t* texture);
+shape_t*     shape_ref                   (shape_t* shape);
+void         shape_free                  (shape_t* shape);
+float_rect_t shape_bounds                (const shape_t* shape);
+image_t*     shape_texture               (const shape_t* shape);
+bool         shape_is_dynamic            (const shape_t* shape);
+int          shape_num_vertices          (const shape_t* shape);
+vertex_t     shape_get_vertex            (const shape_t* shape, int index);
+void         shape_set_dynamic           (shape_t* shape, bool is_dynamic);
+void         shape_set_texture           (shape_t* shape, image_t* texture);
+bool         shape_add_vertex            (shape_t* shape, vertex_t vertex);
+void         shape_set_vertex            (shape_t* shape, int index, vertex_t vertex);
+void         shape_draw                  (shape_t* shape, matrix_t* matrix, image_t* surface);
+void         shape_draw_instances        (shape_t* shape, const ALLEGRO_TRANSFORM* instances, int num_instances, matrix_t* matrix, image_t* surface);
+void         shape_upload                (shape_t* shape);
 
 void init_galileo_api (void);
 
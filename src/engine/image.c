@@ -1,6 +1,8 @@
 #include "minisphere.h"
 #include "api.h"
+#include "async.h"
 #include "color.h"
+#include "colorfx.h"
 #include "surface.h"
 
 #include "image.h"
@@ -17,12 +19,35 @@ struct image
 	int             width;
 	int             height;
 	image_t*        parent;
+	bool            is_soft;
+	ALLEGRO_BITMAP* upload;
+	bool            is_upload_stale;
+};
+
+struct cache_entry
+{
+	char*    key;
+	image_t* image;
+	size_t   size;
+};
+
+struct load_job
+{
+	ALLEGRO_BITMAP* bitmap;
+	char*           cache_key;
+	image_load_cb_t callback;
+	char*           filename;
+	size_t          file_size;
+	image_t*        image;
+	void*           slurp;
+	void*           udata;
 };
 
 static duk_ret_t js_GetSystemArrow          (duk_context* ctx);
 static duk_ret_t js_GetSystemDownArrow      (duk_context* ctx);
 static duk_ret_t js_GetSystemUpArrow        (duk_context* ctx);
 static duk_ret_t js_LoadImage               (duk_context* ctx);
+static duk_ret_t js_LoadImageAsync          (duk_context* ctx);
 static duk_ret_t js_GrabImage               (duk_context* ctx);
 static duk_ret_t js_new_Image               (duk_context* ctx);
 static duk_ret_t js_Image_finalize          (duk_context* ctx);
@@ -39,13 +64,75 @@ static duk_ret_t js_Image_transformBlitMask (duk_context* ctx);
 static duk_ret_t js_Image_zoomBlit          (duk_context* ctx);
 static duk_ret_t js_Image_zoomBlitMask      (duk_context* ctx);
 
-static void cache_pixels   (image_t* image);
-static void uncache_pixels (image_t* image);
+static void            cache_image        (const char* key, image_t* image);
+static ALLEGRO_BITMAP* create_bitmap_like (const image_t* image, int width, int height);
+static image_t*        find_cached_image  (const char* key);
+static image_lock_t*   lock_bitmap        (image_t* image);
+static void            cache_pixels       (image_t* image);
+static void            uncache_pixels     (image_t* image);
+static void            decode_image_job   (void* udata);
+static void            finish_image_job   (void* udata, bool is_cancelled);
+static void            on_js_image_loaded (image_t* image, void* udata);
+static const char*     sniff_image_type   (const char* filename, const void* data, size_t size);
+static bool            upload_image       (image_t* image);
+
+static vector_t*       s_load_cache = NULL;
+static size_t          s_cache_budget = 0;
+static size_t          s_cache_size = 0;
+static ALLEGRO_BITMAP* s_last_texture = NULL;
+static unsigned int    s_next_async_id = 0;
+static unsigned int    s_next_image_id = 0;
+static unsigned int    s_num_cache_evictions = 0;
+static unsigned int    s_num_cache_hits = 0;
+static unsigned int    s_num_cache_misses = 0;
+static int             s_num_binds = 0;
+static int             s_num_texture_switches = 0;
+static image_t*        s_sys_arrow = NULL;
+static image_t*        s_sys_dn_arrow = NULL;
+static image_t*        s_sys_up_arrow = NULL;
 
-static unsigned int s_next_image_id = 0;
-static image_t*     s_sys_arrow = NULL;
-static image_t*     s_sys_dn_arrow = NULL;
-static image_t*     s_sys_up_arrow = NULL;
+void
+initialize_images(void)
+{
+	// decoded images are cached by file identity so that loading the same file
+	// twice doesn't decode it again and waste texture memory on a second copy.
+	// the cache keeps its own reference to each image and evicts the least
+	// recently used ones once the budget from system.ini is exceeded.
+
+	double budget_mb;
+
+	console_log(1, "initializing image manager");
+	budget_mb = g_sys_conf != NULL ? kev_read_float(g_sys_conf, "ImageCacheSize", 64.0) : 64.0;
+	s_cache_budget = budget_mb > 0.0 ? (size_t)(budget_mb * 1048576) : 0;
+	if (s_cache_budget > 0) {
+		console_log(2, "    image cache budget: %.1f MB", budget_mb);
+		s_load_cache = vector_new(sizeof(struct cache_entry));
+	}
+}
+
+void
+shutdown_images(void)
+{
+	struct cache_entry* entry;
+
+	iter_t iter;
+
+	console_log(1, "shutting down image manager");
+	console_log(2, "    objects created: %u", s_next_image_id);
+	console_log(2, "    cache hits: %u", s_num_cache_hits);
+	console_log(2, "    cache misses: %u", s_num_cache_misses);
+	console_log(2, "    cache evictions: %u", s_num_cache_evictions);
+	if (s_load_cache != NULL) {
+		iter = vector_enum(s_load_cache);
+		while (entry = vector_next(&iter)) {
+			free_image(entry->image);
+			free(entry->key);
+		}
+		vector_free(s_load_cache);
+		s_load_cache = NULL;
+		s_cache_size = 0;
+	}
+}
 
 image_t*
 create_image(int width, int height)
@@ -66,6 +153,31 @@ on_error:
 	return NULL;
 }
 
+image_t*
+create_soft_image(int width, int height)
+{
+	// software images live in system memory and are drawn into by the rasterizer
+	// in raster.c instead of the GPU.  a video copy is only made when the image is
+	// drawn somewhere, see get_image_bitmap().
+
+	image_t* image;
+
+	console_log(3, "creating software image #%u at %ix%i", s_next_image_id, width, height);
+	image = calloc(1, sizeof(image_t));
+	image->is_soft = true;
+	image->is_upload_stale = true;
+	if (!(image->bitmap = create_bitmap_like(image, width, height)))
+		goto on_error;
+	image->id = s_next_image_id++;
+	image->width = al_get_bitmap_width(image->bitmap);
+	image->height = al_get_bitmap_height(image->bitmap);
+	return ref_image(image);
+
+on_error:
+	free(image);
+	return NULL;
+}
+
 image_t*
 create_subimage(image_t* parent, int x, int y, int width, int height)
 {
@@ -89,13 +201,24 @@ on_error:
 image_t*
 clone_image(const image_t* src_image)
 {
-	image_t* image;
+	image_t*      image;
+	ALLEGRO_STATE old_state;
 
 	console_log(3, "cloning image #%u from source image #%u",
 		s_next_image_id, src_image->id);
 	
 	image = calloc(1, sizeof(image_t));
-	if (!(image->bitmap = al_clone_bitmap(src_image->bitmap)))
+	image->is_soft = src_image->is_soft;
+	image->is_upload_stale = true;
+	if (image->is_soft) {
+		al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+		al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+		al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+	}
+	image->bitmap = al_clone_bitmap(src_image->bitmap);
+	if (image->is_soft)
+		al_restore_state(&old_state);
+	if (image->bitmap == NULL)
 		goto on_error;
 	image->id = s_next_image_id++;
 	image->width = al_get_bitmap_width(image->bitmap);
@@ -111,30 +234,30 @@ on_error:
 image_t*
 load_image(const char* filename)
 {
+	// note: images returned by this function may be shared through the image
+	// cache and must be treated as read-only.  clone the image first if it needs
+	// to be modified.
+
 	ALLEGRO_FILE* al_file = NULL;
+	char*         cache_key;
 	const char*   file_ext;
 	size_t        file_size;
-	uint8_t       first_16[16];
 	image_t*      image;
 	void*         slurp = NULL;
 
-	console_log(2, "loading image #%u as `%s`", s_next_image_id, filename);
+	cache_key = sfs_fident(g_fs, filename, NULL);
+	if (image = find_cached_image(cache_key)) {
+		console_log(2, "using cached image #%u for `%s`", image->id, filename);
+		free(cache_key);
+		return image;
+	}
 	
+	console_log(2, "loading image #%u as `%s`", s_next_image_id, filename);
 	image = calloc(1, sizeof(image_t));
 	if (!(slurp = sfs_fslurp(g_fs, filename, NULL, &file_size)))
 		goto on_error;
 	al_file = al_open_memfile(slurp, file_size, "rb");
-
-	// look at the first 16 bytes of the file to determine its actual type.
-	// Allegro won't load it if the content doesn't match the file extension, so
-	// we have to inspect the file ourselves.
-	al_fread(al_file, first_16, 16);
-	al_fseek(al_file, 0, ALLEGRO_SEEK_SET);
-	file_ext = strrchr(filename, '.');
-	if (memcmp(first_16, "BM", 2) == 0) file_ext = ".bmp";
-	if (memcmp(first_16, "\211PNG\r\n\032\n", 8) == 0) file_ext = ".png";
-	if (memcmp(first_16, "\0xFF\0xD8", 2) == 0) file_ext = ".jpg";
-
+	file_ext = sniff_image_type(filename, slurp, file_size);
 	if (!(image->bitmap = al_load_bitmap_f(al_file, file_ext)))
 		goto on_error;
 	al_fclose(al_file);
@@ -143,17 +266,58 @@ load_image(const char* filename)
 	image->height = al_get_bitmap_height(image->bitmap);
 	
 	image->id = s_next_image_id++;
-	return ref_image(image);
+	ref_image(image);
+	cache_image(cache_key, image);
+	free(cache_key);
+	return image;
 
 on_error:
 	console_log(2, "    failed to load image #%u", s_next_image_id++);
 	if (al_file != NULL)
 		al_fclose(al_file);
+	free(cache_key);
 	free(slurp);
 	free(image);
 	return NULL;
 }
 
+bool
+load_image_async(const char* filename, image_load_cb_t callback, void* udata)
+{
+	// the file is read up front since SphereFS isn't thread safe, but decoding it,
+	// which is the expensive part, happens on the async worker pool.  `callback`
+	// is called later on the main thread with the new image (which it takes
+	// ownership of), or NULL if it couldn't be decoded.  it's not called at all if
+	// the engine shuts down before then.  a cached image is still delivered
+	// through the worker pool so the callback is never called synchronously.
+
+	struct load_job* job;
+
+	console_log(3, "queueing async load of `%s`", filename);
+
+	job = calloc(1, sizeof(struct load_job));
+	job->callback = callback;
+	job->udata = udata;
+	job->cache_key = sfs_fident(g_fs, filename, NULL);
+	if (!(job->filename = strdup(filename)))
+		goto on_error;
+	if (!(job->image = find_cached_image(job->cache_key))) {
+		if (!(job->slurp = sfs_fslurp(g_fs, filename, NULL, &job->file_size)))
+			goto on_error;
+	}
+	if (!queue_async_job(decode_image_job, finish_image_job, job))
+		goto on_error;
+	return true;
+
+on_error:
+	free_image(job->image);
+	free(job->slurp);
+	free(job->filename);
+	free(job->cache_key);
+	free(job);
+	return false;
+}
+
 image_t*
 read_image(sfs_file_t* file, int width, int height)
 {
@@ -242,6 +406,8 @@ free_image(image_t* image)
 		image->id);
 	uncache_pixels(image);
 	al_destroy_bitmap(image->bitmap);
+	if (image->upload != NULL)
+		al_destroy_bitmap(image->upload);
 	free_image(image->parent);
 	free(image);
 }
@@ -249,8 +415,41 @@ free_image(image_t* image)
 ALLEGRO_BITMAP*
 get_image_bitmap(image_t* image)
 {
-	uncache_pixels(image);
-	return image->bitmap;
+	// returns a bitmap to draw the image with.  for software images, this is a
+	// video copy which is refreshed here if the image changed since the last
+	// upload.  use get_image_target() to draw onto an image instead.
+	//
+	// every call is counted as a draw, and if the underlying texture isn't the
+	// same one the last draw used, as a texture switch.  subimages share their
+	// root's texture, which is what makes atlasing pay off.
+
+	ALLEGRO_BITMAP* bitmap;
+	image_t*        root;
+
+	bitmap = image->is_soft && upload_image(image) ? image->upload : image->bitmap;
+	root = image;
+	while (root->parent != NULL)
+		root = root->parent;
+	++s_num_binds;
+	if (root->bitmap != s_last_texture) {
+		++s_num_texture_switches;
+		s_last_texture = root->bitmap;
+	}
+	return bitmap;
+}
+
+void
+get_image_bind_counts(int* out_num_binds, int* out_num_switches)
+{
+	// returns the number of times a bitmap was fetched for drawing, and how many
+	// of those switched textures, since the last call and starts counting again.
+	// the screen calls this once per frame.
+
+	*out_num_binds = s_num_binds;
+	*out_num_switches = s_num_texture_switches;
+	s_num_binds = 0;
+	s_num_texture_switches = 0;
+	s_last_texture = NULL;
 }
 
 int
@@ -259,6 +458,23 @@ get_image_height(const image_t* image)
 	return image->height;
 }
 
+unsigned int
+get_image_refcount(const image_t* image)
+{
+	return image->refcount;
+}
+
+ALLEGRO_BITMAP*
+get_image_target(image_t* image)
+{
+	// returns the bitmap to set as the Allegro target when drawing onto the image.
+	// the caller is assumed to modify it.
+
+	uncache_pixels(image);
+	image->is_upload_stale = true;
+	return image->bitmap;
+}
+
 color_t
 get_image_pixel(image_t* image, int x, int y)
 {
@@ -271,39 +487,84 @@ get_image_pixel(image_t* image, int x, int y)
 	return image->pixel_cache[x + y * image->width];
 }
 
+bool
+get_image_pixels(image_t* image, int x, int y, int width, int height, color_t* buffer)
+{
+	image_lock_t* lock;
+	color_t*      psrc;
+
+	int i_y;
+
+	if (image->pixel_cache != NULL) {
+		// pixels are already cached, no need to lock the bitmap
+		++image->cache_hits;
+		psrc = image->pixel_cache + x + y * image->width;
+		for (i_y = 0; i_y < height; ++i_y)
+			memcpy(buffer + i_y * width, psrc + i_y * image->width, width * sizeof(color_t));
+		return true;
+	}
+	if (!(lock = lock_bitmap(image)))
+		return false;
+	psrc = lock->pixels + x + y * lock->pitch;
+	for (i_y = 0; i_y < height; ++i_y)
+		memcpy(buffer + i_y * width, psrc + i_y * lock->pitch, width * sizeof(color_t));
+	unlock_image(image, lock);
+	return true;
+}
+
 int
 get_image_width(const image_t* image)
 {
 	return image->width;
 }
 
+bool
+is_image_soft(const image_t* image)
+{
+	return image->is_soft;
+}
+
 void
 set_image_pixel(image_t* image, int x, int y, color_t color)
 {
 	ALLEGRO_BITMAP* old_target;
 
-	uncache_pixels(image);
 	old_target = al_get_target_bitmap();
-	al_set_target_bitmap(image->bitmap);
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_pixel(x + 0.5, y + 0.5, nativecolor(color));
 	al_set_target_bitmap(old_target);
 }
 
+bool
+set_image_pixels(image_t* image, int x, int y, int width, int height, const color_t* buffer)
+{
+	image_lock_t* lock;
+	color_t*      pdest;
+
+	int i_y;
+
+	if (!(lock = lock_image(image)))
+		return false;
+	uncache_pixels(image);
+	pdest = lock->pixels + x + y * lock->pitch;
+	for (i_y = 0; i_y < height; ++i_y)
+		memcpy(pdest + i_y * lock->pitch, buffer + i_y * width, width * sizeof(color_t));
+	unlock_image(image, lock);
+	return true;
+}
+
 bool
 apply_color_matrix(image_t* image, colormatrix_t matrix, int x, int y, int width, int height)
 {
 	image_lock_t* lock;
-	color_t*      pixel;
 
-	int i_x, i_y;
+	int i_y;
 
 	if (!(lock = lock_image(image)))
 		return false;
 	uncache_pixels(image);
-	for (i_x = x; i_x < x + width; ++i_x) for (i_y = y; i_y < y + height; ++i_y) {
-		pixel = &lock->pixels[i_x + i_y * lock->pitch];
-		*pixel = color_transform(*pixel, matrix);
-	}
+	for (i_y = y; i_y < y + height; ++i_y)
+		colorfx_matrix_row(&lock->pixels[x + i_y * lock->pitch], width, &matrix);
 	unlock_image(image, lock);
 	return true;
 }
@@ -318,10 +579,9 @@ apply_color_matrix_4(image_t* image, colormatrix_t ul_mat, colormatrix_t ur_mat,
 	
 	int           i1, i2;
 	image_lock_t* lock;
-	colormatrix_t mat_1, mat_2, mat_3;
-	color_t*      pixel;
+	colormatrix_t mat_1, mat_2;
 
-	int i_x, i_y;
+	int i_y;
 
 	if (!(lock = lock_image(image)))
 		return false;
@@ -329,21 +589,13 @@ apply_color_matrix_4(image_t* image, colormatrix_t ul_mat, colormatrix_t ur_mat,
 	for (i_y = y; i_y < y + h; ++i_y) {
 		// thankfully, we don't have to do a full bilinear interpolation every frame.
 		// two thirds of the work is done in the outer loop, giving us two color matrices
-		// which we then use in the inner loop to calculate the transforms for individual
-		// pixels.
+		// which the row kernel then interpolates between to calculate the transforms for
+		// individual pixels.
 		i1 = y + h - 1 - i_y;
 		i2 = i_y - y;
-		mat_1 = colormatrix_lerp(ul_mat, ll_mat, i1, i2);
-		mat_2 = colormatrix_lerp(ur_mat, lr_mat, i1, i2);
-		for (i_x = x; i_x < x + w; ++i_x) {
-			// calculate the final matrix for this pixel and transform it
-			i1 = x + w - 1 - i_x;
-			i2 = i_x - x;
-			mat_3 = colormatrix_lerp(mat_1, mat_2, i1, i2);
-			pixel = &lock->pixels[i_x + i_y * lock->pitch];
-			*pixel = color_transform(*pixel, mat_3);
-
-		}
+		mat_1 = h > 1 ? colormatrix_lerp(ul_mat, ll_mat, i1, i2) : ul_mat;
+		mat_2 = h > 1 ? colormatrix_lerp(ur_mat, lr_mat, i1, i2) : ur_mat;
+		colorfx_lerp_row(&lock->pixels[x + i_y * lock->pitch], w, &mat_1, &mat_2);
 	}
 	unlock_image(image, lock);
 	return true;
@@ -352,23 +604,18 @@ apply_color_matrix_4(image_t* image, colormatrix_t ul_mat, colormatrix_t ur_mat,
 bool
 apply_image_lookup(image_t* image, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256])
 {
-	ALLEGRO_BITMAP*        bitmap = get_image_bitmap(image);
-	uint8_t*               pixel;
-	ALLEGRO_LOCKED_REGION* lock;
+	image_lock_t* lock;
+	colorfx_lut_t lut;
 
-	int i_x, i_y;
+	int i_y;
 
-	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
+	if (!(lock = lock_image(image)))
 		return false;
 	uncache_pixels(image);
-	for (i_x = x; i_x < x + width; ++i_x) for (i_y = y; i_y < y + height; ++i_y) {
-		pixel = (uint8_t*)lock->data + i_x * 4 + i_y * lock->pitch;
-		pixel[0] = red_lu[pixel[0]];
-		pixel[1] = green_lu[pixel[1]];
-		pixel[2] = blue_lu[pixel[2]];
-		pixel[3] = alpha_lu[pixel[3]];
-	}
-	al_unlock_bitmap(bitmap);
+	colorfx_init_lut(&lut, red_lu, green_lu, blue_lu, alpha_lu);
+	for (i_y = y; i_y < y + height; ++i_y)
+		colorfx_lookup_row(&lock->pixels[x + i_y * lock->pitch], width, &lut);
+	unlock_image(image, lock);
 	return true;
 }
 
@@ -379,7 +626,7 @@ blit_image(image_t* image, image_t* target_image, int x, int y)
 	int blend_mode_src;
 	int blend_op;
 
-	al_set_target_bitmap(get_image_bitmap(target_image));
+	al_set_target_bitmap(get_image_target(target_image));
 	al_get_blender(&blend_op, &blend_mode_src, &blend_mode_dest);
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
 	al_draw_bitmap(get_image_bitmap(image), x, y, 0x0);
@@ -390,28 +637,28 @@ blit_image(image_t* image, image_t* target_image, int x, int y)
 void
 draw_image(image_t* image, int x, int y)
 {
-	al_draw_bitmap(image->bitmap, x, y, 0x0);
+	al_draw_bitmap(get_image_bitmap(image), x, y, 0x0);
 }
 
 void
 draw_image_masked(image_t* image, color_t mask, int x, int y)
 {
-	al_draw_tinted_bitmap(image->bitmap, al_map_rgba(mask.r, mask.g, mask.b, mask.alpha), x, y, 0x0);
+	al_draw_tinted_bitmap(get_image_bitmap(image), al_map_rgba(mask.r, mask.g, mask.b, mask.alpha), x, y, 0x0);
 }
 
 void
 draw_image_scaled(image_t* image, int x, int y, int width, int height)
 {
-	al_draw_scaled_bitmap(image->bitmap,
-		0, 0, al_get_bitmap_width(image->bitmap), al_get_bitmap_height(image->bitmap),
+	al_draw_scaled_bitmap(get_image_bitmap(image),
+		0, 0, image->width, image->height,
 		x, y, width, height, 0x0);
 }
 
 void
 draw_image_scaled_masked(image_t* image, color_t mask, int x, int y, int width, int height)
 {
-	al_draw_tinted_scaled_bitmap(image->bitmap, nativecolor(mask),
-		0, 0, al_get_bitmap_width(image->bitmap), al_get_bitmap_height(image->bitmap),
+	al_draw_tinted_scaled_bitmap(get_image_bitmap(image), nativecolor(mask),
+		0, 0, image->width, image->height,
 		x, y, width, height, 0x0);
 }
 
@@ -432,24 +679,25 @@ draw_image_tiled_masked(image_t* image, color_t mask, int x, int y, int width, i
 	int i_x, i_y;
 
 	img_w = image->width; img_h = image->height;
-	if (img_w >= 16 && img_h >= 16) {
-		// tile in hardware whenever possible
+	if (img_w >= 16 && img_h >= 16 && image->parent == NULL) {
+		// tile in hardware whenever possible.  this can't be done for subimages
+		// since the texture would wrap around the parent instead.
 		ALLEGRO_VERTEX vbuf[] = {
 			{ x, y, 0, 0, 0, native_mask },
 			{ x + width, y, 0, width, 0, native_mask },
 			{ x, y + height, 0, 0, height, native_mask },
 			{ x + width, y + height, 0, width, height, native_mask }
 		};
-		al_draw_prim(vbuf, NULL, image->bitmap, 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
+		al_draw_prim(vbuf, NULL, get_image_bitmap(image), 0, 4, ALLEGRO_PRIM_TRIANGLE_STRIP);
 	}
 	else {
-		// texture smaller than 16x16, tile it in software (Allegro pads it)
+		// texture smaller than 16x16 or part of an atlas, tile it in software
 		is_drawing_held = al_is_bitmap_drawing_held();
 		al_hold_bitmap_drawing(true);
 		for (i_x = width / img_w; i_x >= 0; --i_x) for (i_y = height / img_h; i_y >= 0; --i_y) {
 			tile_w = i_x == width / img_w ? width % img_w : img_w;
 			tile_h = i_y == height / img_h ? height % img_h : img_h;
-			al_draw_tinted_bitmap_region(image->bitmap, native_mask,
+			al_draw_tinted_bitmap_region(get_image_bitmap(image), native_mask,
 				0, 0, tile_w, tile_h,
 				x + i_x * img_w, y + i_y * img_h, 0x0);
 		}
@@ -463,11 +711,10 @@ fill_image(image_t* image, color_t color)
 	int             clip_x, clip_y, clip_w, clip_h;
 	ALLEGRO_BITMAP* last_target;
 
-	uncache_pixels(image);
 	al_get_clipping_rectangle(&clip_x, &clip_y, &clip_w, &clip_h);
 	al_reset_clipping_rectangle();
 	last_target = al_get_target_bitmap();
-	al_set_target_bitmap(image->bitmap);
+	al_set_target_bitmap(get_image_target(image));
 	al_clear_to_color(al_map_rgba(color.r, color.g, color.b, color.alpha));
 	al_set_target_bitmap(last_target);
 	al_set_clipping_rectangle(clip_x, clip_y, clip_w, clip_h);
@@ -483,7 +730,7 @@ flip_image(image_t* image, bool is_h_flip, bool is_v_flip)
 	if (!is_h_flip && !is_v_flip)  // this really shouldn't happen...
 		return true;
 	uncache_pixels(image);
-	if (!(new_bitmap = al_create_bitmap(image->width, image->height))) return false;
+	if (!(new_bitmap = create_bitmap_like(image, image->width, image->height))) return false;
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(new_bitmap);
 	if (is_h_flip) draw_flags |= ALLEGRO_FLIP_HORIZONTAL;
@@ -492,55 +739,38 @@ flip_image(image_t* image, bool is_h_flip, bool is_v_flip)
 	al_set_target_bitmap(old_target);
 	al_destroy_bitmap(image->bitmap);
 	image->bitmap = new_bitmap;
+	image->is_upload_stale = true;
 	return true;
 }
 
 image_lock_t*
 lock_image(image_t* image)
 {
-	ALLEGRO_LOCKED_REGION* ll_lock;
+	// the caller may write through the lock, so any cached pixels or uploaded
+	// copy of the image are assumed to be stale from here on.
 
-	if (image->lock_count == 0) {
-		if (!(ll_lock = al_lock_bitmap(image->bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READWRITE)))
-			return NULL;
-		ref_image(image);
-		image->lock.pixels = ll_lock->data;
-		image->lock.pitch = ll_lock->pitch / 4;
-		image->lock.num_lines = image->height;
-	}
-	++image->lock_count;
-	return &image->lock;
+	image_lock_t* lock;
+
+	if (!(lock = lock_bitmap(image)))
+		return NULL;
+	uncache_pixels(image);
+	image->is_upload_stale = true;
+	return lock;
 }
 
 bool
 replace_image_color(image_t* image, color_t color, color_t new_color)
 {
-	ALLEGRO_BITMAP*        bitmap = get_image_bitmap(image);
-	uint8_t*               pixel;
-	ALLEGRO_LOCKED_REGION* lock;
-	int                    w, h;
+	image_lock_t* lock;
 
-	int i_x, i_y;
+	int i_y;
 
-	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
+	if (!(lock = lock_image(image)))
 		return false;
 	uncache_pixels(image);
-	w = al_get_bitmap_width(bitmap);
-	h = al_get_bitmap_height(bitmap);
-	for (i_x = 0; i_x < w; ++i_x) for (i_y = 0; i_y < h; ++i_y) {
-		pixel = (uint8_t*)lock->data + i_x * 4 + i_y * lock->pitch;
-		if (pixel[0] == color.r &&
-		    pixel[1] == color.g &&
-		    pixel[2] == color.b &&
-		    pixel[3] == color.alpha)
-		{
-			pixel[0] = new_color.r;
-			pixel[1] = new_color.g;
-			pixel[2] = new_color.b;
-			pixel[3] = new_color.alpha;
-		}
-	}
-	al_unlock_bitmap(bitmap);
+	for (i_y = 0; i_y < image->height; ++i_y)
+		colorfx_replace_row(&lock->pixels[i_y * lock->pitch], image->width, color, new_color);
+	unlock_image(image, lock);
 	return true;
 }
 
@@ -552,7 +782,7 @@ rescale_image(image_t* image, int width, int height)
 
 	if (width == image->width && height == image->height)
 		return true;
-	if (!(new_bitmap = al_create_bitmap(width, height)))
+	if (!(new_bitmap = create_bitmap_like(image, width, height)))
 		return false;
 	uncache_pixels(image);
 	old_target = al_get_target_bitmap();
@@ -565,6 +795,10 @@ rescale_image(image_t* image, int width, int height)
 	image->bitmap = new_bitmap;
 	image->width = al_get_bitmap_width(image->bitmap);
 	image->height = al_get_bitmap_height(image->bitmap);
+	if (image->upload != NULL)
+		al_destroy_bitmap(image->upload);
+	image->upload = NULL;
+	image->is_upload_stale = true;
 	return true;
 }
 
@@ -606,6 +840,101 @@ unlock_image(image_t* image, image_lock_t* lock)
 	free_image(image);
 }
 
+static void
+cache_image(const char* key, image_t* image)
+{
+	struct cache_entry  entry;
+	struct cache_entry* p_entry;
+
+	if (s_load_cache == NULL || key == NULL)
+		return;
+	entry.size = (size_t)image->width * image->height * sizeof(color_t);
+	if (entry.size > s_cache_budget)
+		return;
+	while (s_cache_size + entry.size > s_cache_budget && vector_len(s_load_cache) > 0) {
+		p_entry = vector_get(s_load_cache, 0);
+		console_log(3, "evicting image #%u from cache", p_entry->image->id);
+		s_cache_size -= p_entry->size;
+		free_image(p_entry->image);
+		free(p_entry->key);
+		vector_remove(s_load_cache, 0);
+		++s_num_cache_evictions;
+	}
+	if (!(entry.key = strdup(key)))
+		return;
+	entry.image = ref_image(image);
+	if (!vector_push(s_load_cache, &entry)) {
+		free_image(entry.image);
+		free(entry.key);
+		return;
+	}
+	s_cache_size += entry.size;
+}
+
+static ALLEGRO_BITMAP*
+create_bitmap_like(const image_t* image, int width, int height)
+{
+	// creates a bitmap of the same kind (video or software) as `image`.  software
+	// bitmaps use the same pixel format as lock_image() so locking them is free.
+
+	ALLEGRO_BITMAP* bitmap;
+	ALLEGRO_STATE   old_state;
+
+	if (!image->is_soft)
+		return al_create_bitmap(width, height);
+	al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+	bitmap = al_create_bitmap(width, height);
+	al_restore_state(&old_state);
+	return bitmap;
+}
+
+static image_t*
+find_cached_image(const char* key)
+{
+	// returns a new reference to the cached image for `key`, if there is one, and
+	// makes it the most recently used.  the cache is in LRU order with the most
+	// recently used image at the end.
+
+	struct cache_entry  entry;
+	struct cache_entry* p_entry;
+
+	iter_t iter;
+
+	if (s_load_cache == NULL || key == NULL)
+		return NULL;
+	iter = vector_enum(s_load_cache);
+	while (p_entry = vector_next(&iter)) {
+		if (strcmp(key, p_entry->key) != 0)
+			continue;
+		entry = *p_entry;
+		iter_remove(&iter);
+		vector_push(s_load_cache, &entry);
+		++s_num_cache_hits;
+		return ref_image(entry.image);
+	}
+	++s_num_cache_misses;
+	return NULL;
+}
+
+static image_lock_t*
+lock_bitmap(image_t* image)
+{
+	ALLEGRO_LOCKED_REGION* ll_lock;
+
+	if (image->lock_count == 0) {
+		if (!(ll_lock = al_lock_bitmap(image->bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READWRITE)))
+			return NULL;
+		ref_image(image);
+		image->lock.pixels = ll_lock->data;
+		image->lock.pitch = ll_lock->pitch / 4;
+		image->lock.num_lines = image->height;
+	}
+	++image->lock_count;
+	return &image->lock;
+}
+
 static void
 cache_pixels(image_t* image)
 {
@@ -616,7 +945,7 @@ cache_pixels(image_t* image)
 	int i;
 
 	free(image->pixel_cache); image->pixel_cache = NULL;
-	if (!(lock = lock_image(image)))
+	if (!(lock = lock_bitmap(image)))
 		goto on_error;
 	if (!(cache = malloc(image->width * image->height * 4)))
 		goto on_error;
@@ -636,6 +965,127 @@ on_error:
 		al_unlock_bitmap(image->bitmap);
 }
 
+static void
+decode_image_job(void* udata)
+{
+	// runs on a worker thread.  the image is decoded into a memory bitmap in the
+	// same format as a software image, since video bitmaps can only be created on
+	// the main thread.
+
+	ALLEGRO_FILE*    al_file;
+	struct load_job* job;
+
+	job = udata;
+	if (job->slurp == NULL)
+		return;  // already cached, nothing to decode
+	al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP | ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+	if ((al_file = al_open_memfile(job->slurp, job->file_size, "rb"))) {
+		job->bitmap = al_load_bitmap_f(al_file,
+			sniff_image_type(job->filename, job->slurp, job->file_size));
+		al_fclose(al_file);
+	}
+	free(job->slurp);
+	job->slurp = NULL;
+}
+
+static void
+finish_image_job(void* udata, bool is_cancelled)
+{
+	image_t*         image = NULL;
+	struct load_job* job;
+
+	job = udata;
+	if (is_cancelled)
+		goto finished;
+	if (job->image != NULL) {
+		console_log(2, "using cached image #%u for `%s`", job->image->id, job->filename);
+		image = job->image;
+		job->image = NULL;
+	}
+	else {
+		console_log(2, "loading image #%u as `%s` (async)", s_next_image_id, job->filename);
+		if (job->bitmap != NULL) {
+			image = calloc(1, sizeof(image_t));
+			if ((image->bitmap = al_clone_bitmap(job->bitmap))) {
+				image->id = s_next_image_id++;
+				image->width = al_get_bitmap_width(image->bitmap);
+				image->height = al_get_bitmap_height(image->bitmap);
+				ref_image(image);
+				cache_image(job->cache_key, image);
+			}
+			else {
+				free(image);
+				image = NULL;
+			}
+		}
+		if (image == NULL)
+			console_log(2, "    failed to load image #%u", s_next_image_id++);
+	}
+	job->callback(image, job->udata);
+
+finished:
+	if (job->bitmap != NULL)
+		al_destroy_bitmap(job->bitmap);
+	free_image(job->image);
+	free(job->slurp);
+	free(job->filename);
+	free(job->cache_key);
+	free(job);
+}
+
+static void
+on_js_image_loaded(image_t* image, void* udata)
+{
+	unsigned int id;
+	bool         is_surface;
+	image_t*     surface_image;
+
+	// the stash entry is [callback, is_surface], see duk_load_image_async()
+	id = (unsigned int)(uintptr_t)udata;
+	duk_push_global_stash(g_duk);
+	duk_get_prop_string(g_duk, -1, "async_images");
+	duk_get_prop_index(g_duk, -1, id);
+	duk_del_prop_index(g_duk, -2, id);
+	duk_get_prop_index(g_duk, -1, 1);
+	is_surface = duk_get_boolean(g_duk, -1);
+	duk_pop(g_duk);
+	duk_get_prop_index(g_duk, -1, 0);
+	if (image == NULL)
+		duk_push_null(g_duk);
+	else if (is_surface) {
+		// the image may be shared with the cache, so the Surface gets a copy
+		surface_image = clone_image(image);
+		free_image(image);
+		if (surface_image != NULL)
+			duk_push_sphere_obj(g_duk, "Surface", surface_image);
+		else
+			duk_push_null(g_duk);
+	}
+	else {
+		duk_push_sphere_image(g_duk, image);
+		free_image(image);
+	}
+	duk_call(g_duk, 1);
+	duk_pop_n(g_duk, 4);
+}
+
+static const char*
+sniff_image_type(const char* filename, const void* data, size_t size)
+{
+	// look at the first few bytes of the file to determine its actual type.
+	// Allegro won't load it if the content doesn't match the file extension, so
+	// we have to inspect the file ourselves.
+
+	if (size >= 2 && memcmp(data, "BM", 2) == 0)
+		return ".bmp";
+	if (size >= 8 && memcmp(data, "\211PNG\r\n\032\n", 8) == 0)
+		return ".png";
+	if (size >= 2 && memcmp(data, "\xFF\xD8", 2) == 0)
+		return ".jpg";
+	return strrchr(filename, '.');
+}
+
 static void
 uncache_pixels(image_t* image)
 {
@@ -646,6 +1096,37 @@ uncache_pixels(image_t* image)
 	image->pixel_cache = NULL;
 }
 
+static bool
+upload_image(image_t* image)
+{
+	ALLEGRO_LOCKED_REGION* ll_lock;
+	image_lock_t*          lock;
+	uint8_t*               pdest;
+
+	int i_y;
+
+	if (image->upload != NULL && !image->is_upload_stale)
+		return true;
+	if (image->upload == NULL) {
+		if (!(image->upload = al_create_bitmap(image->width, image->height)))
+			return false;
+	}
+	console_log(4, "uploading software image #%u", image->id);
+	if (!(lock = lock_bitmap(image)))
+		return false;
+	if (!(ll_lock = al_lock_bitmap(image->upload, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY))) {
+		unlock_image(image, lock);
+		return false;
+	}
+	pdest = ll_lock->data;
+	for (i_y = 0; i_y < image->height; ++i_y)
+		memcpy(pdest + i_y * ll_lock->pitch, lock->pixels + i_y * lock->pitch, image->width * 4);
+	al_unlock_bitmap(image->upload);
+	unlock_image(image, lock);
+	image->is_upload_stale = false;
+	return true;
+}
+
 void
 init_image_api(duk_context* ctx)
 {
@@ -661,11 +1142,18 @@ init_image_api(duk_context* ctx)
 		s_sys_dn_arrow = load_image(systempath(filename));
 	}
 	
+	// callbacks for LoadImageAsync() and friends are kept in the stash until
+	// the image is ready
+	duk_push_global_stash(ctx);
+	duk_push_object(ctx); duk_put_prop_string(ctx, -2, "async_images");
+	duk_pop(ctx);
+
 	// register image API functions
 	api_register_method(ctx, NULL, "GetSystemArrow", js_GetSystemArrow);
 	api_register_method(ctx, NULL, "GetSystemDownArrow", js_GetSystemDownArrow);
 	api_register_method(ctx, NULL, "GetSystemUpArrow", js_GetSystemUpArrow);
 	api_register_method(ctx, NULL, "LoadImage", js_LoadImage);
+	api_register_method(ctx, NULL, "LoadImageAsync", js_LoadImageAsync);
 	api_register_method(ctx, NULL, "GrabImage", js_GrabImage);
 
 	// register Image properties and methods
@@ -690,6 +1178,31 @@ duk_push_sphere_image(duk_context* ctx, image_t* image)
 	duk_push_sphere_obj(ctx, "Image", ref_image(image));
 }
 
+void
+duk_load_image_async(duk_context* ctx, const char* filename, duk_idx_t callback_index, bool as_surface)
+{
+	// loads an image in the background and calls the JS function at
+	// `callback_index` with it once it's ready, as either an Image or a Surface.
+	// throws if the file can't be read.
+
+	unsigned int id;
+
+	callback_index = duk_require_normalize_index(ctx, callback_index);
+	duk_require_function(ctx, callback_index);
+	id = s_next_async_id++;
+	duk_push_global_stash(ctx);
+	duk_get_prop_string(ctx, -1, "async_images");
+	duk_push_array(ctx);
+	duk_dup(ctx, callback_index); duk_put_prop_index(ctx, -2, 0);
+	duk_push_boolean(ctx, as_surface); duk_put_prop_index(ctx, -2, 1);
+	duk_put_prop_index(ctx, -2, id);
+	if (!load_image_async(filename, on_js_image_loaded, (void*)(uintptr_t)id)) {
+		duk_del_prop_index(ctx, -1, id);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "unable to load image file `%s`", filename);
+	}
+	duk_pop_2(ctx);
+}
+
 image_t*
 duk_require_sphere_image(duk_context* ctx, duk_idx_t index)
 {
@@ -742,6 +1255,23 @@ js_LoadImage(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_LoadImageAsync(duk_context* ctx)
+{
+	// LoadImageAsync(filename, callback);
+	// Loads an image file in the background and calls `callback` with the new
+	// Image object, or null if the file couldn't be decoded, once it's ready.
+	// Arguments:
+	//     filename: The name of the image file, relative to ~sgm/images.
+	//     callback: A function to call with the Image.
+
+	const char* filename;
+
+	filename = duk_require_path(ctx, 0, "images", true);
+	duk_load_image_async(ctx, filename, 1, false);
+	return 0;
+}
+
 static duk_ret_t
 js_GrabImage(duk_context* ctx)
 {
@@ -808,7 +1338,13 @@ js_new_Image(duk_context* ctx)
 	else if (duk_is_sphere_obj(ctx, 0, "Surface")) {
 		// create an Image from a Surface
 		src_image = duk_require_sphere_obj(ctx, 0, "Surface");
-		if (!(image = clone_image(src_image)))
+		if (is_image_soft(src_image)) {
+			if ((image = create_image(src_image->width, src_image->height)) != NULL)
+				blit_image(src_image, image, 0, 0);
+		}
+		else
+			image = clone_image(src_image);
+		if (image == NULL)
 			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Image(): unable to create image from surface");
 	}
 	else {
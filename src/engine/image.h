@@ -3,6 +3,8 @@
 
 typedef struct image image_t;
 
+typedef void (* image_load_cb_t)(image_t* image, void* udata);
+
 typedef
 struct image_lock
 {
@@ -11,19 +13,29 @@ struct image_lock
 	int       num_lines;
 } image_lock_t;
 
+void            initialize_images        (void);
+void            shutdown_images          (void);
 image_t*        create_image             (int width, int height);
+image_t*        create_soft_image        (int width, int height);
 image_t*        create_subimage          (image_t* parent, int x, int y, int width, int height);
 image_t*        clone_image              (const image_t* image);
 image_t*        load_image               (const char* filename);
+bool            load_image_async         (const char* filename, image_load_cb_t callback, void* udata);
 image_t*        read_image               (sfs_file_t* file, int width, int height);
 image_t*        read_subimage            (sfs_file_t* file, image_t* parent, int x, int y, int width, int height);
 image_t*        ref_image                (image_t* image);
 void            free_image               (image_t* image);
 ALLEGRO_BITMAP* get_image_bitmap         (image_t* image);
+void            get_image_bind_counts    (int* out_num_binds, int* out_num_switches);
 int             get_image_height         (const image_t* image);
+unsigned int    get_image_refcount       (const image_t* image);
+ALLEGRO_BITMAP* get_image_target         (image_t* image);
 color_t         get_image_pixel          (image_t* image, int x, int y);
+bool            get_image_pixels         (image_t* image, int x, int y, int width, int height, color_t* buffer);
 int             get_image_width          (const image_t* image);
+bool            is_image_soft            (const image_t* image);
 void            set_image_pixel          (image_t* image, int x, int y, color_t color);
+bool            set_image_pixels         (image_t* image, int x, int y, int width, int height, const color_t* buffer);
 bool            apply_color_matrix       (image_t* image, colormatrix_t matrix, int x, int y, int width, int height);
 bool            apply_color_matrix_4     (image_t* image, colormatrix_t ul_mat, colormatrix_t ur_mat, colormatrix_t ll_mat, colormatrix_t lr_mat, int x, int y, int width, int height);
 bool            apply_image_lookup       (image_t* image, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256]);
@@ -44,6 +56,7 @@ void            unlock_image             (image_t* image, image_lock_t* lock);
 
 void init_image_api (duk_context* ctx);
 
+void     duk_load_image_async     (duk_context* ctx, const char* filename, duk_idx_t callback_index, bool as_surface);
 void     duk_push_sphere_image    (duk_context* ctx, image_t* image);
 image_t* duk_require_sphere_image (duk_context* ctx, duk_idx_t index);
 
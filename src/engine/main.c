@@ -1,16 +1,25 @@
 #include "minisphere.h"
 #include "api.h"
 #include "async.h"
+#include "atlas.h"
 #include "audialis.h"
 #include "debugger.h"
 #include "galileo.h"
 #include "input.h"
 #include "map_engine.h"
+#include "profiler.h"
 #include "rng.h"
 #include "spriteset.h"
 
 #include <libmng.h>
 
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 // enable Windows visual styles (MSVC)
 #ifdef _MSC_VER
 #pragma comment(linker, \
@@ -22,14 +31,15 @@
     "language='*'\"")
 #endif
 
-static bool initialize_engine   (void);
-static void shutdown_engine     (void);
-static bool find_startup_game   (path_t* *out_path);
-static bool parse_command_line  (int argc, char* argv[], path_t* *out_game_path, bool *out_want_fullscreen, int *out_fullscreen, int *out_verbosity, bool *out_want_throttle, bool *out_want_debug);
-static void print_banner        (bool want_copyright, bool want_deps);
-static void print_usage         (void);
-static void report_error        (const char* fmt, ...);
-static bool verify_requirements (sandbox_t* fs);
+static bool  initialize_engine   (void);
+static void  shutdown_engine     (bool is_final);
+static bool  find_startup_game   (path_t* *out_path);
+static FILE* open_capture_file   (const char* filename);
+static bool  parse_command_line  (int argc, char* argv[], path_t* *out_game_path, bool *out_want_fullscreen, int *out_fullscreen, int *out_verbosity, bool *out_want_throttle, bool *out_want_debug, const char* *out_capture_path, const char* *out_profile_path);
+static void  print_banner        (bool want_copyright, bool want_deps);
+static void  print_usage         (void);
+static void  report_error        (const char* fmt, ...);
+static bool  verify_requirements (sandbox_t* fs);
 
 static void on_duk_fatal (duk_context* ctx, duk_errcode_t code, const char* msg);
 
@@ -44,6 +54,7 @@ kevfile_t*           g_sys_conf;
 font_t*              g_sys_font = NULL;
 int                  g_res_x, g_res_y;
 
+static FILE*   s_capture_file = NULL;
 static jmp_buf s_jmp_exit;
 static jmp_buf s_jmp_restart;
 
@@ -70,6 +81,7 @@ main(int argc, char* argv[])
 	// something of a hairball over time, and likely quite fragile.  don't be surprised if
 	// attempting to edit it causes something to break. :o)
 
+	const char*          capture_path;
 	path_t*              games_path;
 	lstring_t*           dialog_name;
 	duk_errcode_t        err_code;
@@ -78,6 +90,7 @@ main(int argc, char* argv[])
 	const char*          filename;
 	image_t*             icon;
 	int                  line_num;
+	const char*          profile_path;
 	const path_t*        script_path;
 	bool                 use_conserve_cpu;
 	int                  use_frameskip;
@@ -87,13 +100,20 @@ main(int argc, char* argv[])
 
 	// parse the command line
 	if (parse_command_line(argc, argv, &g_game_path,
-		&use_fullscreen, &use_frameskip, &use_verbosity, &use_conserve_cpu, &want_debug))
+		&use_fullscreen, &use_frameskip, &use_verbosity, &use_conserve_cpu, &want_debug,
+		&capture_path, &profile_path))
 	{
 		initialize_console(use_verbosity);
 	}
 	else
 		return EXIT_FAILURE;
 
+	// open the capture stream now, before anything else is written to stdout
+	if (capture_path != NULL && !(s_capture_file = open_capture_file(capture_path))) {
+		report_error("unable to open `%s` for frame capture\n", capture_path);
+		return EXIT_FAILURE;
+	}
+
 	print_banner(true, false);
 	printf("\n");
 
@@ -106,16 +126,22 @@ main(int argc, char* argv[])
 	console_log(1, "    console verbosity: V%d", use_verbosity);
 #if defined(MINISPHERE_SPHERUN)
 	console_log(1, "    debugger mode: %s", want_debug ? "active" : "passive");
+	console_log(1, "    frame capture: %s", capture_path != NULL ? capture_path : "off");
+	console_log(1, "    JS profiler: %s", profile_path != NULL ? profile_path : "off");
 #endif
 	console_log(1, "");
 
 	if (!initialize_engine())
 		return EXIT_FAILURE;
+#if defined(MINISPHERE_SPHERUN)
+	if (profile_path != NULL)
+		start_profiler(profile_path);
+#endif
 
 	// set up jump points for script bailout
 	console_log(1, "setting up jump points for longjmp");
 	if (setjmp(s_jmp_exit)) {  // user closed window, script called Exit(), etc.
-		shutdown_engine();
+		shutdown_engine(g_last_game_path == NULL);
 		if (g_last_game_path != NULL) {  // returning from ExecuteGame()?
 			initialize_engine();
 			g_game_path = g_last_game_path;
@@ -126,7 +152,7 @@ main(int argc, char* argv[])
 		}
 	}
 	if (setjmp(s_jmp_restart)) {  // script called RestartGame() or ExecuteGame()
-		shutdown_engine();
+		shutdown_engine(false);
 		console_log(1, "\nrestarting to launch new game");
 		console_log(1, "    path: %s", path_cstr(g_game_path));
 		initialize_engine();
@@ -194,6 +220,11 @@ main(int argc, char* argv[])
 			NULL, ALLEGRO_MESSAGEBOX_ERROR);
 		return EXIT_FAILURE;
 	}
+	if (s_capture_file != NULL && !screen_start_capture(g_screen, s_capture_file)) {
+		report_error("unable to start frame capture\n");
+		shutdown_engine(true);
+		return EXIT_FAILURE;
+	}
 	
 	al_set_new_bitmap_flags(ALLEGRO_NO_PREMULTIPLIED_ALPHA);
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
@@ -411,7 +442,7 @@ on_duk_fatal(duk_context* ctx, duk_errcode_t code, const char* msg)
 		}
 	}
 	free_wraptext(error_info);
-	shutdown_engine();
+	shutdown_engine(true);
 	exit(EXIT_SUCCESS);
 
 show_error_box:
@@ -419,7 +450,7 @@ show_error_box:
 	al_show_native_message_box(NULL, "Script Error",
 		"minisphere encountered an error during game execution.",
 		msg, NULL, ALLEGRO_MESSAGEBOX_ERROR);
-	shutdown_engine();
+	shutdown_engine(true);
 	exit(EXIT_SUCCESS);
 }
 
@@ -460,6 +491,8 @@ initialize_engine(void)
 
 	// initialize engine components
 	initialize_async();
+	initialize_images();
+	initialize_atlases();
 	initialize_rng();
 	initialize_galileo();
 	initialize_audialis();
@@ -471,6 +504,10 @@ initialize_engine(void)
 	// register the Sphere API
 	initialize_api(g_duk);
 
+#if defined(MINISPHERE_SPHERUN)
+	initialize_profiler();
+#endif
+
 	return true;
 
 on_error:
@@ -481,12 +518,13 @@ on_error:
 }
 
 static void
-shutdown_engine(void)
+shutdown_engine(bool is_final)
 {
 	save_key_map();
 
 #if defined(MINISPHERE_SPHERUN)
 	shutdown_debugger();
+	shutdown_profiler(is_final);
 #endif
 
 	shutdown_map_engine();
@@ -500,6 +538,8 @@ shutdown_engine(void)
 	dyad_shutdown();
 
 	shutdown_spritesets();
+	shutdown_atlases();
+	shutdown_images();
 	shutdown_audialis();
 	shutdown_galileo();
 	shutdown_async();
@@ -516,6 +556,13 @@ shutdown_engine(void)
 		kev_close(g_sys_conf);
 	g_sys_conf = NULL;
 	al_uninstall_system();
+
+	// the capture stream stays open across a restart, so frames from the new
+	// game are appended to it.  screen_free() has already flushed it.
+	if (is_final && s_capture_file != NULL) {
+		fclose(s_capture_file);
+		s_capture_file = NULL;
+	}
 }
 
 static bool
@@ -567,11 +614,37 @@ find_startup_game(path_t* *out_path)
 	return false;
 }
 
+static FILE*
+open_capture_file(const char* filename)
+{
+	// capturing to stdout ("-") hijacks the real stdout for frame data and
+	// points fd 1 at stderr, so log output and Print() can't corrupt the stream.
+	
+	int fd;
+
+	if (strcmp(filename, "-") != 0)
+		return fopen(filename, "wb");
+	fflush(stdout);
+#if defined(_WIN32)
+	if ((fd = _dup(_fileno(stdout))) < 0)
+		return NULL;
+	_setmode(fd, _O_BINARY);
+	_dup2(_fileno(stderr), _fileno(stdout));
+	return _fdopen(fd, "wb");
+#else
+	if ((fd = dup(STDOUT_FILENO)) < 0)
+		return NULL;
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	return fdopen(fd, "wb");
+#endif
+}
+
 static bool
 parse_command_line(
 	int argc, char* argv[],
 	path_t* *out_game_path, bool *out_want_fullscreen, int *out_frameskip,
-	int *out_verbosity, bool *out_want_throttle, bool *out_want_debug)
+	int *out_verbosity, bool *out_want_throttle, bool *out_want_debug,
+	const char* *out_capture_path, const char* *out_profile_path)
 {
 	bool parse_options = true;
 
@@ -589,6 +662,8 @@ parse_command_line(
 	*out_verbosity = 0;
 	*out_want_throttle = true;
 	*out_want_debug = false;
+	*out_capture_path = NULL;
+	*out_profile_path = NULL;
 
 	// process command line arguments
 	for (i = 1; i < argc; ++i) {
@@ -620,6 +695,14 @@ parse_command_line(
 			else if (strcmp(argv[i], "--debug") == 0) {
 				*out_want_debug = true;
 			}
+			else if (strcmp(argv[i], "--capture") == 0) {
+				if (++i >= argc) goto missing_argument;
+				*out_capture_path = argv[i];
+			}
+			else if (strcmp(argv[i], "--profile") == 0) {
+				if (++i >= argc) goto missing_argument;
+				*out_profile_path = argv[i];
+			}
 			else if (strcmp(argv[i], "--verbose") == 0) {
 				if (++i >= argc) goto missing_argument;
 				*out_verbosity = atoi(argv[i]);
@@ -713,7 +796,7 @@ print_usage(void)
 	printf("\n");
 	printf("USAGE:\n");
 	printf("   spherun [--fullscreen | --window] [--frameskip <n>] [--no-sleep] [--debug] \n");
-	printf("           [--verbose <n>] <game_path>                                        \n");
+	printf("           [--capture <file>] [--profile <file>] [--verbose <n>] <game_path>  \n");
 	printf("\n");
 	printf("OPTIONS:\n");
 	printf("       --fullscreen   Start minisphere in fullscreen mode.                    \n");
@@ -721,6 +804,11 @@ print_usage(void)
 	printf("       --frameskip    Set the maximum number of consecutive frames to skip.   \n");
 	printf("       --no-sleep     Prevent the engine from sleeping between frames.        \n");
 	printf("   -d, --debug        Wait up to 30 seconds for the debugger to attach.       \n");
+	printf("       --capture      Stream every rendered frame as raw RGBA to a file.  Use \n");
+	printf("                      `-` to write the frames to stdout.                      \n");
+	printf("       --profile      Sample the JS call stack while the game runs and write  \n");
+	printf("                      the results to a file on exit, in the collapsed-stack   \n");
+	printf("                      format used by flamegraph.pl.                           \n");
 	printf("       --verbose      Set the engine's verbosity level from 0 to 4.  This can \n");
 	printf("                      be abbreviated as `-n`, where n is [0-4].               \n");
 	printf("       --version      Show which version of minisphere is installed.          \n");
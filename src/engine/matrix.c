@@ -1,6 +1,18 @@
 #include "minisphere.h"
 #include "matrix.h"
 
+// composing matrices and transforming points use SSE or NEON where available.
+// the products are added up in the same order Allegro adds them, so the
+// results are identical to al_compose_transform().
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATRIX_SSE
+#include <xmmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define MATRIX_NEON
+#include <arm_neon.h>
+#endif
+
 struct matrix
 {
 	unsigned int      refcount;
@@ -63,7 +75,7 @@ matrix_identity(matrix_t* matrix)
 void
 matrix_compose(matrix_t* matrix, const matrix_t* other)
 {
-	al_compose_transform(&matrix->transform, &other->transform);
+	compose_transform(&matrix->transform, &other->transform);
 }
 
 void
@@ -95,3 +107,116 @@ matrix_translate(matrix_t* matrix, float dx, float dy, float dz)
 	al_translate_transform(&matrix->transform, dx, dy);
 #endif
 }
+
+void
+compose_transform(ALLEGRO_TRANSFORM* transform, const ALLEGRO_TRANSFORM* other)
+{
+	// same as al_compose_transform(): `transform` is multiplied by `other`, so
+	// that `transform` is applied first.  each row of the result is the sum of
+	// the rows of `other` weighted by the same row of `transform`.
+
+#if defined(MATRIX_SSE)
+	__m128 row_0, row_1, row_2, row_3;
+	__m128 sum;
+
+	int i;
+
+	row_0 = _mm_loadu_ps(other->m[0]);
+	row_1 = _mm_loadu_ps(other->m[1]);
+	row_2 = _mm_loadu_ps(other->m[2]);
+	row_3 = _mm_loadu_ps(other->m[3]);
+	for (i = 0; i < 4; ++i) {
+		sum = _mm_mul_ps(_mm_set1_ps(transform->m[i][0]), row_0);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(transform->m[i][1]), row_1));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(transform->m[i][2]), row_2));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(transform->m[i][3]), row_3));
+		_mm_storeu_ps(transform->m[i], sum);
+	}
+#elif defined(MATRIX_NEON)
+	float32x4_t row_0, row_1, row_2, row_3;
+	float32x4_t sum;
+
+	int i;
+
+	row_0 = vld1q_f32(other->m[0]);
+	row_1 = vld1q_f32(other->m[1]);
+	row_2 = vld1q_f32(other->m[2]);
+	row_3 = vld1q_f32(other->m[3]);
+	for (i = 0; i < 4; ++i) {
+		sum = vmulq_n_f32(row_0, transform->m[i][0]);
+		sum = vaddq_f32(sum, vmulq_n_f32(row_1, transform->m[i][1]));
+		sum = vaddq_f32(sum, vmulq_n_f32(row_2, transform->m[i][2]));
+		sum = vaddq_f32(sum, vmulq_n_f32(row_3, transform->m[i][3]));
+		vst1q_f32(transform->m[i], sum);
+	}
+#else
+	al_compose_transform(transform, other);
+#endif
+}
+
+void
+transform_points(const ALLEGRO_TRANSFORM* transform, float* points, int count, size_t stride, int num_dims)
+{
+	// transforms `count` points in place.  each point is 2 or 3 floats (x, y and
+	// optionally z) and points are `stride` bytes apart, so this works on packed
+	// arrays as well as the position fields of vertex structs.  for 2D points, z
+	// is taken to be zero.
+
+	float* p;
+
+	int i;
+
+#if defined(MATRIX_SSE)
+	__m128 row_0, row_1, row_2, row_3;
+	__m128 sum;
+
+	row_0 = _mm_loadu_ps(transform->m[0]);
+	row_1 = _mm_loadu_ps(transform->m[1]);
+	row_2 = _mm_loadu_ps(transform->m[2]);
+	row_3 = _mm_loadu_ps(transform->m[3]);
+	for (i = 0; i < count; ++i) {
+		p = (float*)((uint8_t*)points + i * stride);
+		sum = _mm_mul_ps(_mm_set1_ps(p[0]), row_0);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(p[1]), row_1));
+		if (num_dims == 3)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(p[2]), row_2));
+		sum = _mm_add_ps(sum, row_3);
+		_mm_storel_pi((__m64*)p, sum);
+		if (num_dims == 3)
+			_mm_store_ss(&p[2], _mm_movehl_ps(sum, sum));
+	}
+#elif defined(MATRIX_NEON)
+	float32x4_t row_0, row_1, row_2, row_3;
+	float32x4_t sum;
+
+	row_0 = vld1q_f32(transform->m[0]);
+	row_1 = vld1q_f32(transform->m[1]);
+	row_2 = vld1q_f32(transform->m[2]);
+	row_3 = vld1q_f32(transform->m[3]);
+	for (i = 0; i < count; ++i) {
+		p = (float*)((uint8_t*)points + i * stride);
+		sum = vmulq_n_f32(row_0, p[0]);
+		sum = vaddq_f32(sum, vmulq_n_f32(row_1, p[1]));
+		if (num_dims == 3)
+			sum = vaddq_f32(sum, vmulq_n_f32(row_2, p[2]));
+		sum = vaddq_f32(sum, row_3);
+		vst1_f32(p, vget_low_f32(sum));
+		if (num_dims == 3)
+			vst1q_lane_f32(&p[2], sum, 2);
+	}
+#else
+	const float (*m)[4] = transform->m;
+	float x, y, z;
+
+	for (i = 0; i < count; ++i) {
+		p = (float*)((uint8_t*)points + i * stride);
+		x = p[0];
+		y = p[1];
+		z = num_dims == 3 ? p[2] : 0.0;
+		p[0] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+		p[1] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+		if (num_dims == 3)
+			p[2] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+	}
+#endif
+}
@@ -15,4 +15,7 @@ void                     matrix_rotate    (matrix_t* matrix, float theta, float
 void                     matrix_scale     (matrix_t* matrix, float sx, float sy, float sz);
 void                     matrix_translate (matrix_t* matrix, float dx, float dy, float dz);
 
+void compose_transform (ALLEGRO_TRANSFORM* transform, const ALLEGRO_TRANSFORM* other);
+void transform_points  (const ALLEGRO_TRANSFORM* transform, float* points, int count, size_t stride, int num_dims);
+
 #endif // MINISPHERE__MATRIX_H__INCLUDED
@@ -23,6 +23,7 @@ struct person
 	person_t*       leader;
 	color_t         mask;
 	int             mv_x, mv_y;
+	int             pose_index;
 	int             revert_delay;
 	int             revert_frames;
 	double          scale_x;
@@ -196,7 +197,7 @@ create_person(const char* name, spriteset_t* spriteset, bool is_persistent, scri
 	person->layer = map_origin.z;
 	person->speed_x = 1.0;
 	person->speed_y = 1.0;
-	person->anim_frames = get_sprite_frame_delay(person->sprite, person->direction, 0);
+	person->anim_frames = get_sprite_pose_delay(person->sprite, person->pose_index, 0);
 	person->mask = color_new(255, 255, 255, 255);
 	person->scale_x = person->scale_y = 1.0;
 	person->scripts[PERSON_SCRIPT_ON_CREATE] = create_script;
@@ -454,7 +455,8 @@ set_person_spriteset(person_t* person, spriteset_t* spriteset)
 	
 	old_spriteset = person->sprite;
 	person->sprite = ref_spriteset(spriteset);
-	person->anim_frames = get_sprite_frame_delay(person->sprite, person->direction, 0);
+	person->pose_index = get_sprite_pose_index(person->sprite, person->direction);
+	person->anim_frames = get_sprite_pose_delay(person->sprite, person->pose_index, 0);
 	person->frame = 0;
 	free_spriteset(old_spriteset);
 }
@@ -610,8 +612,8 @@ render_persons(int layer, bool is_flipped, int cam_x, int cam_y)
 		get_person_xy(person, &x, &y, true);
 		x -= cam_x - person->x_offset;
 		y -= cam_y - person->y_offset;
-		draw_sprite(sprite, person->mask, is_flipped, person->theta, person->scale_x, person->scale_y,
-			person->direction, x, y, person->frame);
+		draw_sprite_pose(sprite, person->mask, is_flipped, person->theta, person->scale_x, person->scale_y,
+			person->pose_index, x, y, person->frame);
 	}
 }
 
@@ -702,8 +704,14 @@ does_person_exist(const person_t* person)
 static void
 set_person_direction(person_t* person, const char* direction)
 {
+	// the pose is looked up here rather than on every draw, since the face
+	// commands are only queued occasionally but persons are rendered every frame
+
+	if (person->direction != NULL && strcmp(direction, person->direction) == 0)
+		return;
 	person->direction = realloc(person->direction, (strlen(direction) + 1) * sizeof(char));
 	strcpy(person->direction, direction);
+	person->pose_index = get_sprite_pose_index(person->sprite, direction);
 }
 
 static void
@@ -726,7 +734,7 @@ command_person(person_t* person, int command)
 		person->revert_frames = person->revert_delay;
 		if (person->anim_frames > 0 && --person->anim_frames == 0) {
 			++person->frame;
-			person->anim_frames = get_sprite_frame_delay(person->sprite, person->direction, person->frame);
+			person->anim_frames = get_sprite_pose_delay(person->sprite, person->pose_index, person->frame);
 		}
 		break;
 	case COMMAND_FACE_NORTH:
@@ -1286,7 +1294,7 @@ js_GetPersonData(duk_context* ctx)
 	spriteset = person->sprite;
 	get_sprite_size(spriteset, &width, &height);
 	get_spriteset_info(spriteset, NULL, &num_directions);
-	get_spriteset_pose_info(spriteset, person->direction, &num_frames);
+	num_frames = get_sprite_pose_frames(spriteset, person->pose_index);
 	duk_push_global_stash(ctx);
 	duk_get_prop_string(ctx, -1, "person_data");
 	duk_get_prop_string(ctx, -1, name);
@@ -1359,7 +1367,7 @@ js_GetPersonFrame(duk_context* ctx)
 
 	if ((person = find_person(name)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "GetPersonFrame(): no such person `%s`", name);
-	get_spriteset_pose_info(person->sprite, person->direction, &num_frames);
+	num_frames = get_sprite_pose_frames(person->sprite, person->pose_index);
 	duk_push_int(ctx, person->frame % num_frames);
 	return 1;
 }
@@ -1719,9 +1727,9 @@ js_SetPersonFrame(duk_context* ctx)
 
 	if ((person = find_person(name)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_REFERENCE_ERROR, "SetPersonFrame(): no such person `%s`", name);
-	get_spriteset_pose_info(person->sprite, person->direction, &num_frames);
+	num_frames = get_sprite_pose_frames(person->sprite, person->pose_index);
 	person->frame = (frame_index % num_frames + num_frames) % num_frames;
-	person->anim_frames = get_sprite_frame_delay(person->sprite, person->direction, person->frame);
+	person->anim_frames = get_sprite_pose_delay(person->sprite, person->pose_index, person->frame);
 	person->revert_frames = person->revert_delay;
 	return 0;
 }
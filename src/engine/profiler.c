@@ -0,0 +1,343 @@
+#include "minisphere.h"
+#include "profiler.h"
+
+// the profiler is driven by the exec timeout hook, which Duktape calls from its
+// executor interrupt (see duk_custom.h).  while it's running, the JS call stack
+// is recorded once every SAMPLE_INTERVAL instructions.  that's counted apart
+// from the interrupts themselves, as with SSJ attached Duktape interrupts after
+// every instruction.  samples are counted per unique stack and saved in the
+// collapsed format read by flamegraph.pl and speedscope: one line per stack,
+// outermost frame first, separated by semicolons and followed by the count.
+//
+// as samples are taken by instruction count rather than by the clock, time
+// spent inside a native call or waiting on the frame limiter isn't counted.
+
+#if defined(MINISPHERE_SPHERUN)
+
+#define MAX_SAMPLE_DEPTH 64
+#define SAMPLE_INTERVAL  (256L * 1024L)
+
+struct stack
+{
+	char*        frames;
+	uint64_t     hash;
+	unsigned int num_samples;
+};
+
+static duk_ret_t do_take_sample (duk_context* ctx);
+static void      append_frame   (duk_context* ctx, duk_idx_t index);
+static void      append_text    (const char* text);
+static void      clear_stacks   (void);
+static bool      grow_stacks    (void);
+static void      record_stack   (const char* frames, size_t length);
+
+static void*         s_act_ptr = NULL;
+static char*         s_buffer = NULL;
+static size_t        s_buffer_len = 0;
+static size_t        s_buffer_size = 0;
+static long          s_insn_count = 0;
+static bool          s_is_running = false;
+static int           s_num_samples = 0;
+static int           s_num_stacks = 0;
+static char*         s_out_path = NULL;
+static double        s_sample_time = 0.0;
+static size_t        s_table_size = 0;
+static struct stack* s_stacks = NULL;
+
+void
+initialize_profiler(void)
+{
+	console_log(1, "initializing JS profiler");
+
+	// Duktape.act is an ordinary property and a script is free to delete or
+	// replace it, so the function is saved in the global stash to keep the heap
+	// pointer valid.
+	duk_push_global_stash(g_duk);
+	duk_get_global_string(g_duk, "Duktape");
+	duk_get_prop_string(g_duk, -1, "act");
+	s_act_ptr = duk_is_function(g_duk, -1) ? duk_get_heapptr(g_duk, -1) : NULL;
+	duk_put_prop_string(g_duk, -3, "profiler_act");
+	duk_pop_2(g_duk);
+	if (s_act_ptr == NULL)
+		console_log(1, "    Duktape.act() not available, profiling disabled");
+}
+
+void
+shutdown_profiler(bool is_final)
+{
+	// samples are kept across a RestartGame(), so the profile written on the
+	// final shutdown covers the entire session.  they are only freed once the
+	// engine isn't coming back up.
+
+	console_log(1, "shutting down JS profiler");
+	if (s_num_samples > 0) {
+		console_log(2, "    %d samples over %d unique stacks", s_num_samples, s_num_stacks);
+		console_log(2, "    %.1f ms spent taking samples", s_sample_time * 1000.0);
+	}
+	if (s_out_path != NULL && s_num_samples > 0)
+		save_profile(s_out_path);
+	duk_push_global_stash(g_duk);
+	duk_del_prop_string(g_duk, -1, "profiler_act");
+	duk_pop(g_duk);
+	s_act_ptr = NULL;
+	if (is_final) {
+		clear_stacks();
+		free(s_buffer);
+		free(s_out_path);
+		s_buffer = NULL;
+		s_buffer_len = 0;
+		s_buffer_size = 0;
+		s_is_running = false;
+		s_out_path = NULL;
+	}
+}
+
+bool
+is_profiler_running(void)
+{
+	return s_is_running;
+}
+
+int
+get_profile_samples(void)
+{
+	return s_num_samples;
+}
+
+int
+get_profile_stacks(void)
+{
+	return s_num_stacks;
+}
+
+void
+start_profiler(const char* out_path)
+{
+	// starts a new profile, discarding any samples already taken.  if
+	// `out_path` isn't NULL, it replaces the file the profile is written to on
+	// shutdown.
+
+	clear_stacks();
+	if (out_path != NULL) {
+		free(s_out_path);
+		s_out_path = strdup(out_path);
+	}
+	s_is_running = true;
+	console_log(1, "JS profiler started");
+}
+
+void
+stop_profiler(void)
+{
+	if (!s_is_running)
+		return;
+	s_is_running = false;
+	console_log(1, "JS profiler stopped after %d samples", s_num_samples);
+}
+
+bool
+save_profile(const char* filename)
+{
+	FILE* file;
+
+	size_t i;
+
+	if (!(file = fopen(filename, "wb")))
+		return false;
+	for (i = 0; i < s_table_size; ++i) {
+		if (s_stacks[i].frames != NULL)
+			fprintf(file, "%s %u\n", s_stacks[i].frames, s_stacks[i].num_samples);
+	}
+	fclose(file);
+	console_log(1, "wrote %d profiler samples to `%s`", s_num_samples, filename);
+	return true;
+}
+
+int
+profiler_interrupt(void* thread, long num_instructions)
+{
+	// called by Duktape from the executor interrupt with the thread which was
+	// interrupted and the number of instructions run since the last interrupt.
+	// this must always return 0, otherwise Duktape would throw an execution
+	// timeout error.
+
+	duk_context* ctx = thread;
+	double       start_time;
+
+	if (!s_is_running || s_act_ptr == NULL)
+		return 0;
+	if ((s_insn_count += num_instructions) < SAMPLE_INTERVAL)
+		return 0;
+	s_insn_count = 0;
+	start_time = al_get_time();
+	if (duk_check_stack(ctx, 2)) {
+		duk_safe_call(ctx, do_take_sample, 0, 1);
+		duk_pop(ctx);
+	}
+	s_sample_time += al_get_time() - start_time;
+	return 0;
+}
+
+static duk_ret_t
+do_take_sample(duk_context* ctx)
+{
+	duk_idx_t base;
+	int       depth;
+
+	duk_idx_t i;
+
+	// walk the call stack using Duktape.act().  level -1 is the act() call
+	// itself, so the interrupted function is at level -2.  the entries come
+	// out innermost first and are pushed in that order.
+	base = duk_get_top(ctx);
+	duk_require_stack(ctx, MAX_SAMPLE_DEPTH + 2);
+	for (depth = 0; depth < MAX_SAMPLE_DEPTH; ++depth) {
+		duk_push_heapptr(ctx, s_act_ptr);
+		duk_push_int(ctx, -2 - depth);
+		duk_call(ctx, 1);
+		if (!duk_is_object(ctx, -1)) {
+			duk_pop(ctx);
+			break;
+		}
+	}
+	if (duk_get_top(ctx) == base)
+		return 0;
+
+	s_buffer_len = 0;
+	if (depth >= MAX_SAMPLE_DEPTH)
+		append_text("[truncated]");
+	for (i = duk_get_top(ctx) - 1; i >= base; --i)
+		append_frame(ctx, i);
+	record_stack(s_buffer, s_buffer_len);
+	return 0;
+}
+
+static void
+append_frame(duk_context* ctx, duk_idx_t index)
+{
+	const char* filename;
+	int         line_number;
+	const char* name;
+	char        text[512];
+
+	char* p;
+
+	duk_get_prop_string(ctx, index, "lineNumber");
+	line_number = duk_get_int(ctx, -1);
+	duk_get_prop_string(ctx, index, "function");
+	duk_get_prop_string(ctx, -1, "name");
+	name = duk_get_string(ctx, -1);
+	duk_get_prop_string(ctx, -2, "fileName");
+	filename = duk_get_string(ctx, -1);
+	if (name == NULL || name[0] == '\0')
+		name = "(anonymous)";
+	if (filename != NULL)
+		snprintf(text, sizeof text, "%s (%s:%d)", name, filename, line_number);
+	else
+		snprintf(text, sizeof text, "%s [native]", name);
+	text[sizeof text - 1] = '\0';
+	duk_pop_n(ctx, 4);
+
+	// semicolons separate frames and a newline ends the stack, so neither can
+	// appear in a frame name.
+	for (p = text; *p != '\0'; ++p) {
+		if (*p == ';' || *p == '\n' || *p == '\r')
+			*p = '_';
+	}
+	if (s_buffer_len > 0)
+		append_text(";");
+	append_text(text);
+}
+
+static void
+append_text(const char* text)
+{
+	size_t length;
+	char*  new_buffer;
+	size_t new_size;
+
+	length = strlen(text);
+	if (s_buffer_len + length + 1 > s_buffer_size) {
+		new_size = (s_buffer_len + length + 1) * 2;
+		if (!(new_buffer = realloc(s_buffer, new_size)))
+			return;
+		s_buffer = new_buffer;
+		s_buffer_size = new_size;
+	}
+	memcpy(s_buffer + s_buffer_len, text, length + 1);
+	s_buffer_len += length;
+}
+
+static void
+clear_stacks(void)
+{
+	size_t i;
+
+	for (i = 0; i < s_table_size; ++i)
+		free(s_stacks[i].frames);
+	free(s_stacks);
+	s_stacks = NULL;
+	s_table_size = 0;
+	s_num_stacks = 0;
+	s_insn_count = 0;
+	s_num_samples = 0;
+	s_sample_time = 0.0;
+}
+
+static bool
+grow_stacks(void)
+{
+	// the table uses open addressing with linear probing and is kept at most
+	// half full.
+
+	size_t        index;
+	size_t        new_size;
+	struct stack* new_stacks;
+
+	size_t i;
+
+	new_size = s_table_size > 0 ? s_table_size * 2 : 256;
+	if (!(new_stacks = calloc(new_size, sizeof(struct stack))))
+		return false;
+	for (i = 0; i < s_table_size; ++i) {
+		if (s_stacks[i].frames == NULL)
+			continue;
+		index = s_stacks[i].hash & (new_size - 1);
+		while (new_stacks[index].frames != NULL)
+			index = (index + 1) & (new_size - 1);
+		new_stacks[index] = s_stacks[i];
+	}
+	free(s_stacks);
+	s_stacks = new_stacks;
+	s_table_size = new_size;
+	return true;
+}
+
+static void
+record_stack(const char* frames, size_t length)
+{
+	uint64_t      hash;
+	size_t        index;
+	struct stack* p_stack;
+
+	if ((size_t)(s_num_stacks + 1) * 2 > s_table_size && !grow_stacks())
+		return;
+	hash = memhash(frames, length);
+	index = hash & (s_table_size - 1);
+	while ((p_stack = &s_stacks[index])->frames != NULL) {
+		if (p_stack->hash == hash && strcmp(p_stack->frames, frames) == 0) {
+			++p_stack->num_samples;
+			++s_num_samples;
+			return;
+		}
+		index = (index + 1) & (s_table_size - 1);
+	}
+	if (!(p_stack->frames = strdup(frames)))
+		return;
+	p_stack->hash = hash;
+	p_stack->num_samples = 1;
+	++s_num_stacks;
+	++s_num_samples;
+}
+
+#endif // MINISPHERE_SPHERUN
@@ -0,0 +1,13 @@
+#ifndef MINISPHERE__PROFILER_H__INCLUDED
+#define MINISPHERE__PROFILER_H__INCLUDED
+
+void initialize_profiler  (void);
+void shutdown_profiler    (bool is_final);
+bool is_profiler_running  (void);
+int  get_profile_samples  (void);
+int  get_profile_stacks   (void);
+void start_profiler       (const char* out_path);
+void stop_profiler        (void);
+bool save_profile         (const char* filename);
+
+#endif // MINISPHERE__PROFILER_H__INCLUDED
@@ -0,0 +1,354 @@
+#include "minisphere.h"
+#include "colorfx.h"
+#include "image.h"
+
+#include "raster.h"
+
+// Surfaces created in system memory (see create_soft_image()) are drawn by
+// software: everything goes directly into the locked pixels, one span at a
+// time, using the blend kernels in colorfx.c.  coordinates are integers and
+// every primitive is clipped to the image, so unlike Allegro's primitives
+// add-on, no pixel is ever blended twice by the same call.
+
+typedef
+struct target
+{
+	image_t*      image;
+	image_lock_t* lock;
+	int           width;
+	int           height;
+	blend_mode_t  mode;
+} target_t;
+
+static bool begin_target (target_t* target, image_t* image, blend_mode_t mode);
+static void end_target   (target_t* target);
+static void plot         (target_t* target, int x, int y, color_t color);
+static void fill_span    (target_t* target, int x1, int x2, int y, color_t color);
+static void blend_span   (target_t* target, int x1, int x2, int y, const color_t* colors);
+
+bool
+raster_blit(image_t* image, blend_mode_t mode, image_t* src_image, int x, int y, color_t mask)
+{
+	color_t* buffer = NULL;
+	bool     is_tinted;
+	int      src_x, src_y;
+	target_t target;
+	int      w, h;
+
+	int i_y;
+
+	if (!begin_target(&target, image, mode))
+		return false;
+
+	// clip the source area against the target.  the pixels are copied out first,
+	// which also takes care of a Surface being blitted onto itself.
+	src_x = x < 0 ? -x : 0;
+	src_y = y < 0 ? -y : 0;
+	w = fmin(get_image_width(src_image) - src_x, target.width - (x + src_x));
+	h = fmin(get_image_height(src_image) - src_y, target.height - (y + src_y));
+	if (w <= 0 || h <= 0)
+		goto finished;
+	if (!(buffer = malloc(w * h * sizeof(color_t))))
+		goto on_error;
+	if (!get_image_pixels(src_image, src_x, src_y, w, h, buffer))
+		goto on_error;
+	is_tinted = mask.r != 255 || mask.g != 255 || mask.b != 255 || mask.alpha != 255;
+	for (i_y = 0; i_y < h; ++i_y) {
+		if (is_tinted)
+			colorfx_tint_row(&buffer[i_y * w], w, mask);
+		blend_span(&target, x + src_x, x + src_x + w, y + src_y + i_y, &buffer[i_y * w]);
+	}
+
+finished:
+	free(buffer);
+	end_target(&target);
+	return true;
+
+on_error:
+	free(buffer);
+	end_target(&target);
+	return false;
+}
+
+bool
+raster_circle(image_t* image, blend_mode_t mode, int x, int y, int radius, color_t color)
+{
+	// midpoint circle.  the points on the axes and diagonals are shared between
+	// octants and are only plotted once.
+
+	int      error;
+	target_t target;
+	int      x_off, y_off;
+
+	if (radius < 0)
+		return true;
+	if (radius == 0)
+		return raster_point(image, mode, x, y, color);
+	if (!begin_target(&target, image, mode))
+		return false;
+	x_off = radius;
+	y_off = 0;
+	error = 1 - radius;
+	while (x_off >= y_off) {
+		plot(&target, x + x_off, y + y_off, color);
+		plot(&target, x - x_off, y - y_off, color);
+		if (y_off > 0) {
+			plot(&target, x + x_off, y - y_off, color);
+			plot(&target, x - x_off, y + y_off, color);
+		}
+		if (x_off != y_off) {
+			plot(&target, x + y_off, y + x_off, color);
+			plot(&target, x - y_off, y - x_off, color);
+			if (y_off > 0) {
+				plot(&target, x - y_off, y + x_off, color);
+				plot(&target, x + y_off, y - x_off, color);
+			}
+		}
+		++y_off;
+		if (error < 0)
+			error += 2 * y_off + 1;
+		else {
+			--x_off;
+			error += 2 * (y_off - x_off) + 1;
+		}
+	}
+	end_target(&target);
+	return true;
+}
+
+bool
+raster_fill_circle(image_t* image, blend_mode_t mode, int x, int y, int radius, color_t color)
+{
+	// a pixel is inside the circle if its center is
+
+	double   dx, dy;
+	target_t target;
+
+	int i_y;
+
+	if (!begin_target(&target, image, mode))
+		return false;
+	for (i_y = y - radius; i_y <= y + radius; ++i_y) {
+		dy = i_y + 0.5 - y;
+		if (fabs(dy) > radius)
+			continue;
+		dx = sqrt((double)radius * radius - dy * dy);
+		fill_span(&target, ceil(x - dx - 0.5), floor(x + dx - 0.5) + 1, i_y, color);
+	}
+	end_target(&target);
+	return true;
+}
+
+bool
+raster_gradient_circle(image_t* image, blend_mode_t mode, int x, int y, int radius, color_t in_color, color_t out_color)
+{
+	double   distance;
+	double   dx, dy;
+	color_t* row = NULL;
+	target_t target;
+	int      x1, x2;
+
+	int i_x, i_y;
+
+	if (radius <= 0)
+		return true;
+	if (!begin_target(&target, image, mode))
+		return false;
+	if (!(row = malloc((2 * radius + 1) * sizeof(color_t))))
+		goto on_error;
+	for (i_y = y - radius; i_y <= y + radius; ++i_y) {
+		dy = i_y + 0.5 - y;
+		if (fabs(dy) > radius)
+			continue;
+		dx = sqrt((double)radius * radius - dy * dy);
+		x1 = ceil(x - dx - 0.5);
+		x2 = floor(x + dx - 0.5) + 1;
+		for (i_x = x1; i_x < x2; ++i_x) {
+			distance = fmin(hypot(i_x + 0.5 - x, dy) / radius, 1.0);
+			row[i_x - x1] = color_lerp(in_color, out_color, 1.0 - distance, distance);
+		}
+		blend_span(&target, x1, x2, i_y, row);
+	}
+	free(row);
+	end_target(&target);
+	return true;
+
+on_error:
+	end_target(&target);
+	return false;
+}
+
+bool
+raster_gradient_rect(image_t* image, blend_mode_t mode, int x, int y, int width, int height, color_t color_ul, color_t color_ur, color_t color_ll, color_t color_lr)
+{
+	// the colors are interpolated bilinearly from corner to corner, which is what
+	// Sphere 1.x did.  the hardware path draws two Gouraud-shaded triangles
+	// instead, so the middle of the rectangle can differ slightly.
+
+	color_t  left, right;
+	color_t* row = NULL;
+	target_t target;
+	int      x_span, y_span;
+
+	int i_x, i_y;
+
+	if (width <= 0 || height <= 0)
+		return true;
+	if (!begin_target(&target, image, mode))
+		return false;
+	if (!(row = malloc(width * sizeof(color_t))))
+		goto on_error;
+	x_span = width > 1 ? width - 1 : 1;
+	y_span = height > 1 ? height - 1 : 1;
+	for (i_y = 0; i_y < height; ++i_y) {
+		if (y + i_y < 0 || y + i_y >= target.height)
+			continue;
+		left = color_lerp(color_ul, color_ll, y_span - i_y, i_y);
+		right = color_lerp(color_ur, color_lr, y_span - i_y, i_y);
+		for (i_x = 0; i_x < width; ++i_x)
+			row[i_x] = color_lerp(left, right, x_span - i_x, i_x);
+		blend_span(&target, x, x + width, y + i_y, row);
+	}
+	free(row);
+	end_target(&target);
+	return true;
+
+on_error:
+	end_target(&target);
+	return false;
+}
+
+bool
+raster_line(image_t* image, blend_mode_t mode, int x1, int y1, int x2, int y2, color_t color)
+{
+	// Bresenham's line algorithm, both endpoints included
+
+	int      dx, dy;
+	int      error, error_2;
+	int      step_x, step_y;
+	target_t target;
+
+	if (!begin_target(&target, image, mode))
+		return false;
+	dx = abs(x2 - x1);
+	dy = -abs(y2 - y1);
+	step_x = x1 < x2 ? 1 : -1;
+	step_y = y1 < y2 ? 1 : -1;
+	error = dx + dy;
+	for (;;) {
+		plot(&target, x1, y1, color);
+		if (x1 == x2 && y1 == y2)
+			break;
+		error_2 = 2 * error;
+		if (error_2 >= dy) {
+			error += dy;
+			x1 += step_x;
+		}
+		if (error_2 <= dx) {
+			error += dx;
+			y1 += step_y;
+		}
+	}
+	end_target(&target);
+	return true;
+}
+
+bool
+raster_outline_rect(image_t* image, blend_mode_t mode, int x, int y, int width, int height, int thickness, color_t color)
+{
+	// the four edges are drawn as separate rectangles which don't overlap, so
+	// the corners aren't blended twice.
+
+	if (thickness <= 0)
+		return true;
+	if (thickness * 2 >= width || thickness * 2 >= height)
+		return raster_rect(image, mode, x, y, width, height, color);
+	return raster_rect(image, mode, x, y, width, thickness, color)
+		&& raster_rect(image, mode, x, y + height - thickness, width, thickness, color)
+		&& raster_rect(image, mode, x, y + thickness, thickness, height - thickness * 2, color)
+		&& raster_rect(image, mode, x + width - thickness, y + thickness, thickness, height - thickness * 2, color);
+}
+
+bool
+raster_point(image_t* image, blend_mode_t mode, int x, int y, color_t color)
+{
+	target_t target;
+
+	if (!begin_target(&target, image, mode))
+		return false;
+	plot(&target, x, y, color);
+	end_target(&target);
+	return true;
+}
+
+bool
+raster_rect(image_t* image, blend_mode_t mode, int x, int y, int width, int height, color_t color)
+{
+	target_t target;
+
+	int i_y;
+
+	if (!begin_target(&target, image, mode))
+		return false;
+	for (i_y = y; i_y < y + height; ++i_y)
+		fill_span(&target, x, x + width, i_y, color);
+	end_target(&target);
+	return true;
+}
+
+static bool
+begin_target(target_t* target, image_t* image, blend_mode_t mode)
+{
+	if (!(target->lock = lock_image(image)))
+		return false;
+	target->image = image;
+	target->width = get_image_width(image);
+	target->height = get_image_height(image);
+	target->mode = mode;
+	return true;
+}
+
+static void
+end_target(target_t* target)
+{
+	unlock_image(target->image, target->lock);
+}
+
+static void
+plot(target_t* target, int x, int y, color_t color)
+{
+	if (x < 0 || y < 0 || x >= target->width || y >= target->height)
+		return;
+	colorfx_fill_row(&target->lock->pixels[x + y * target->lock->pitch], 1, color, target->mode);
+}
+
+static void
+fill_span(target_t* target, int x1, int x2, int y, color_t color)
+{
+	// fills [x1,x2) on row y
+
+	if (y < 0 || y >= target->height)
+		return;
+	x1 = x1 < 0 ? 0 : x1;
+	x2 = x2 > target->width ? target->width : x2;
+	if (x1 >= x2)
+		return;
+	colorfx_fill_row(&target->lock->pixels[x1 + y * target->lock->pitch], x2 - x1, color, target->mode);
+}
+
+static void
+blend_span(target_t* target, int x1, int x2, int y, const color_t* colors)
+{
+	// blends colors[0..x2-x1) onto [x1,x2) on row y
+
+	int start;
+
+	if (y < 0 || y >= target->height)
+		return;
+	start = x1 < 0 ? -x1 : 0;
+	x1 += start;
+	x2 = x2 > target->width ? target->width : x2;
+	if (x1 >= x2)
+		return;
+	colorfx_blend_row(&target->lock->pixels[x1 + y * target->lock->pitch], &colors[start], x2 - x1, target->mode);
+}
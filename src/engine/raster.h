@@ -0,0 +1,18 @@
+#ifndef MINISPHERE__RASTER_H__INCLUDED
+#define MINISPHERE__RASTER_H__INCLUDED
+
+#include "color.h"
+#include "image.h"
+#include "surface.h"
+
+bool raster_blit            (image_t* image, blend_mode_t mode, image_t* src_image, int x, int y, color_t mask);
+bool raster_circle          (image_t* image, blend_mode_t mode, int x, int y, int radius, color_t color);
+bool raster_fill_circle     (image_t* image, blend_mode_t mode, int x, int y, int radius, color_t color);
+bool raster_gradient_circle (image_t* image, blend_mode_t mode, int x, int y, int radius, color_t in_color, color_t out_color);
+bool raster_gradient_rect   (image_t* image, blend_mode_t mode, int x, int y, int width, int height, color_t color_ul, color_t color_ur, color_t color_ll, color_t color_lr);
+bool raster_line            (image_t* image, blend_mode_t mode, int x1, int y1, int x2, int y2, color_t color);
+bool raster_outline_rect    (image_t* image, blend_mode_t mode, int x, int y, int width, int height, int thickness, color_t color);
+bool raster_point           (image_t* image, blend_mode_t mode, int x, int y, color_t color);
+bool raster_rect            (image_t* image, blend_mode_t mode, int x, int y, int width, int height, color_t color);
+
+#endif // MINISPHERE__RASTER_H__INCLUDED
@@ -26,6 +26,10 @@ static duk_ret_t js_Rectangle              (duk_context* ctx);
 static duk_ret_t js_RoundRectangle         (duk_context* ctx);
 static duk_ret_t js_Triangle               (duk_context* ctx);
 
+#define CAPTURE_RING_SIZE 8
+#define FRAME_SPIN_TIME   0.002
+#define FRAME_STATS_SIZE  256
+
 enum line_series_type
 {
 	LINE_MULTIPLE,
@@ -33,24 +37,54 @@ enum line_series_type
 	LINE_LOOP
 };
 
+struct capture
+{
+	ALLEGRO_COND*   cond;
+	FILE*           file;
+	size_t          frame_size;
+	uint8_t*        frames;
+	bool            have_pending;
+	bool            have_write_error;
+	int             height;
+	ALLEGRO_MUTEX*  mutex;
+	int             num_dropped;
+	int             num_queued;
+	int             num_written;
+	int             read_index;
+	ALLEGRO_BITMAP* staging[2];
+	int             stage_index;
+	bool            stopping;
+	ALLEGRO_THREAD* thread;
+	int             width;
+	int             write_index;
+};
+
 struct screen
 {
 	bool             avoid_sleep;
+	struct capture*  capture;
 	rect_t           clip_rect;
 	ALLEGRO_DISPLAY* display;
 	int              fps_flips;
 	int              fps_frames;
 	double           fps_poll_time;
+	double           frame_times[FRAME_STATS_SIZE];
 	bool             fullscreen;
 	bool             have_shaders;
+	bool             is_late[FRAME_STATS_SIZE];
+	int              num_binds[FRAME_STATS_SIZE];
+	int              num_switches[FRAME_STATS_SIZE];
 	double           last_flip_time;
+	double           last_frame_time;
 	int              max_skips;
 	double           next_frame_time;
 	int              num_flips;
 	int              num_frames;
 	int              num_skips;
+	int              num_stats;
 	bool             show_fps;
 	bool             skip_frame;
+	int              stats_index;
 	bool             take_screenshot;
 	bool             use_shaders;
 	int              x_offset;
@@ -61,7 +95,11 @@ struct screen
 	int              y_size;
 };
 
-static void refresh_display (screen_t* obj);
+static void  capture_frame   (screen_t* obj);
+static int   compare_times   (const void* a, const void* b);
+static void  queue_capture   (struct capture* capture, ALLEGRO_BITMAP* bitmap);
+static void  refresh_display (screen_t* obj);
+static void* run_capture     (ALLEGRO_THREAD* thread, void* arg);
 
 screen_t*
 screen_new(const char* title, image_t* icon, int x_size, int y_size, int frameskip, bool avoid_sleep)
@@ -122,6 +160,7 @@ screen_new(const char* title, image_t* icon, int x_size, int y_size, int framesk
 	obj->fps_poll_time = al_get_time() + 1.0;
 	obj->next_frame_time = al_get_time();
 	obj->last_flip_time = obj->next_frame_time;
+	obj->last_frame_time = obj->next_frame_time;
 
 #ifdef MINISPHERE_SPHERUN
 	obj->show_fps = true;
@@ -139,6 +178,7 @@ screen_free(screen_t* obj)
 		return;
 	
 	console_log(1, "shutting down render context");
+	screen_stop_capture(obj);
 	al_destroy_display(obj->display);
 	free(obj);
 }
@@ -173,6 +213,46 @@ screen_get_frameskip(const screen_t* obj)
 	return obj->max_skips;
 }
 
+frame_stats_t
+screen_get_frame_stats(const screen_t* obj)
+{
+	// all stats are calculated over the last FRAME_STATS_SIZE frames. a frame is
+	// counted as late if the game was still working on it when it was due.
+	
+	double        deviation;
+	double        sorted[FRAME_STATS_SIZE];
+	frame_stats_t stats;
+	double        total = 0.0;
+
+	int i;
+
+	memset(&stats, 0, sizeof(frame_stats_t));
+	if ((stats.num_frames = obj->num_stats) == 0)
+		return stats;
+	for (i = 0; i < obj->num_stats; ++i) {
+		sorted[i] = obj->frame_times[i];
+		total += obj->frame_times[i];
+		if (obj->is_late[i])
+			++stats.num_late;
+		stats.mean_binds += obj->num_binds[i];
+		stats.mean_switches += obj->num_switches[i];
+	}
+	stats.mean_binds /= obj->num_stats;
+	stats.mean_switches /= obj->num_stats;
+	qsort(sorted, obj->num_stats, sizeof(double), compare_times);
+	stats.min_time = sorted[0];
+	stats.max_time = sorted[obj->num_stats - 1];
+	stats.mean_time = total / obj->num_stats;
+	stats.p95_time = sorted[(int)ceil(obj->num_stats * 0.95) - 1];
+	stats.p99_time = sorted[(int)ceil(obj->num_stats * 0.99) - 1];
+	for (i = 0; i < obj->num_stats; ++i) {
+		deviation = obj->frame_times[i] - stats.mean_time;
+		stats.jitter += deviation * deviation;
+	}
+	stats.jitter = sqrt(stats.jitter / obj->num_stats);
+	return stats;
+}
+
 void
 screen_get_mouse_xy(const screen_t* obj, int* o_x, int* o_y)
 {
@@ -243,9 +323,11 @@ screen_flip(screen_t* obj, int framerate)
 {
 	char*             filename;
 	char              fps_text[20];
+	double            frame_time;
 	const char*       game_filename;
 	const path_t*     game_path;
 	bool              is_backbuffer_valid;
+	bool              is_late = false;
 	time_t            now;
 	ALLEGRO_STATE     old_state;
 	path_t*           path;
@@ -254,6 +336,8 @@ screen_flip(screen_t* obj, int framerate)
 	int               screen_cy;
 	int               serial = 1;
 	ALLEGRO_BITMAP*   snapshot;
+	frame_stats_t     stats;
+	char              stats_text[32];
 	double            time_left;
 	char              timestamp[100];
 	ALLEGRO_TRANSFORM trans;
@@ -274,6 +358,8 @@ screen_flip(screen_t* obj, int framerate)
 	screen_cx = al_get_display_width(obj->display);
 	screen_cy = al_get_display_height(obj->display);
 	if (is_backbuffer_valid) {
+		if (obj->capture != NULL)
+			capture_frame(obj);
 		if (obj->take_screenshot) {
 			al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
 			al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ANY_24_NO_ALPHA);
@@ -308,13 +394,17 @@ screen_flip(screen_t* obj, int framerate)
 				sprintf(fps_text, "%d/%d fps", obj->fps_flips, obj->fps_frames);
 			else
 				sprintf(fps_text, "%d fps", obj->fps_flips);
-			x = screen_cx - obj->x_offset - 108;
-			y = screen_cy - obj->y_offset - 24;
+			stats = screen_get_frame_stats(obj);
+			sprintf(stats_text, "p99 %.1fms, %d late", stats.p99_time * 1000.0, stats.num_late);
+			x = screen_cx - obj->x_offset - 128;
+			y = screen_cy - obj->y_offset - 36;
 			al_identity_transform(&trans);
 			al_use_transform(&trans);
-			al_draw_filled_rounded_rectangle(x, y, x + 100, y + 16, 4, 4, al_map_rgba(16, 16, 16, 192));
-			draw_text(g_sys_font, color_new(0, 0, 0, 255), x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
-			draw_text(g_sys_font, color_new(255, 255, 255, 255), x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+			al_draw_filled_rounded_rectangle(x, y, x + 120, y + 28, 4, 4, al_map_rgba(16, 16, 16, 192));
+			draw_text(g_sys_font, color_new(0, 0, 0, 255), x + 61, y + 3, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, color_new(255, 255, 255, 255), x + 60, y + 2, TEXT_ALIGN_CENTER, fps_text);
+			draw_text(g_sys_font, color_new(0, 0, 0, 255), x + 61, y + 15, TEXT_ALIGN_CENTER, stats_text);
+			draw_text(g_sys_font, color_new(255, 255, 255, 255), x + 60, y + 14, TEXT_ALIGN_CENTER, stats_text);
 			screen_transform(g_screen, NULL);
 		}
 		al_flip_display();
@@ -332,12 +422,18 @@ screen_flip(screen_t* obj, int framerate)
 	// that we lag instead of never rendering anything at all.
 	if (framerate > 0) {
 		obj->skip_frame = obj->num_skips < obj->max_skips && obj->last_flip_time > obj->next_frame_time;
-		do {  // kill time while we wait for the next frame
-			time_left = obj->next_frame_time - al_get_time();
-			if (!obj->avoid_sleep && time_left > 0.001)  // engine may stall with < 1ms timeout
-				al_wait_for_event_timed(g_events, NULL, time_left);
+		is_late = al_get_time() > obj->next_frame_time;
+		
+		// kill time while we wait for the next frame. timed waits routinely overshoot
+		// by a millisecond or more, so we only sleep until shortly before the deadline
+		// and spin for the remainder.
+		do_events();
+		while ((time_left = obj->next_frame_time - al_get_time()) > FRAME_SPIN_TIME) {
+			if (!obj->avoid_sleep)
+				al_wait_for_event_timed(g_events, NULL, time_left - FRAME_SPIN_TIME);
 			do_events();
-		} while (al_get_time() < obj->next_frame_time);
+		}
+		while (al_get_time() < obj->next_frame_time);
 		if (!is_backbuffer_valid && !obj->skip_frame)  // did we just finish skipping frames?
 			obj->next_frame_time = al_get_time() + 1.0 / framerate;
 		else
@@ -350,6 +446,17 @@ screen_flip(screen_t* obj, int framerate)
 		obj->next_frame_time = al_get_time();
 	}
 	++obj->num_frames;
+
+	// record frame time for pacing statistics
+	frame_time = al_get_time();
+	obj->frame_times[obj->stats_index] = frame_time - obj->last_frame_time;
+	obj->is_late[obj->stats_index] = is_late;
+	get_image_bind_counts(&obj->num_binds[obj->stats_index], &obj->num_switches[obj->stats_index]);
+	obj->stats_index = (obj->stats_index + 1) % FRAME_STATS_SIZE;
+	if (obj->num_stats < FRAME_STATS_SIZE)
+		++obj->num_stats;
+	obj->last_frame_time = frame_time;
+	
 	if (!obj->skip_frame) {
 		// disable clipping momentarily so we can clear the letterbox area.
 		// this prevents artifacts which manifest with some graphics drivers.
@@ -375,7 +482,7 @@ screen_grab(screen_t* obj, int x, int y, int width, int height)
 	if (!(image = create_image(scale_width, scale_height)))
 		goto on_error;
 	backbuffer = al_get_backbuffer(obj->display);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_bitmap_region(backbuffer, x, y, scale_width, scale_height, 0, 0, 0x0);
 	al_set_target_backbuffer(obj->display);
 	if (!rescale_image(image, width, height))
@@ -393,6 +500,107 @@ screen_queue_screenshot(screen_t* obj)
 	obj->take_screenshot = true;
 }
 
+bool
+screen_start_capture(screen_t* obj, FILE* file)
+{
+	// capture streams every flipped frame as raw 8-bit RGBA at the game's native
+	// resolution, with no header. the stream can be encoded offline, e.g.:
+	//     ffmpeg -f rawvideo -pix_fmt rgba -s WxH -r <fps> -i <file> out.mp4
+	// the caller retains ownership of the file; it is flushed but not closed when
+	// capture stops.
+	
+	struct capture* capture;
+	ALLEGRO_STATE   old_state;
+
+	if (obj->capture != NULL)
+		return false;
+
+	console_log(1, "starting frame capture at %dx%d", obj->x_size, obj->y_size);
+	if (!(capture = calloc(1, sizeof(struct capture))))
+		goto on_error;
+	capture->file = file;
+	capture->width = obj->x_size;
+	capture->height = obj->y_size;
+	capture->frame_size = (size_t)capture->width * capture->height * 4;
+	if (!(capture->frames = malloc(capture->frame_size * CAPTURE_RING_SIZE)))
+		goto on_error;
+
+	// two staging bitmaps let the readback for each frame be deferred until the
+	// following flip, so the GPU has a full frame to finish the copy before we
+	// lock it.
+	al_store_state(&old_state, ALLEGRO_STATE_NEW_BITMAP_PARAMETERS);
+	al_set_new_bitmap_flags(ALLEGRO_VIDEO_BITMAP | ALLEGRO_NO_PREMULTIPLIED_ALPHA);
+	al_set_new_bitmap_format(ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE);
+	capture->staging[0] = al_create_bitmap(capture->width, capture->height);
+	capture->staging[1] = al_create_bitmap(capture->width, capture->height);
+	al_restore_state(&old_state);
+	if (capture->staging[0] == NULL || capture->staging[1] == NULL)
+		goto on_error;
+
+	if (!(capture->mutex = al_create_mutex()))
+		goto on_error;
+	if (!(capture->cond = al_create_cond()))
+		goto on_error;
+	if (!(capture->thread = al_create_thread(run_capture, capture)))
+		goto on_error;
+	al_start_thread(capture->thread);
+	obj->capture = capture;
+	return true;
+
+on_error:
+	console_log(0, "unable to start frame capture");
+	if (capture != NULL) {
+		if (capture->staging[0] != NULL)
+			al_destroy_bitmap(capture->staging[0]);
+		if (capture->staging[1] != NULL)
+			al_destroy_bitmap(capture->staging[1]);
+		if (capture->mutex != NULL)
+			al_destroy_mutex(capture->mutex);
+		if (capture->cond != NULL)
+			al_destroy_cond(capture->cond);
+		free(capture->frames);
+		free(capture);
+	}
+	return false;
+}
+
+void
+screen_stop_capture(screen_t* obj)
+{
+	struct capture* capture;
+
+	if ((capture = obj->capture) == NULL)
+		return;
+
+	// queue the last frame still sitting in staging, then let the writer thread
+	// drain the ring before we tear everything down.
+	if (capture->have_pending)
+		queue_capture(capture, capture->staging[capture->stage_index ^ 1]);
+	al_lock_mutex(capture->mutex);
+	capture->stopping = true;
+	al_signal_cond(capture->cond);
+	al_unlock_mutex(capture->mutex);
+	al_join_thread(capture->thread, NULL);
+	al_destroy_thread(capture->thread);
+	fflush(capture->file);
+
+	console_log(1, "stopping frame capture");
+	console_log(1, "    frames written: %d", capture->num_written);
+	console_log(1, "    frames dropped: %d", capture->num_dropped);
+	if (capture->num_dropped > 0 || capture->have_write_error) {
+		fprintf(stderr, "WARNING: frame capture dropped %d frame(s)%s\n", capture->num_dropped,
+			capture->have_write_error ? " due to a write error" : "");
+	}
+	
+	al_destroy_bitmap(capture->staging[0]);
+	al_destroy_bitmap(capture->staging[1]);
+	al_destroy_cond(capture->cond);
+	al_destroy_mutex(capture->mutex);
+	free(capture->frames);
+	free(capture);
+	obj->capture = NULL;
+}
+
 void
 screen_resize(screen_t* obj, int x_size, int y_size)
 {
@@ -429,9 +637,10 @@ screen_transform(screen_t* obj, const matrix_t* matrix)
 {
 	ALLEGRO_TRANSFORM transform;
 	
-	al_identity_transform(&transform);
 	if (matrix != NULL)
-		al_compose_transform(&transform, matrix_transform(matrix));
+		al_copy_transform(&transform, matrix_transform(matrix));
+	else
+		al_identity_transform(&transform);
 	if (al_get_target_bitmap() == al_get_backbuffer(obj->display)) {
 		al_scale_transform(&transform, obj->x_scale, obj->y_scale);
 		al_translate_transform(&transform, obj->x_offset, obj->y_offset);
@@ -446,6 +655,99 @@ screen_unskip_frame(screen_t* obj)
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 }
 
+static void
+capture_frame(screen_t* obj)
+{
+	ALLEGRO_BITMAP*   backbuffer;
+	struct capture*   capture;
+	ALLEGRO_STATE     old_state;
+	ALLEGRO_TRANSFORM trans;
+
+	capture = obj->capture;
+	if (obj->x_size != capture->width || obj->y_size != capture->height) {
+		// raw frames have no header, so a mid-stream resolution change would
+		// garble everything after it.  drop the frame instead.
+		al_lock_mutex(capture->mutex);
+		++capture->num_dropped;
+		al_unlock_mutex(capture->mutex);
+		return;
+	}
+
+	// copy the game area of the backbuffer to staging at native resolution. this
+	// must happen before the FPS counter and other overlays are drawn.
+	backbuffer = al_get_backbuffer(obj->display);
+	al_store_state(&old_state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(capture->staging[capture->stage_index]);
+	al_identity_transform(&trans);
+	al_use_transform(&trans);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+	al_draw_scaled_bitmap(backbuffer, obj->x_offset, obj->y_offset,
+		obj->x_size * obj->x_scale, obj->y_size * obj->y_scale,
+		0, 0, capture->width, capture->height, 0x0);
+	al_restore_state(&old_state);
+
+	// read back the *previous* frame, which the GPU has had a full frame to finish.
+	if (capture->have_pending)
+		queue_capture(capture, capture->staging[capture->stage_index ^ 1]);
+	capture->have_pending = true;
+	capture->stage_index ^= 1;
+}
+
+static int
+compare_times(const void* a, const void* b)
+{
+	double t1 = *(const double*)a;
+	double t2 = *(const double*)b;
+
+	return t1 < t2 ? -1 : t1 > t2 ? 1 : 0;
+}
+
+static void
+queue_capture(struct capture* capture, ALLEGRO_BITMAP* bitmap)
+{
+	// if the writer thread can't keep up, the frame is dropped rather than
+	// stalling the game. the ring only needs the mutex for bookkeeping; the slot
+	// at write_index is never touched by the writer until num_queued says so.
+	
+	ALLEGRO_LOCKED_REGION* lock;
+	uint8_t*               p_dest;
+	const uint8_t*         p_src;
+	size_t                 row_size;
+
+	int y;
+
+	al_lock_mutex(capture->mutex);
+	if (capture->num_queued >= CAPTURE_RING_SIZE || capture->have_write_error)
+		goto on_drop;
+	al_unlock_mutex(capture->mutex);
+
+	if (!(lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY))) {
+		al_lock_mutex(capture->mutex);
+		goto on_drop;
+	}
+	row_size = capture->width * 4;
+	p_dest = capture->frames + capture->write_index * capture->frame_size;
+	p_src = lock->data;
+	for (y = 0; y < capture->height; ++y) {
+		memcpy(p_dest, p_src, row_size);
+		p_dest += row_size;
+		p_src += lock->pitch;
+	}
+	al_unlock_bitmap(bitmap);
+
+	al_lock_mutex(capture->mutex);
+	capture->write_index = (capture->write_index + 1) % CAPTURE_RING_SIZE;
+	++capture->num_queued;
+	al_signal_cond(capture->cond);
+	al_unlock_mutex(capture->mutex);
+	return;
+
+on_drop:
+	++capture->num_dropped;
+	al_unlock_mutex(capture->mutex);
+	console_log(3, "unable to keep up with capture, dropping frame");
+}
+
 static void
 refresh_display(screen_t* obj)
 {
@@ -488,6 +790,36 @@ refresh_display(screen_t* obj)
 	screen_set_clipping(obj, obj->clip_rect);
 }
 
+static void*
+run_capture(ALLEGRO_THREAD* thread, void* arg)
+{
+	struct capture* capture = arg;
+	const uint8_t*  frame;
+	bool            is_ok;
+
+	al_lock_mutex(capture->mutex);
+	while (true) {
+		while (capture->num_queued == 0 && !capture->stopping)
+			al_wait_cond(capture->cond, capture->mutex);
+		if (capture->num_queued == 0)
+			break;  // stopping and nothing left to write
+		frame = capture->frames + capture->read_index * capture->frame_size;
+		al_unlock_mutex(capture->mutex);
+		is_ok = fwrite(frame, capture->frame_size, 1, capture->file) == 1;
+		al_lock_mutex(capture->mutex);
+		capture->read_index = (capture->read_index + 1) % CAPTURE_RING_SIZE;
+		--capture->num_queued;
+		if (is_ok)
+			++capture->num_written;
+		else {
+			capture->have_write_error = true;
+			++capture->num_dropped;
+		}
+	}
+	al_unlock_mutex(capture->mutex);
+	return NULL;
+}
+
 void
 init_screen_api(void)
 {
@@ -6,6 +6,21 @@
 
 typedef struct screen screen_t;
 
+typedef
+struct frame_stats
+{
+	int    num_frames;
+	int    num_late;
+	double min_time;
+	double max_time;
+	double mean_time;
+	double p95_time;
+	double p99_time;
+	double jitter;
+	double mean_binds;
+	double mean_switches;
+} frame_stats_t;
+
 screen_t*        screen_new               (const char* title, image_t* icon, int x_size, int y_size, int frameskip, bool avoid_sleep);
 void             screen_free              (screen_t* obj);
 ALLEGRO_DISPLAY* screen_display           (const screen_t* obj);
@@ -13,6 +28,7 @@ bool             screen_have_shaders      (const screen_t* screen);
 bool             screen_is_skipframe      (const screen_t* obj);
 rect_t           screen_get_clipping      (screen_t* obj);
 int              screen_get_frameskip     (const screen_t* obj);
+frame_stats_t    screen_get_frame_stats   (const screen_t* obj);
 void             screen_get_mouse_xy      (const screen_t* obj, int* o_x, int* o_y);
 void             screen_set_clipping      (screen_t* obj, rect_t clip_rect);
 void             screen_set_frameskip     (screen_t* obj, int max_skips);
@@ -23,6 +39,8 @@ image_t*         screen_grab              (screen_t* obj, int x, int y, int widt
 void             screen_queue_screenshot  (screen_t* obj);
 void             screen_resize            (screen_t* obj, int x_size, int y_size);
 void             screen_show_mouse        (screen_t* obj, bool visible);
+bool             screen_start_capture     (screen_t* obj, FILE* file);
+void             screen_stop_capture      (screen_t* obj);
 void             screen_toggle_fps        (screen_t* obj);
 void             screen_toggle_fullscreen (screen_t* obj);
 void             screen_transform         (screen_t* obj, const matrix_t* matrix);
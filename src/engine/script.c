@@ -9,13 +9,23 @@
 struct script
 {
 	unsigned int  refcount;
+	void*         heapptr;
 	bool          is_in_use;
 	duk_uarridx_t id;
 };
 
+static duk_ret_t do_load_function        (duk_context* ctx);
+static bool      load_bytecode           (const char* key, uint64_t hash);
+static script_t* new_script              (void);
 static script_t* script_from_js_function (void* heapptr);
+static void      save_bytecode           (const char* key, uint64_t hash);
 
-static int       s_next_script_id = 0;
+static double        s_cache_load_time = 0.0;
+static double        s_compile_time = 0.0;
+static vector_t*     s_free_slots = NULL;
+static duk_uarridx_t s_num_slots = 0;
+static int           s_num_cached = 0;
+static int           s_num_compiled = 0;
 
 void
 initialize_scripts(void)
@@ -26,6 +36,8 @@ initialize_scripts(void)
 	duk_push_array(g_duk);
 	duk_put_prop_string(g_duk, -2, "scripts");
 	duk_pop(g_duk);
+	s_free_slots = vector_new(sizeof(duk_uarridx_t));
+	s_num_slots = 0;
 
 	initialize_transpiler();
 }
@@ -34,44 +46,94 @@ void
 shutdown_scripts(void)
 {
 	console_log(1, "shutting down JS script manager");
+	console_log(2, "    %i scripts compiled in %.1f ms", s_num_compiled, s_compile_time * 1000.0);
+	console_log(2, "    %i scripts loaded from bytecode cache in %.1f ms", s_num_cached, s_cache_load_time * 1000.0);
 	shutdown_transpiler();
+	vector_free(s_free_slots);
+	s_free_slots = NULL;
 }
 
 bool
 evaluate_script(const char* filename)
 {
-	sfs_file_t*    file = NULL;
-	path_t*        path;
-	const char*    source_name;
-	lstring_t*     source_text = NULL;
-	char*          slurp;
-	size_t         size;
+	char*       cache_key = NULL;
+	sfs_file_t* file = NULL;
+	uint64_t    hash;
+	char*       js_text;
+	size_t      js_size;
+	lstring_t*  original_text;
+	path_t*     path;
+	const char* source_name;
+	lstring_t*  source_text = NULL;
+	double      start_time;
+	char*       slurp;
+	size_t      size;
 	
 	path = make_sfs_path(filename, NULL, false);
 	source_name = get_source_name(path_cstr(path));
 	if (!(slurp = sfs_fslurp(g_fs, filename, NULL, &size)))
 		goto on_error;
-	source_text = lstr_from_buf(slurp, size);
-	free(slurp);
+	
+	// compiled scripts are cached as Duktape bytecode, keyed on the game and the
+	// script's path.  the hash of the source is checked when loading, so a
+	// script which has been edited since is compiled again.  the source name is
+	// part of the key because it's baked into the bytecode for error messages.
+	start_time = al_get_time();
+	cache_key = strnewf("%s|%s|%s", path_cstr(g_game_path), path_cstr(path), source_name);
+	hash = memhash(slurp, size);
+	if (load_bytecode(cache_key, hash)) {
+		// the bytecode doesn't carry the JS a TypeScript or CoffeeScript file was
+		// transpiled to, which the debugger needs, so that is cached alongside it.
+		// if it's missing, the transpiler provides it from its own cache.
+		if (js_text = read_cache_file("source", cache_key, hash, &js_size)) {
+			source_text = lstr_from_buf(js_text, js_size);
+			cache_source(source_name, source_text);
+			free(js_text);
+		}
+		else {
+			source_text = lstr_from_buf(slurp, size);
+			if (!transpile_to_js(&source_text, source_name))
+				duk_pop(g_duk);
+		}
+		free(slurp);
+		++s_num_cached;
+		s_cache_load_time += al_get_time() - start_time;
+		console_log(3, "loaded `%s` from bytecode cache in %.1f ms", source_name,
+			(al_get_time() - start_time) * 1000.0);
+	}
+	else {
+		source_text = lstr_from_buf(slurp, size);
+		free(slurp);
 
-	// ensure non-JS scripts are transpiled to JS first.  this is needed to support
-	// TypeScript, CoffeeScript, etc. transparently.
-	if (!transpile_to_js(&source_text, source_name))
-		goto on_error;
+		// ensure non-JS scripts are transpiled to JS first.  this is needed to support
+		// TypeScript, CoffeeScript, etc. transparently.
+		original_text = source_text;
+		if (!transpile_to_js(&source_text, source_name))
+			goto on_error;
 
-	// ready for launch in T-10...9...*munch*
-	duk_push_lstring_t(g_duk, source_text);
-	duk_push_string(g_duk, source_name);
-	if (duk_pcompile(g_duk, DUK_COMPILE_EVAL) != DUK_EXEC_SUCCESS)
-		goto on_error;
+		// ready for launch in T-10...9...*munch*
+		duk_push_lstring_t(g_duk, source_text);
+		duk_push_string(g_duk, source_name);
+		if (duk_pcompile(g_duk, DUK_COMPILE_EVAL) != DUK_EXEC_SUCCESS)
+			goto on_error;
+		++s_num_compiled;
+		s_compile_time += al_get_time() - start_time;
+		console_log(3, "compiled `%s` in %.1f ms", source_name,
+			(al_get_time() - start_time) * 1000.0);
+		save_bytecode(cache_key, hash);
+		if (source_text != original_text)
+			write_cache_file("source", cache_key, hash, lstr_cstr(source_text), lstr_len(source_text));
+	}
 	if (duk_pcall(g_duk, 0) != DUK_EXEC_SUCCESS)
 		goto on_error;
 	
+	free(cache_key);
 	lstr_free(source_text);
 	path_free(path);
 	return true;
 
 on_error:
+	free(cache_key);
 	lstr_free(source_text);
 	path_free(path);
 	if (!duk_is_error(g_duk, -1))
@@ -89,26 +151,19 @@ compile_script(const lstring_t* source, const char* fmt_name, ...)
 	va_start(ap, fmt_name);
 	name = lstr_vnewf(fmt_name, ap);
 	va_end(ap);
-	script = calloc(1, sizeof(script_t));
 
-	console_log(3, "compiling script #%u as `%s`", s_next_script_id, lstr_cstr(name));
-	
-	// this wouldn't be necessary if Duktape duk_get_heapptr() gave us a strong reference.
-	// instead we get this ugliness where the compiled function is saved in the global stash
-	// so it doesn't get eaten by the garbage collector. yummy!
-	duk_push_global_stash(g_duk);
-	duk_get_prop_string(g_duk, -1, "scripts");
 	duk_push_lstring_t(g_duk, source);
 	duk_push_lstring_t(g_duk, name);
 	duk_compile(g_duk, 0x0);
-	duk_put_prop_index(g_duk, -2, s_next_script_id);
-	duk_pop_2(g_duk);
+	if (!(script = new_script())) {
+		lstr_free(name);
+		return NULL;
+	}
+	console_log(3, "compiled script #%u as `%s`", script->id, lstr_cstr(name));
 
 	cache_source(lstr_cstr(name), source);
 	lstr_free(name);
-
-	script->id = s_next_script_id++;
-	return ref_script(script);
+	return script;
 }
 
 script_t*
@@ -126,11 +181,15 @@ free_script(script_t* script)
 	
 	console_log(3, "disposing script #%u no longer in use", script->id);
 	
-	// unstash the compiled function, it's now safe to GC
+	// unstash the compiled function, it's now safe to GC.  the slot is cleared
+	// rather than deleted so the array stays dense, and is reused by the next
+	// script to come along.
 	duk_push_global_stash(g_duk);
 	duk_get_prop_string(g_duk, -1, "scripts");
-	duk_del_prop_index(g_duk, -1, script->id);
+	duk_push_undefined(g_duk);
+	duk_put_prop_index(g_duk, -2, script->id);
 	duk_pop_2(g_duk);
+	vector_push(s_free_slots, &script->id);
 
 	free(script);
 }
@@ -158,13 +217,12 @@ run_script(script_t* script, bool allow_reentry)
 	// may be destroyed in the process and we don't want to end up crashing.
 	ref_script(script);
 	
-	// get the compiled script from the stash and run it. so dumb...
+	// the stash keeps the function alive, so the heap pointer can be pushed
+	// directly without going through the stash.
 	script->is_in_use = true;
-	duk_push_global_stash(g_duk);
-	duk_get_prop_string(g_duk, -1, "scripts");
-	duk_get_prop_index(g_duk, -1, script->id);
+	duk_push_heapptr(g_duk, script->heapptr);
 	duk_call(g_duk, 0);
-	duk_pop_3(g_duk);
+	duk_pop(g_duk);
 	script->is_in_use = was_in_use;
 
 	free_script(script);
@@ -195,20 +253,97 @@ duk_require_sphere_script(duk_context* ctx, duk_idx_t index, const char* name)
 	return script;
 }
 
+static duk_ret_t
+do_load_function(duk_context* ctx)
+{
+	duk_load_function(ctx);
+	return 1;
+}
+
+static bool
+load_bytecode(const char* key, uint64_t hash)
+{
+	// pushes the cached function onto the Duktape stack if there's an up-to-date
+	// copy in the cache.  Duktape doesn't validate bytecode, but the cache file
+	// is checked against the engine and Duktape versions and its own hash before
+	// any of it gets here.
+
+	void*  buffer;
+	void*  bytecode;
+	size_t size;
+
+	if (!(buffer = read_cache_file("bytecode", key, hash, &size)))
+		return false;
+	bytecode = duk_push_fixed_buffer(g_duk, size);
+	memcpy(bytecode, buffer, size);
+	free(buffer);
+	if (duk_safe_call(g_duk, do_load_function, 1, 1) != DUK_EXEC_SUCCESS) {
+		duk_pop(g_duk);
+		return false;
+	}
+	return true;
+}
+
+static void
+save_bytecode(const char* key, uint64_t hash)
+{
+	// saves the compiled function on top of the Duktape stack to the cache,
+	// leaving it in place.
+
+	void*      bytecode;
+	duk_size_t size;
+
+	duk_dup_top(g_duk);
+	duk_dump_function(g_duk);
+	bytecode = duk_get_buffer(g_duk, -1, &size);
+	write_cache_file("bytecode", key, hash, bytecode, size);
+	duk_pop(g_duk);
+}
+
 static script_t*
-script_from_js_function(void* heapptr)
+new_script(void)
 {
-	script_t* script;
+	// wraps the function on top of the Duktape stack in a script_t, popping
+	// it.  duk_get_heapptr() doesn't give us a strong reference, so the
+	// function is also saved in the global stash to keep it from getting eaten
+	// by the garbage collector.  slots freed by free_script() are reused first,
+	// lowest first, which keeps the stash array as short as possible.
 
-	if (!(script = calloc(1, sizeof(script_t))))
-		return NULL;
+	size_t        lowest;
+	size_t        num_free;
+	script_t*     script;
+	duk_uarridx_t slot;
 
+	size_t i;
+
+	if (!(script = calloc(1, sizeof(script_t)))) {
+		duk_pop(g_duk);
+		return NULL;
+	}
+	if ((num_free = vector_len(s_free_slots)) > 0) {
+		lowest = 0;
+		for (i = 1; i < num_free; ++i) {
+			if (*(duk_uarridx_t*)vector_get(s_free_slots, i) < *(duk_uarridx_t*)vector_get(s_free_slots, lowest))
+				lowest = i;
+		}
+		slot = *(duk_uarridx_t*)vector_get(s_free_slots, lowest);
+		vector_remove(s_free_slots, lowest);
+	}
+	else
+		slot = s_num_slots++;
+	script->heapptr = duk_get_heapptr(g_duk, -1);
+	script->id = slot;
 	duk_push_global_stash(g_duk);
 	duk_get_prop_string(g_duk, -1, "scripts");
-	duk_push_heapptr(g_duk, heapptr);
-	duk_put_prop_index(g_duk, -2, s_next_script_id);
-	duk_pop_2(g_duk);
-
-	script->id = s_next_script_id++;
+	duk_dup(g_duk, -3);
+	duk_put_prop_index(g_duk, -2, slot);
+	duk_pop_3(g_duk);
 	return ref_script(script);
 }
+
+static script_t*
+script_from_js_function(void* heapptr)
+{
+	duk_push_heapptr(g_duk, heapptr);
+	return new_script();
+}
@@ -4,13 +4,41 @@
 #include "api.h"
 #include "matrix.h"
 
+#ifdef MINISPHERE_USE_SHADERS
+#include <allegro5/allegro_opengl.h>
+#endif
+
 static duk_ret_t js_new_ShaderProgram       (duk_context* ctx);
 static duk_ret_t js_ShaderProgram_finalize  (duk_context* ctx);
 
+static struct uniform* get_uniform (shader_t* shader, int slot);
+
+enum uniform_type
+{
+	UNIFORM_NONE,
+	UNIFORM_INT,
+	UNIFORM_FLOAT,
+	UNIFORM_MATRIX,
+};
+
+struct uniform
+{
+	char*             name;
+	uint32_t          hash;
+	int               location;
+	enum uniform_type type;
+	union {
+		ALLEGRO_TRANSFORM mat_value;
+		int               int_value;
+		float             float_value;
+	};
+};
+
 struct shader
 {
 	unsigned int   id;
 	unsigned int   refcount;
+	vector_t*      uniforms;
 #ifdef MINISPHERE_USE_SHADERS
 	ALLEGRO_SHADER* program;
 #endif
@@ -52,6 +80,8 @@ shader_new(const char* vs_filename, const char* fs_filename)
 	
 	console_log(2, "compiling new shader program #%u", s_next_id);
 	
+	if (!(shader->uniforms = vector_new(sizeof(struct uniform))))
+		goto on_error;
 	if (!(vs_source = sfs_fslurp(g_fs, vs_filename, NULL, NULL)))
 		goto on_error;
 	if (!(fs_source = sfs_fslurp(g_fs, fs_filename, NULL, NULL)))
@@ -85,6 +115,7 @@ on_error:
 	if (shader->program != NULL)
 		al_destroy_shader(shader->program);
 #endif
+	vector_free(shader->uniforms);
 	free(shader);
 	return NULL;
 }
@@ -101,6 +132,9 @@ shader_ref(shader_t* shader)
 void
 shader_free(shader_t* shader)
 {
+	iter_t          iter;
+	struct uniform* p;
+	
 	if (shader == NULL || --shader->refcount > 0)
 		return;
 
@@ -108,21 +142,123 @@ shader_free(shader_t* shader)
 #ifdef MINISPHERE_USE_SHADERS
 	al_destroy_shader(shader->program);
 #endif
+	iter = vector_enum(shader->uniforms);
+	while (p = vector_next(&iter))
+		free(p->name);
+	vector_free(shader->uniforms);
 	free(shader);
 }
 
+unsigned int
+shader_id(const shader_t* shader)
+{
+	return shader->id;
+}
+
+int
+shader_uniform(shader_t* shader, const char* name)
+{
+	// returns a slot number for the named uniform which can be passed to the
+	// shader_put_*() functions.  the GL uniform location is looked up only the
+	// first time a name is seen; uniforms which don't exist in the program
+	// still get a slot, but setting them does nothing.
+
+	uint32_t        hash;
+	iter_t          iter;
+	struct uniform  uniform;
+	struct uniform* p;
+
+	hash = strhash(name);
+	iter = vector_enum(shader->uniforms);
+	while (p = vector_next(&iter)) {
+		if (p->hash == hash && strcmp(p->name, name) == 0)
+			return (int)iter.index;
+	}
+	memset(&uniform, 0, sizeof(struct uniform));
+	if (!(uniform.name = strdup(name)))
+		return -1;
+	uniform.hash = hash;
+	uniform.location = -1;
+#ifdef MINISPHERE_USE_SHADERS
+	if (s_have_shaders)
+		uniform.location = glGetUniformLocation(al_get_opengl_program_object(shader->program), name);
+#endif
+	console_log(4, "uniform `%s` in shader program #%u is at location %i", name, shader->id, uniform.location);
+	if (!vector_push(shader->uniforms, &uniform)) {
+		free(uniform.name);
+		return -1;
+	}
+	return (int)vector_len(shader->uniforms) - 1;
+}
+
+void
+shader_put_float(shader_t* shader, int slot, float value)
+{
+	// the shader must be in use.  a GL program keeps its uniform values until
+	// they're changed, so if the value is the same as last time, nothing has
+	// to be sent.
+
+	struct uniform* uniform;
+
+	if (!(uniform = get_uniform(shader, slot)))
+		return;
+	if (uniform->type == UNIFORM_FLOAT && uniform->float_value == value)
+		return;
+	uniform->type = UNIFORM_FLOAT;
+	uniform->float_value = value;
+#ifdef MINISPHERE_USE_SHADERS
+	glUniform1f(uniform->location, value);
+#endif
+}
+
+void
+shader_put_int(shader_t* shader, int slot, int value)
+{
+	struct uniform* uniform;
+
+	if (!(uniform = get_uniform(shader, slot)))
+		return;
+	if (uniform->type == UNIFORM_INT && uniform->int_value == value)
+		return;
+	uniform->type = UNIFORM_INT;
+	uniform->int_value = value;
+#ifdef MINISPHERE_USE_SHADERS
+	glUniform1i(uniform->location, value);
+#endif
+}
+
+void
+shader_put_matrix(shader_t* shader, int slot, const ALLEGRO_TRANSFORM* matrix)
+{
+	struct uniform* uniform;
+
+	if (!(uniform = get_uniform(shader, slot)))
+		return;
+	if (uniform->type == UNIFORM_MATRIX && memcmp(&uniform->mat_value, matrix, sizeof(ALLEGRO_TRANSFORM)) == 0)
+		return;
+	uniform->type = UNIFORM_MATRIX;
+	al_copy_transform(&uniform->mat_value, matrix);
+#ifdef MINISPHERE_USE_SHADERS
+	glUniformMatrix4fv(uniform->location, 1, GL_FALSE, (const GLfloat*)matrix->m);
+#endif
+}
+
 bool
 shader_use(shader_t* shader)
 {
 #ifdef MINISPHERE_USE_SHADERS
 	ALLEGRO_SHADER* al_shader;
 
-	if (shader != NULL)
-		console_log(4, "activating shader program #%u", shader->id);
-	else
-		console_log(4, "activating null shader");
 	if (s_have_shaders) {
+		// Allegro keeps track of the shader per target bitmap, so ask it which
+		// one is active instead of remembering the last one used here.
 		al_shader = shader != NULL ? shader->program : NULL;
+		if (al_get_current_shader() == al_shader)
+			return true;
+		if (shader != NULL)
+			console_log(4, "activating shader program #%u", shader->id);
+		else
+			console_log(4, "activating null shader");
 		if (!al_use_shader(al_shader))
 			return false;
 		return true;
@@ -143,6 +279,20 @@ init_shader_api(void)
 	api_register_ctor(g_duk, "ShaderProgram", js_new_ShaderProgram, js_ShaderProgram_finalize);
 }
 
+static struct uniform*
+get_uniform(shader_t* shader, int slot)
+{
+	// returns NULL if the uniform can't be set, either because shaders are
+	// disabled or because the program doesn't have it
+	
+	struct uniform* uniform;
+
+	if (!s_have_shaders || slot < 0 || slot >= (int)vector_len(shader->uniforms))
+		return NULL;
+	uniform = vector_get(shader->uniforms, slot);
+	return uniform->location >= 0 ? uniform : NULL;
+}
+
 static duk_ret_t
 js_new_ShaderProgram(duk_context* ctx)
 {
@@ -11,13 +11,18 @@ enum shader_type
 	SHADER_TYPE_MAX
 } shader_type_t;
 
-void      initialize_shaders (bool enable_shading);
-void      shutdown_shaders   (void);
-bool      are_shaders_active (void);
-shader_t* shader_new         (const char* vs_path, const char* fs_path);
-shader_t* shader_ref         (shader_t* shader);
-void      shader_free        (shader_t* shader);
-bool      shader_use         (shader_t* shader);
+void         initialize_shaders (bool enable_shading);
+void         shutdown_shaders   (void);
+bool         are_shaders_active (void);
+shader_t*    shader_new         (const char* vs_path, const char* fs_path);
+shader_t*    shader_ref         (shader_t* shader);
+void         shader_free        (shader_t* shader);
+unsigned int shader_id          (const shader_t* shader);
+int          shader_uniform     (shader_t* shader, const char* name);
+void         shader_put_float   (shader_t* shader, int slot, float value);
+void         shader_put_int     (shader_t* shader, int slot, int value);
+void         shader_put_matrix  (shader_t* shader, int slot, const ALLEGRO_TRANSFORM* matrix);
+bool         shader_use         (shader_t* shader);
 
 void init_shader_api (void);
 
@@ -516,7 +516,7 @@ js_Socket_close(duk_context* ctx)
 
 	duk_push_this(ctx);
 	socket = duk_require_sphere_obj(ctx, -1, "Socket");
-	duk_push_null(ctx); duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, NULL);
 	duk_pop(ctx);
 	if (socket != NULL)
 		free_socket(socket);
@@ -653,7 +653,7 @@ js_Server_close(duk_context* ctx)
 
 	duk_push_this(ctx);
 	socket = duk_require_sphere_obj(ctx, -1, "Server");
-	duk_push_null(ctx); duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, NULL);
 	duk_pop(ctx);
 	if (socket != NULL)
 		free_socket(socket);
@@ -760,7 +760,7 @@ js_IOSocket_close(duk_context* ctx)
 
 	duk_push_this(ctx);
 	socket = duk_require_sphere_obj(ctx, -1, "IOSocket");
-	duk_push_null(ctx); duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, NULL);
 	duk_pop(ctx);
 	if (socket != NULL)
 		free_socket(socket);
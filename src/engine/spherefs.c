@@ -382,6 +382,40 @@ sfs_fexist(sandbox_t* fs, const char* filename, const char* base_dir)
 	return true;
 }
 
+char*
+sfs_fident(sandbox_t* fs, const char* filename, const char* base_dir)
+{
+	// returns a string which identifies both a file and its current version, or
+	// NULL if the file doesn't exist.  this is used as a key for caching things
+	// loaded from disk: if the file is modified, its identity changes.
+
+	ALLEGRO_FS_ENTRY* fse = NULL;
+	path_t*           file_path = NULL;
+	enum fs_type      fs_type;
+	char*             ident = NULL;
+
+	if (!resolve_path(fs, filename, base_dir, &file_path, &fs_type))
+		goto finished;
+	switch (fs_type) {
+	case SPHEREFS_LOCAL:
+		fse = al_create_fs_entry(path_cstr(file_path));
+		if (fse == NULL || !(al_get_fs_entry_mode(fse) & ALLEGRO_FILEMODE_ISFILE))
+			break;
+		ident = strnewf("%s:%lld:%lld", path_cstr(file_path),
+			(long long)al_get_fs_entry_mtime(fse), (long long)al_get_fs_entry_size(fse));
+		break;
+	case SPHEREFS_SPK:
+		ident = spk_fident(fs->spk, path_cstr(file_path));
+		break;
+	}
+
+finished:
+	if (fse != NULL)
+		al_destroy_fs_entry(fse);
+	path_free(file_path);
+	return ident;
+}
+
 int
 sfs_fputc(int ch, sfs_file_t* file)
 {
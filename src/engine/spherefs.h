@@ -33,6 +33,7 @@ path_t*          make_sfs_path       (const char* filename, const char* base_dir
 sfs_file_t* sfs_fopen  (sandbox_t* fs, const char* path, const char* base_dir, const char* mode);
 void        sfs_fclose (sfs_file_t* file);
 bool        sfs_fexist (sandbox_t* fs, const char* filename, const char* base_dir);
+char*       sfs_fident (sandbox_t* fs, const char* filename, const char* base_dir);
 int         sfs_fputc  (int ch, sfs_file_t* file);
 int         sfs_fputs  (const char* string, sfs_file_t* file);
 size_t      sfs_fread  (void* buf, size_t size, size_t count, sfs_file_t* file);
@@ -211,6 +211,24 @@ spk_fclose(spk_file_t* file)
 	free(file);
 }
 
+char*
+spk_fident(spk_t* spk, const char* path)
+{
+	// packed files can't change while the package is open, so the SPK ID and
+	// the canonical filename are enough to identify one.
+
+	struct spk_entry* fileinfo;
+
+	iter_t iter;
+
+	iter = vector_enum(spk->index);
+	while (fileinfo = vector_next(&iter)) {
+		if (strcasecmp(path, fileinfo->file_path) == 0)
+			return strnewf("spk#%u:%s", spk->id, fileinfo->file_path);
+	}
+	return NULL;
+}
+
 int
 spk_fputc(int ch, spk_file_t* file)
 {
@@ -19,6 +19,7 @@ vector_t*   list_spk_filenames (spk_t* spk, const char* dirname, bool want_dirs)
 
 spk_file_t* spk_fopen  (spk_t* spk, const char* path, const char* mode);
 void        spk_fclose (spk_file_t* file);
+char*       spk_fident (spk_t* spk, const char* path);
 int         spk_fputc  (int ch, spk_file_t* file);
 int         spk_fputs  (const char* string, spk_file_t* file);
 size_t      spk_fread  (void* buf, size_t size, size_t count, spk_file_t* file);
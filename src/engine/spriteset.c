@@ -50,6 +50,19 @@ struct rss_frame_v3
 };
 #pragma pack(pop)
 
+#define CACHE_BUCKETS 64
+
+struct cache_entry
+{
+	char*               key;
+	uint32_t            hash;
+	size_t              size;
+	spriteset_t*        spriteset;
+	struct cache_entry* next;
+	struct cache_entry* newer;
+	struct cache_entry* older;
+};
+
 static duk_ret_t js_LoadSpriteset          (duk_context* ctx);
 static duk_ret_t js_new_Spriteset          (duk_context* ctx);
 static duk_ret_t js_Spriteset_finalize     (duk_context* ctx);
@@ -59,34 +72,48 @@ static duk_ret_t js_Spriteset_clone        (duk_context* ctx);
 static duk_ret_t js_Spriteset_get_image    (duk_context* ctx);
 static duk_ret_t js_Spriteset_set_image    (duk_context* ctx);
 
-static const spriteset_pose_t* find_sprite_pose    (const spriteset_t* spriteset, const char* pose_name);
-
-static vector_t*    s_load_cache;
-static unsigned int s_next_spriteset_id = 0;
-static unsigned int s_num_cache_hits = 0;
+static void                cache_spriteset   (const char* key, uint32_t hash, spriteset_t* spriteset);
+static void                evict_spriteset   (void);
+static struct cache_entry* find_cached       (const char* key, uint32_t hash);
+static bool                read_images       (spriteset_t* spriteset, sfs_file_t* file, int width, int height);
+static void                unlink_cached     (struct cache_entry* entry);
+
+static struct cache_entry* s_cache_buckets[CACHE_BUCKETS];
+static size_t              s_cache_budget = 0;
+static struct cache_entry* s_cache_newest = NULL;
+static struct cache_entry* s_cache_oldest = NULL;
+static size_t              s_cache_size = 0;
+static unsigned int        s_next_spriteset_id = 0;
+static unsigned int        s_num_cache_evictions = 0;
+static unsigned int        s_num_cache_hits = 0;
+static unsigned int        s_num_cache_misses = 0;
 
 void
 initialize_spritesets(void)
 {
+	// loaded spritesets are cached by file identity and handed out as clones.
+	// every entry is also linked into a recency list, so once the pixel data held
+	// by the cache goes over budget the least recently used ones are evicted.
+
+	double budget_mb;
+
 	console_log(1, "initializing spriteset manager");
-	s_load_cache = vector_new(sizeof(spriteset_t*));
+	budget_mb = g_sys_conf != NULL ? kev_read_float(g_sys_conf, "SpritesetCacheSize", 32.0) : 32.0;
+	s_cache_budget = budget_mb > 0.0 ? (size_t)(budget_mb * 1048576) : 0;
+	console_log(2, "    spriteset cache budget: %.1f MB", budget_mb);
 }
 
 void
 shutdown_spritesets(void)
 {
-	iter_t        iter;
-	spriteset_t** p_spriteset;
-	
 	console_log(1, "shutting down spriteset manager");
 	console_log(2, "    objects created: %u", s_next_spriteset_id);
 	console_log(2, "    cache hits: %u", s_num_cache_hits);
-	if (s_load_cache != NULL) {
-		iter = vector_enum(s_load_cache);
-		while (p_spriteset = vector_next(&iter))
-			free_spriteset(*p_spriteset);
-		vector_free(s_load_cache);
-	}
+	console_log(2, "    cache misses: %u", s_num_cache_misses);
+	console_log(2, "    cache evictions: %u", s_num_cache_evictions);
+	console_log(2, "    cache size at exit: %.1f MB", s_cache_size / 1048576.0);
+	while (s_cache_oldest != NULL)
+		evict_spriteset();
 }
 
 spriteset_t*
@@ -155,30 +182,32 @@ load_spriteset(const char* filename)
 	struct rss_frame_v2 frame_v2;
 	struct rss_frame_v3 frame_v3;
 	sfs_file_t*         file = NULL;
+	uint64_t*           image_hashes = NULL;
+	int*                image_heights = NULL;
 	int                 image_index;
-	int                 max_width = 0, max_height = 0;
+	int*                image_widths = NULL;
+	struct cache_entry* cached;
+	uint32_t            hash = 0;
+	char*               key;
 	struct rss_header   rss;
 	long                skip_size;
 	spriteset_t*        spriteset = NULL;
 	long                v2_data_offset;
-	spriteset_t*        *p_spriteset;
 	
-	iter_t iter;
 	int i, j;
 
-	// check load cache to see if we loaded this file once already
-	if (s_load_cache != NULL) {
-		iter = vector_enum(s_load_cache);
-		while (p_spriteset = vector_next(&iter)) {
-			if (strcmp(filename, (*p_spriteset)->filename) == 0) {
-				console_log(2, "using cached spriteset #%u for `%s`", (*p_spriteset)->id, filename);
-				++s_num_cache_hits;
-				return clone_spriteset(*p_spriteset);
-			}
+	// check load cache to see if we loaded this file once already.  the key
+	// includes the file's modification time, so an edited file is reloaded.
+	if ((key = sfs_fident(g_fs, filename, NULL)) != NULL) {
+		hash = strhash(key);
+		if (cached = find_cached(key, hash)) {
+			console_log(2, "using cached spriteset #%u for `%s`", cached->spriteset->id, filename);
+			++s_num_cache_hits;
+			free(key);
+			return clone_spriteset(cached->spriteset);
 		}
+		++s_num_cache_misses;
 	}
-	else
-		s_load_cache = vector_new(sizeof(spriteset_t*));
 	
 	// filename not in load cache, load the spriteset
 	console_log(2, "loading spriteset #%u as `%s`", s_next_spriteset_id, filename);
@@ -203,15 +232,8 @@ load_spriteset(const char* filename)
 			spriteset->poses[i].name = lstr_newf("%s", def_dir_names[i]);
 		if ((spriteset->images = calloc(spriteset->num_images, sizeof(image_t*))) == NULL)
 			goto on_error;
-		if (!(atlas = atlas_new(spriteset->num_images, rss.frame_width, rss.frame_height)))
+		if (!read_images(spriteset, file, rss.frame_width, rss.frame_height))
 			goto on_error;
-		atlas_lock(atlas);
-		for (i = 0; i < spriteset->num_images; ++i) {
-			if (!(spriteset->images[i] = atlas_load(atlas, file, i, rss.frame_width, rss.frame_height)))
-				goto on_error;
-		}
-		atlas_unlock(atlas);
-		atlas_free(atlas);
 		for (i = 0; i < spriteset->num_poses; ++i) {
 			if ((spriteset->poses[i].frames = calloc(8, sizeof(spriteset_frame_t))) == NULL)
 				goto on_error;
@@ -241,8 +263,6 @@ load_spriteset(const char* filename)
 			for (j = 0; j < dir_v2.num_frames; ++j) {  // skip over frame and image data
 				if (sfs_fread(&frame_v2, sizeof(struct rss_frame_v2), 1, file) != 1)
 					goto on_error;
-				max_width = fmax(rss.frame_width != 0 ? rss.frame_width : frame_v2.width, max_width);
-				max_height = fmax(rss.frame_height != 0 ? rss.frame_height : frame_v2.height, max_height);
 				skip_size = (rss.frame_width != 0 ? rss.frame_width : frame_v2.width)
 					* (rss.frame_height != 0 ? rss.frame_height : frame_v2.height)
 					* 4;
@@ -252,8 +272,32 @@ load_spriteset(const char* filename)
 		if (!(spriteset->images = calloc(spriteset->num_images, sizeof(image_t*))))
 			goto on_error;
 
-		// pass 2 - read images and frame data
-		if (!(atlas = atlas_new(spriteset->num_images, max_width, max_height)))
+		// pass 2 - read frame sizes so the atlas can be packed tightly, and
+		// hash the pixels so duplicate frames can share space
+		if (!(image_widths = malloc(spriteset->num_images * sizeof(int))))
+			goto on_error;
+		if (!(image_heights = malloc(spriteset->num_images * sizeof(int))))
+			goto on_error;
+		if (!(image_hashes = malloc(spriteset->num_images * sizeof(uint64_t))))
+			goto on_error;
+		sfs_fseek(file, v2_data_offset, SFS_SEEK_SET);
+		image_index = 0;
+		for (i = 0; i < rss.num_directions; ++i) {
+			if (sfs_fread(&dir_v2, sizeof(struct rss_dir_v2), 1, file) != 1)
+				goto on_error;
+			for (j = 0; j < dir_v2.num_frames; ++j) {
+				if (sfs_fread(&frame_v2, sizeof(struct rss_frame_v2), 1, file) != 1)
+					goto on_error;
+				image_widths[image_index] = rss.frame_width != 0 ? rss.frame_width : frame_v2.width;
+				image_heights[image_index] = rss.frame_height != 0 ? rss.frame_height : frame_v2.height;
+				if (!atlas_hash_image(file, image_widths[image_index], image_heights[image_index], &image_hashes[image_index]))
+					goto on_error;
+				++image_index;
+			}
+		}
+
+		// pass 3 - read images and frame data
+		if (!(atlas = atlas_new_packed(spriteset->num_images, image_widths, image_heights, image_hashes)))
 			goto on_error;
 		sfs_fseek(file, v2_data_offset, SFS_SEEK_SET);
 		image_index = 0;
@@ -265,8 +309,7 @@ load_spriteset(const char* filename)
 				if (sfs_fread(&frame_v2, sizeof(struct rss_frame_v2), 1, file) != 1)
 					goto on_error;
 				spriteset->images[image_index] = atlas_load(atlas, file, image_index,
-					rss.frame_width != 0 ? rss.frame_width : frame_v2.width,
-					rss.frame_height != 0 ? rss.frame_height : frame_v2.height);
+					image_widths[image_index], image_heights[image_index]);
 				spriteset->poses[i].frames[j].image_idx = image_index;
 				spriteset->poses[i].frames[j].delay = frame_v2.delay;
 				++image_index;
@@ -274,6 +317,12 @@ load_spriteset(const char* filename)
 		}
 		atlas_unlock(atlas);
 		atlas_free(atlas);
+		atlas = NULL;
+		free(image_hashes);
+		free(image_widths);
+		free(image_heights);
+		image_hashes = NULL;
+		image_widths = image_heights = NULL;
 		break;
 	case 3: // RSSv3, can be done in a single pass thankfully
 		spriteset->num_images = rss.num_images;
@@ -282,15 +331,8 @@ load_spriteset(const char* filename)
 			goto on_error;
 		if ((spriteset->poses = calloc(spriteset->num_poses, sizeof(spriteset_pose_t))) == NULL)
 			goto on_error;
-		if (!(atlas = atlas_new(spriteset->num_images, rss.frame_width, rss.frame_height)))
+		if (!read_images(spriteset, file, rss.frame_width, rss.frame_height))
 			goto on_error;
-		atlas_lock(atlas);
-		for (i = 0; i < rss.num_images; ++i) {
-			if (!(spriteset->images[i] = atlas_load(atlas, file, i, rss.frame_width, rss.frame_height)))
-				goto on_error;
-		}
-		atlas_unlock(atlas);
-		atlas_free(atlas);
 		for (i = 0; i < rss.num_directions; ++i) {
 			if (sfs_fread(&dir_v3, sizeof(struct rss_dir_v3), 1, file) != 1)
 				goto on_error;
@@ -311,20 +353,18 @@ load_spriteset(const char* filename)
 	}
 	sfs_fclose(file);
 	
-	if (s_load_cache != NULL) {
-		while (vector_len(s_load_cache) >= 10) {
-			p_spriteset = vector_get(s_load_cache, 0);
-			free_spriteset(*p_spriteset);
-			vector_remove(s_load_cache, 0);
-		}
-		ref_spriteset(spriteset);
-		vector_push(s_load_cache, &spriteset);
-	}
 	spriteset->id = s_next_spriteset_id++;
+	if (key != NULL)
+		cache_spriteset(key, hash, spriteset);
+	free(key);
 	return ref_spriteset(spriteset);
 
 on_error:
 	console_log(2, "failed to load spriteset #%u", s_next_spriteset_id);
+	free(key);
+	free(image_hashes);
+	free(image_widths);
+	free(image_heights);
 	if (file != NULL) sfs_fclose(file);
 	if (spriteset != NULL) {
 		if (spriteset->poses != NULL) {
@@ -336,10 +376,7 @@ on_error:
 		}
 		free(spriteset);
 	}
-	if (atlas != NULL) {
-		atlas_unlock(atlas);
-		atlas_free(atlas);
-	}
+	atlas_free(atlas);
 	return NULL;
 }
 
@@ -379,15 +416,59 @@ get_sprite_base(const spriteset_t* spriteset)
 
 int
 get_sprite_frame_delay(const spriteset_t* spriteset, const char* pose_name, int frame_index)
+{
+	return get_sprite_pose_delay(spriteset, get_sprite_pose_index(spriteset, pose_name), frame_index);
+}
+
+int
+get_sprite_pose_delay(const spriteset_t* spriteset, int pose_index, int frame_index)
 {
 	const spriteset_pose_t* pose;
-	
-	if ((pose = find_sprite_pose(spriteset, pose_name)) == NULL)
-		return 0;
+
+	pose = &spriteset->poses[pose_index];
 	frame_index %= pose->num_frames;
 	return pose->frames[frame_index].delay;
 }
 
+int
+get_sprite_pose_frames(const spriteset_t* spriteset, int pose_index)
+{
+	return spriteset->poses[pose_index].num_frames;
+}
+
+int
+get_sprite_pose_index(const spriteset_t* spriteset, const char* pose_name)
+{
+	// resolves a pose name to an index into the pose table.  diagonals fall back
+	// on north or south if the spriteset doesn't have them, and anything else
+	// that's missing falls back on the first pose.  this does a case-insensitive
+	// search of the pose names, so anything drawing a sprite every frame should
+	// resolve the pose once up front and pass the index to draw_sprite_pose().
+
+	const char* alt_name;
+	const char* name_to_find;
+
+	int i;
+
+	alt_name = strcasecmp(pose_name, "northeast") == 0 ? "north"
+		: strcasecmp(pose_name, "southeast") == 0 ? "south"
+		: strcasecmp(pose_name, "southwest") == 0 ? "south"
+		: strcasecmp(pose_name, "northwest") == 0 ? "north"
+		: "";
+	name_to_find = pose_name;
+	for (;;) {
+		for (i = 0; i < spriteset->num_poses; ++i) {
+			if (strcasecmp(name_to_find, lstr_cstr(spriteset->poses[i].name)) == 0)
+				return i;
+		}
+		if (name_to_find != alt_name)
+			name_to_find = alt_name;
+		else
+			break;
+	}
+	return 0;
+}
+
 void
 get_sprite_size(const spriteset_t* spriteset, int* out_width, int* out_height)
 {
@@ -414,11 +495,7 @@ get_spriteset_image(const spriteset_t* spriteset, int image_index)
 bool
 get_spriteset_pose_info(const spriteset_t* spriteset, const char* pose_name, int* out_num_frames)
 {
-	const spriteset_pose_t* pose;
-
-	if ((pose = find_sprite_pose(spriteset, pose_name)) == NULL)
-		return false;
-	*out_num_frames = pose->num_frames;
+	*out_num_frames = get_sprite_pose_frames(spriteset, get_sprite_pose_index(spriteset, pose_name));
 	return true;
 }
 
@@ -434,6 +511,13 @@ set_spriteset_image(const spriteset_t* spriteset, int image_index, image_t* imag
 
 void
 draw_sprite(const spriteset_t* spriteset, color_t mask, bool is_flipped, double theta, double scale_x, double scale_y, const char* pose_name, float x, float y, int frame_index)
+{
+	draw_sprite_pose(spriteset, mask, is_flipped, theta, scale_x, scale_y,
+		get_sprite_pose_index(spriteset, pose_name), x, y, frame_index);
+}
+
+void
+draw_sprite_pose(const spriteset_t* spriteset, color_t mask, bool is_flipped, double theta, double scale_x, double scale_y, int pose_index, float x, float y, int frame_index)
 {
 	rect_t                   base;
 	image_t*                 image;
@@ -442,8 +526,7 @@ draw_sprite(const spriteset_t* spriteset, color_t mask, bool is_flipped, double
 	const spriteset_pose_t*  pose;
 	float                    scale_w, scale_h;
 	
-	if ((pose = find_sprite_pose(spriteset, pose_name)) == NULL)
-		return;
+	pose = &spriteset->poses[pose_index];
 	frame_index = frame_index % pose->num_frames;
 	image_index = pose->frames[frame_index].image_idx;
 	base = zoom_rect(spriteset->base, scale_x, scale_y);
@@ -462,34 +545,151 @@ draw_sprite(const spriteset_t* spriteset, color_t mask, bool is_flipped, double
 		scale_x, scale_y, theta, is_flipped ? ALLEGRO_FLIP_VERTICAL : 0x0);
 }
 
-static const spriteset_pose_t*
-find_sprite_pose(const spriteset_t* spriteset, const char* pose_name)
+static void
+cache_spriteset(const char* key, uint32_t hash, spriteset_t* spriteset)
 {
-	const char*             alt_name;
-	const char*             name_to_find;
-	const spriteset_pose_t* pose = NULL;
+	struct cache_entry* entry;
+	size_t              size = 0;
 
 	int i;
 
-	alt_name = strcasecmp(pose_name, "northeast") == 0 ? "north"
-		: strcasecmp(pose_name, "southeast") == 0 ? "south"
-		: strcasecmp(pose_name, "southwest") == 0 ? "south"
-		: strcasecmp(pose_name, "northwest") == 0 ? "north"
-		: "";
-	name_to_find = pose_name;
-	while (pose == NULL) {
-		for (i = 0; i < spriteset->num_poses; ++i) {
-			if (strcasecmp(name_to_find, lstr_cstr(spriteset->poses[i].name)) == 0) {
-				pose = &spriteset->poses[i];
-				break;
-			}
+	// only the pixel data is counted.  the pose tables are tiny by comparison.
+	for (i = 0; i < spriteset->num_images; ++i) {
+		size += (size_t)get_image_width(spriteset->images[i])
+			* get_image_height(spriteset->images[i]) * sizeof(color_t);
+	}
+	if (size > s_cache_budget)
+		return;
+	while (s_cache_size + size > s_cache_budget)
+		evict_spriteset();
+	if (!(entry = calloc(1, sizeof(struct cache_entry))))
+		return;
+	if (!(entry->key = strdup(key))) {
+		free(entry);
+		return;
+	}
+	entry->hash = hash;
+	entry->size = size;
+	entry->spriteset = ref_spriteset(spriteset);
+	entry->next = s_cache_buckets[hash % CACHE_BUCKETS];
+	s_cache_buckets[hash % CACHE_BUCKETS] = entry;
+	entry->older = s_cache_newest;
+	if (s_cache_newest != NULL)
+		s_cache_newest->newer = entry;
+	s_cache_newest = entry;
+	if (s_cache_oldest == NULL)
+		s_cache_oldest = entry;
+	s_cache_size += size;
+}
+
+static void
+evict_spriteset(void)
+{
+	struct cache_entry*  entry;
+	struct cache_entry** p_link;
+
+	entry = s_cache_oldest;
+	console_log(3, "evicting spriteset #%u from cache", entry->spriteset->id);
+	p_link = &s_cache_buckets[entry->hash % CACHE_BUCKETS];
+	while (*p_link != entry)
+		p_link = &(*p_link)->next;
+	*p_link = entry->next;
+	unlink_cached(entry);
+	s_cache_size -= entry->size;
+	++s_num_cache_evictions;
+	free_spriteset(entry->spriteset);
+	free(entry->key);
+	free(entry);
+}
+
+static struct cache_entry*
+find_cached(const char* key, uint32_t hash)
+{
+	struct cache_entry* entry;
+
+	for (entry = s_cache_buckets[hash % CACHE_BUCKETS]; entry != NULL; entry = entry->next) {
+		if (entry->hash != hash || strcmp(entry->key, key) != 0)
+			continue;
+
+		// move it to the front of the recency list
+		if (entry != s_cache_newest) {
+			unlink_cached(entry);
+			entry->older = s_cache_newest;
+			s_cache_newest->newer = entry;
+			s_cache_newest = entry;
+			if (s_cache_oldest == NULL)
+				s_cache_oldest = entry;
 		}
-		if (name_to_find != alt_name)
-			name_to_find = alt_name;
-		else
-			break;
+		return entry;
 	}
-	return pose != NULL ? pose : &spriteset->poses[0];
+	return NULL;
+}
+
+static bool
+read_images(spriteset_t* spriteset, sfs_file_t* file, int width, int height)
+{
+	// reads spriteset->num_images frames of the same size stored back to back,
+	// as in RSSv1 and RSSv3.  the pixels are hashed first so that frames
+	// repeated across directions only take up atlas space once.
+
+	atlas_t*  atlas = NULL;
+	long      file_pos;
+	uint64_t* hashes = NULL;
+	int*      heights = NULL;
+	int*      widths = NULL;
+
+	int i;
+
+	file_pos = sfs_ftell(file);
+	if (!(widths = malloc(spriteset->num_images * sizeof(int))))
+		goto on_error;
+	if (!(heights = malloc(spriteset->num_images * sizeof(int))))
+		goto on_error;
+	if (!(hashes = malloc(spriteset->num_images * sizeof(uint64_t))))
+		goto on_error;
+	for (i = 0; i < spriteset->num_images; ++i) {
+		widths[i] = width;
+		heights[i] = height;
+		if (!atlas_hash_image(file, width, height, &hashes[i]))
+			goto on_error;
+	}
+	sfs_fseek(file, file_pos, SFS_SEEK_SET);
+	if (!(atlas = atlas_new_packed(spriteset->num_images, widths, heights, hashes)))
+		goto on_error;
+	atlas_lock(atlas);
+	for (i = 0; i < spriteset->num_images; ++i) {
+		if (!(spriteset->images[i] = atlas_load(atlas, file, i, width, height)))
+			goto on_error;
+	}
+	atlas_unlock(atlas);
+	atlas_free(atlas);
+	free(hashes);
+	free(heights);
+	free(widths);
+	return true;
+
+on_error:
+	atlas_free(atlas);
+	free(hashes);
+	free(heights);
+	free(widths);
+	return false;
+}
+
+static void
+unlink_cached(struct cache_entry* entry)
+{
+	// removes an entry from the recency list only; the hash chain is untouched
+
+	if (entry->newer != NULL)
+		entry->newer->older = entry->older;
+	else
+		s_cache_newest = entry->older;
+	if (entry->older != NULL)
+		entry->older->newer = entry->newer;
+	else
+		s_cache_oldest = entry->newer;
+	entry->newer = entry->older = NULL;
 }
 
 void
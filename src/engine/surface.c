@@ -1,7 +1,9 @@
 #include "minisphere.h"
 #include "api.h"
+#include "bytearray.h"
 #include "color.h"
 #include "image.h"
+#include "raster.h"
 
 #include "surface.h"
 
@@ -13,15 +15,18 @@ static void reset_blender    (void);
 static duk_ret_t js_GrabSurface               (duk_context* ctx);
 static duk_ret_t js_CreateSurface             (duk_context* ctx);
 static duk_ret_t js_LoadSurface               (duk_context* ctx);
+static duk_ret_t js_LoadSurfaceAsync          (duk_context* ctx);
 static duk_ret_t js_new_Surface               (duk_context* ctx);
 static duk_ret_t js_Surface_finalize          (duk_context* ctx);
 static duk_ret_t js_Surface_get_height        (duk_context* ctx);
 static duk_ret_t js_Surface_get_width         (duk_context* ctx);
 static duk_ret_t js_Surface_toString          (duk_context* ctx);
 static duk_ret_t js_Surface_getPixel          (duk_context* ctx);
+static duk_ret_t js_Surface_getPixels         (duk_context* ctx);
 static duk_ret_t js_Surface_setAlpha          (duk_context* ctx);
 static duk_ret_t js_Surface_setBlendMode      (duk_context* ctx);
 static duk_ret_t js_Surface_setPixel          (duk_context* ctx);
+static duk_ret_t js_Surface_setPixels         (duk_context* ctx);
 static duk_ret_t js_Surface_applyColorFX      (duk_context* ctx);
 static duk_ret_t js_Surface_applyColorFX4     (duk_context* ctx);
 static duk_ret_t js_Surface_applyLookup       (duk_context* ctx);
@@ -67,14 +72,17 @@ init_surface_api(void)
 	// register Surface methods and properties
 	api_register_method(g_duk, NULL, "CreateSurface", js_CreateSurface);
 	api_register_method(g_duk, NULL, "LoadSurface", js_LoadSurface);
+	api_register_method(g_duk, NULL, "LoadSurfaceAsync", js_LoadSurfaceAsync);
 	api_register_ctor(g_duk, "Surface", js_new_Surface, js_Surface_finalize);
 	api_register_method(g_duk, "Surface", "toString", js_Surface_toString);
 	api_register_prop(g_duk, "Surface", "height", js_Surface_get_height, NULL);
 	api_register_prop(g_duk, "Surface", "width", js_Surface_get_width, NULL);
 	api_register_method(g_duk, "Surface", "getPixel", js_Surface_getPixel);
+	api_register_method(g_duk, "Surface", "getPixels", js_Surface_getPixels);
 	api_register_method(g_duk, "Surface", "setAlpha", js_Surface_setAlpha);
 	api_register_method(g_duk, "Surface", "setBlendMode", js_Surface_setBlendMode);
 	api_register_method(g_duk, "Surface", "setPixel", js_Surface_setPixel);
+	api_register_method(g_duk, "Surface", "setPixels", js_Surface_setPixels);
 	api_register_method(g_duk, "Surface", "applyColorFX", js_Surface_applyColorFX);
 	api_register_method(g_duk, "Surface", "applyColorFX4", js_Surface_applyColorFX4);
 	api_register_method(g_duk, "Surface", "applyLookup", js_Surface_applyLookup);
@@ -188,14 +196,37 @@ js_LoadSurface(duk_context* ctx)
 
 	const char* filename;
 	image_t*    image;
+	image_t*    src_image;
 
+	// load_image() may return a cached image, so the surface gets its own copy
 	filename = duk_require_path(ctx, 0, "images", true);
-	if (!(image = load_image(filename)))
+	if (!(src_image = load_image(filename)))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "LoadSurface(): unable to load image file `%s`", filename);
+	image = clone_image(src_image);
+	free_image(src_image);
+	if (image == NULL)
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "LoadSurface(): unable to create surface");
 	duk_push_sphere_obj(ctx, "Surface", image);
 	return 1;
 }
 
+static duk_ret_t
+js_LoadSurfaceAsync(duk_context* ctx)
+{
+	// LoadSurfaceAsync(filename, callback);
+	// Loads an image file in the background and calls `callback` with a new
+	// Surface object, or null if the file couldn't be decoded, once it's ready.
+	// Arguments:
+	//     filename: The name of the image file, relative to @/images.
+	//     callback: A function to call with the Surface.
+
+	const char* filename;
+
+	filename = duk_require_path(ctx, 0, "images", true);
+	duk_load_image_async(ctx, filename, 1, true);
+	return 0;
+}
+
 static duk_ret_t
 js_new_Surface(duk_context* ctx)
 {
@@ -203,6 +234,7 @@ js_new_Surface(duk_context* ctx)
 	const char* filename;
 	color_t     fill_color;
 	image_t*    image;
+	bool        is_soft;
 	image_t*    src_image;
 	int         width, height;
 
@@ -211,7 +243,9 @@ js_new_Surface(duk_context* ctx)
 		width = duk_require_int(ctx, 0);
 		height = duk_require_int(ctx, 1);
 		fill_color = n_args >= 3 ? duk_require_sphere_color(ctx, 2) : color_new(0, 0, 0, 0);
-		if (!(image = create_image(width, height)))
+		is_soft = n_args >= 4 ? duk_require_boolean(ctx, 3) : false;
+		image = is_soft ? create_soft_image(width, height) : create_image(width, height);
+		if (image == NULL)
 			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface(): unable to create new surface");
 		fill_image(image, fill_color);
 	}
@@ -222,9 +256,12 @@ js_new_Surface(duk_context* ctx)
 	}
 	else {
 		filename = duk_require_path(ctx, 0, NULL, false);
-		image = load_image(filename);
-		if (image == NULL)
+		if (!(src_image = load_image(filename)))
 			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface(): unable to load image file `%s`", filename);
+		image = clone_image(src_image);
+		free_image(src_image);
+		if (image == NULL)
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface(): unable to create surface");
 	}
 	duk_push_sphere_obj(ctx, "Surface", image);
 	return 1;
@@ -287,6 +324,43 @@ js_Surface_setPixel(duk_context* ctx)
 	return 0;
 }
 
+static duk_ret_t
+js_Surface_setPixels(duk_context* ctx)
+{
+	bytearray_t* array;
+	void*        buffer;
+	duk_size_t   buffer_size;
+	int          h;
+	image_t*     image;
+	int          w;
+	int          x;
+	int          y;
+
+	duk_push_this(ctx);
+	image = duk_require_sphere_obj(ctx, -1, "Surface");
+	x = duk_require_int(ctx, 0);
+	y = duk_require_int(ctx, 1);
+	w = duk_require_int(ctx, 2);
+	h = duk_require_int(ctx, 3);
+	if (duk_is_sphere_obj(ctx, 4, "ByteArray")) {
+		array = duk_require_sphere_bytearray(ctx, 4);
+		buffer = get_bytearray_buffer(array);
+		buffer_size = get_bytearray_size(array);
+	}
+	else
+		buffer = duk_require_buffer_data(ctx, 4, &buffer_size);
+
+	// `x + w` could overflow, so the area is checked against what's left of
+	// the surface instead.
+	if (w < 0 || h < 0 || x < 0 || y < 0 || w > get_image_width(image) - x || h > get_image_height(image) - y)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Surface:setPixels(): area extends past surface (%i,%i,%i,%i)", x, y, w, h);
+	if (buffer_size < (duk_size_t)w * h * sizeof(color_t))
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Surface:setPixels(): buffer is too small for %ix%i area", w, h);
+	if (!set_image_pixels(image, x, y, w, h, buffer))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:setPixels(): unable to lock surface for writing");
+	return 0;
+}
+
 static duk_ret_t
 js_Surface_getPixel(duk_context* ctx)
 {
@@ -311,6 +385,40 @@ js_Surface_getPixel(duk_context* ctx)
 	return 1;
 }
 
+static duk_ret_t
+js_Surface_getPixels(duk_context* ctx)
+{
+	bytearray_t* array;
+	int          h;
+	image_t*     image;
+	int          w;
+	int          x;
+	int          y;
+
+	duk_push_this(ctx);
+	image = duk_require_sphere_obj(ctx, -1, "Surface");
+	x = duk_require_int(ctx, 0);
+	y = duk_require_int(ctx, 1);
+	w = duk_require_int(ctx, 2);
+	h = duk_require_int(ctx, 3);
+
+	// `x + w` could overflow, so the area is checked against what's left of
+	// the surface instead.
+	if (w < 0 || h < 0 || x < 0 || y < 0 || w > get_image_width(image) - x || h > get_image_height(image) - y)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Surface:getPixels(): area extends past surface (%i,%i,%i,%i)", x, y, w, h);
+	if ((uint64_t)w * h * sizeof(color_t) > INT_MAX)
+		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Surface:getPixels(): area is too large (%ix%i)", w, h);
+	if (!(array = new_bytearray((int)(w * h * sizeof(color_t)))))
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:getPixels(): unable to allocate byte array");
+	if (!get_image_pixels(image, x, y, w, h, (color_t*)get_bytearray_buffer(array))) {
+		free_bytearray(array);
+		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:getPixels(): unable to lock surface for reading");
+	}
+	duk_push_sphere_bytearray(ctx, array);
+	free_bytearray(array);
+	return 1;
+}
+
 static duk_ret_t
 js_Surface_applyColorFX(duk_context* ctx)
 {
@@ -421,8 +529,13 @@ js_Surface_blitMaskSurface(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 
+	if (is_image_soft(image)) {
+		if (!raster_blit(image, blend_mode, src_image, x, y, mask))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:blitMaskSurface(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_tinted_bitmap(get_image_bitmap(src_image), nativecolor(mask), x, y, 0x0);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -444,8 +557,13 @@ js_Surface_blitSurface(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 
+	if (is_image_soft(image)) {
+		if (!raster_blit(image, blend_mode, src_image, x, y, color_new(255, 255, 255, 255)))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:blitSurface(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_bitmap(get_image_bitmap(src_image), x, y, 0x0);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -484,9 +602,17 @@ js_Surface_cloneSection(duk_context* ctx)
 	width = duk_require_int(ctx, 2);
 	height = duk_require_int(ctx, 3);
 
+	if (is_image_soft(image)) {
+		if ((new_image = create_soft_image(width, height)) == NULL)
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:cloneSection(): unable to create surface");
+		fill_image(new_image, color_new(0, 0, 0, 0));
+		raster_blit(new_image, BLEND_REPLACE, image, -x, -y, color_new(255, 255, 255, 255));
+		duk_push_sphere_obj(ctx, "Surface", new_image);
+		return 1;
+	}
 	if ((new_image = create_image(width, height)) == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:cloneSection(): unable to create surface");
-	al_set_target_bitmap(get_image_bitmap(new_image));
+	al_set_target_bitmap(get_image_target(new_image));
 	al_draw_bitmap_region(get_image_bitmap(image), x, y, width, height, 0, 0, 0x0);
 	al_set_target_backbuffer(screen_display(g_screen));
 	duk_push_sphere_obj(ctx, "Surface", new_image);
@@ -502,7 +628,14 @@ js_Surface_createImage(duk_context* ctx)
 	duk_push_this(ctx);
 	image = duk_require_sphere_obj(ctx, -1, "Surface");
 
-	if ((new_image = clone_image(image)) == NULL)
+	if (is_image_soft(image)) {
+		// Images are always drawn from video memory, so upload the pixels now
+		if ((new_image = create_image(get_image_width(image), get_image_height(image))) != NULL)
+			blit_image(image, new_image, 0, 0);
+	}
+	else
+		new_image = clone_image(image);
+	if (new_image == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:createImage(): unable to create image");
 	duk_push_sphere_image(ctx, new_image);
 	free_image(new_image);
@@ -520,6 +653,9 @@ js_Surface_drawText(duk_context* ctx)
 	int      blend_mode;
 	color_t  color;
 	image_t* image;
+	bool     is_ok;
+	image_t* text_image;
+	int      width;
 
 	duk_push_this(ctx);
 	image = duk_require_sphere_obj(ctx, -1, "Surface");
@@ -527,8 +663,27 @@ js_Surface_drawText(duk_context* ctx)
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 
 	duk_get_prop_string(ctx, 0, "\xFF" "color_mask"); color = duk_require_sphere_color(ctx, -1); duk_pop(ctx);
+	if (is_image_soft(image)) {
+		// glyphs are video bitmaps, so render the whole string on the GPU first and
+		// read it back once rather than once per glyph.
+		if ((width = get_text_width(font, text)) <= 0)
+			return 0;
+		if (!(text_image = create_image(width, get_font_line_height(font))))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:drawText(): unable to create text image");
+		fill_image(text_image, color_new(0, 0, 0, 0));
+		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+		al_set_target_bitmap(get_image_target(text_image));
+		draw_text(font, color, 0, 0, TEXT_ALIGN_LEFT, text);
+		al_set_target_backbuffer(screen_display(g_screen));
+		reset_blender();
+		is_ok = raster_blit(image, blend_mode, text_image, x, y, color_new(255, 255, 255, 255));
+		free_image(text_image);
+		if (!is_ok)
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:drawText(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	draw_text(font, color, x, y, TEXT_ALIGN_LEFT, text);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -551,8 +706,13 @@ js_Surface_filledCircle(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_fill_circle(image, blend_mode, x, y, radius, color))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:filledCircle(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_filled_circle(x, y, radius, nativecolor(color));
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -606,8 +766,13 @@ js_Surface_gradientCircle(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_gradient_circle(image, blend_mode, x, y, radius, in_color, out_color))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:gradientCircle(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	vcount = fmin(radius, 126);
 	s_vbuf[0].x = x; s_vbuf[0].y = y; s_vbuf[0].z = 0;
 	s_vbuf[0].color = nativecolor(in_color);
@@ -648,8 +813,13 @@ js_Surface_gradientRectangle(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_gradient_rect(image, blend_mode, x1, y1, x2 - x1, y2 - y1, color_ul, color_ur, color_ll, color_lr))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:gradientRectangle(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	
 	ALLEGRO_VERTEX verts[] = {
 		{ x1, y1, 0, 0, 0, nativecolor(color_ul) },
@@ -680,8 +850,13 @@ js_Surface_line(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_line(image, blend_mode, floor(x1), floor(y1), floor(x2), floor(y2), color))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:line(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_line(x1, y1, x2, y2, nativecolor(color), 1);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -704,8 +879,13 @@ js_Surface_outlinedCircle(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_circle(image, blend_mode, x, y, radius, color))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:outlinedCircle(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_circle(x, y, radius, nativecolor(color), 1);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -719,6 +899,7 @@ js_Surface_pointSeries(duk_context* ctx)
 	
 	int             blend_mode;
 	image_t*        image;
+	image_lock_t*   lock;
 	size_t          num_points;
 	int             x, y;
 	ALLEGRO_VERTEX* vertices;
@@ -733,21 +914,32 @@ js_Surface_pointSeries(duk_context* ctx)
 	duk_pop(ctx);
 	if (!duk_is_array(ctx, 0))
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:pointSeries(): first argument must be an array");
-	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, 0); duk_pop(ctx);
+	duk_get_prop_string(ctx, 0, "length"); num_points = duk_get_uint(ctx, -1); duk_pop(ctx);
 	if (num_points > INT_MAX)
 		duk_error_ni(ctx, -1, DUK_ERR_RANGE_ERROR, "Surface:pointSeries(): too many vertices (%u)", num_points);
 	vertices = calloc(num_points, sizeof(ALLEGRO_VERTEX));
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		duk_get_prop_index(ctx, 0, i);
-		duk_get_prop_string(ctx, 0, "x"); x = duk_require_int(ctx, -1); duk_pop(ctx);
-		duk_get_prop_string(ctx, 0, "y"); y = duk_require_int(ctx, -1); duk_pop(ctx);
+		duk_get_prop_string(ctx, -1, "x"); x = duk_require_int(ctx, -1); duk_pop(ctx);
+		duk_get_prop_string(ctx, -1, "y"); y = duk_require_int(ctx, -1); duk_pop(ctx);
 		duk_pop(ctx);
 		vertices[i].x = x + 0.5; vertices[i].y = y + 0.5;
 		vertices[i].color = vtx_color;
 	}
+	if (is_image_soft(image)) {
+		if (!(lock = lock_image(image))) {
+			free(vertices);
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:pointSeries(): unable to lock surface");
+		}
+		for (i = 0; i < num_points; ++i)
+			raster_point(image, blend_mode, floor(vertices[i].x), floor(vertices[i].y), color);
+		unlock_image(image, lock);
+		free(vertices);
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_prim(vertices, NULL, NULL, 0, (int)num_points, ALLEGRO_PRIM_POINT_LIST);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -774,8 +966,13 @@ js_Surface_outlinedRectangle(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_outline_rect(image, blend_mode, floor(x1), floor(y1), x2 - x1 + 1, y2 - y1 + 1, thickness, color))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:outlinedRectangle(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_rectangle(x1, y1, x2, y2, nativecolor(color), thickness);
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -835,9 +1032,10 @@ js_Surface_rotate(duk_context* ctx)
 	if (want_resize) {
 		// TODO: implement in-place resizing for Surface:rotate()
 	}
-	if ((new_image = create_image(new_w, new_h)) == NULL)
+	new_image = is_image_soft(image) ? create_soft_image(new_w, new_h) : create_image(new_w, new_h);
+	if (new_image == NULL)
 		duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:rotate() - Failed to create new surface bitmap");
-	al_set_target_bitmap(get_image_bitmap(new_image));
+	al_set_target_bitmap(get_image_target(new_image));
 	al_draw_rotated_bitmap(get_image_bitmap(image), (float)w / 2, (float)h / 2, (float)new_w / 2, (float)new_h / 2, angle, 0x0);
 	al_set_target_backbuffer(screen_display(g_screen));
 	
@@ -845,7 +1043,7 @@ js_Surface_rotate(duk_context* ctx)
 	// at one time this was an acceptable thing to do; now it's just a hack
 	free_image(image);
 	duk_push_this(ctx);
-	duk_push_pointer(ctx, new_image); duk_put_prop_string(ctx, -2, "\xFF" "udata");
+	duk_set_sphere_udata(ctx, -1, new_image);
 	return 1;
 }
 
@@ -866,8 +1064,13 @@ js_Surface_rectangle(duk_context* ctx)
 	duk_get_prop_string(ctx, -1, "\xFF" "blend_mode");
 	blend_mode = duk_get_int(ctx, -1); duk_pop(ctx);
 	duk_pop(ctx);
+	if (is_image_soft(image)) {
+		if (!raster_rect(image, blend_mode, x, y, w, h, color))
+			duk_error_ni(ctx, -1, DUK_ERR_ERROR, "Surface:rectangle(): unable to lock surface");
+		return 0;
+	}
 	apply_blend_mode(blend_mode);
-	al_set_target_bitmap(get_image_bitmap(image));
+	al_set_target_bitmap(get_image_target(image));
 	al_draw_filled_rectangle(x, y, x + w, y + h, nativecolor(color));
 	al_set_target_backbuffer(screen_display(g_screen));
 	reset_blender();
@@ -9,9 +9,7 @@ struct tileset
 {
 	unsigned int id;
 	atlas_t*     atlas;
-	int          atlas_pitch;
 	int          height;
-	image_t*     texture;
 	int          num_tiles;
 	struct tile* tiles;
 	int          width;
@@ -84,11 +82,15 @@ tileset_read(sfs_file_t* file)
 {
 	atlas_t*               atlas = NULL;
 	long                   file_pos;
+	uint64_t*              hashes = NULL;
+	int*                   heights = NULL;
 	struct rts_header      rts;
 	rect_t                 segment;
 	struct rts_tile_header tilehdr;
 	struct tile*           tiles = NULL;
 	tileset_t*             tileset = NULL;
+	long                   tiles_pos;
+	int*                   widths = NULL;
 
 	int i, j;
 
@@ -106,9 +108,28 @@ tileset_read(sfs_file_t* file)
 	if (rts.tile_bpp != 32) goto on_error;
 	if (!(tiles = calloc(rts.num_tiles, sizeof(struct tile)))) goto on_error;
 	
-	// read in all the tile bitmaps (use atlasing)
-	if (!(atlas = atlas_new(rts.num_tiles, rts.tile_width, rts.tile_height)))
+	// read in all the tile bitmaps (use atlasing).  editors often export
+	// tilesets with many identical tiles, so hash them first to let the atlas
+	// store each distinct tile only once.
+	if (!(widths = malloc(rts.num_tiles * sizeof(int))))
 		goto on_error;
+	if (!(heights = malloc(rts.num_tiles * sizeof(int))))
+		goto on_error;
+	if (!(hashes = malloc(rts.num_tiles * sizeof(uint64_t))))
+		goto on_error;
+	tiles_pos = sfs_ftell(file);
+	for (i = 0; i < rts.num_tiles; ++i) {
+		widths[i] = rts.tile_width;
+		heights[i] = rts.tile_height;
+		if (!atlas_hash_image(file, rts.tile_width, rts.tile_height, &hashes[i]))
+			goto on_error;
+	}
+	sfs_fseek(file, tiles_pos, SFS_SEEK_SET);
+	if (!(atlas = atlas_new_packed(rts.num_tiles, widths, heights, hashes)))
+		goto on_error;
+	free(hashes); hashes = NULL;
+	free(heights); heights = NULL;
+	free(widths); widths = NULL;
 	atlas_lock(atlas);
 	for (i = 0; i < rts.num_tiles; ++i)
 		if (!(tiles[i].image = atlas_load(atlas, file, i, rts.tile_width, rts.tile_height)))
@@ -166,6 +187,9 @@ on_error:  // oh no!
 		free(tileset->tiles);
 	}
 	atlas_free(atlas);
+	free(hashes);
+	free(heights);
+	free(widths);
 	free(tileset);
 	return NULL;
 }
@@ -256,10 +280,21 @@ tileset_set_image(tileset_t* tileset, int tile_index, image_t* image)
 	//     replaces.  if it's not, the engine won't crash, but it may cause graphical
 	//     glitches.
 	
-	rect_t xy;
+	image_t* new_image;
+	rect_t   xy;
 	
+	// identical tiles share a slot in the atlas.  writing over it would change
+	// all of them, so in that case the tile gets an image of its own instead.
+	if (atlas_is_slot_shared(tileset->atlas, tile_index)) {
+		if (!(new_image = clone_image(image)))
+			return;
+		free_image(tileset->tiles[tile_index].image);
+		tileset->tiles[tile_index].image = new_image;
+		return;
+	}
 	xy = atlas_xy(tileset->atlas, tile_index);
-	blit_image(image, tileset->texture, xy.x1, xy.y1);
+	blit_image(image, atlas_image(tileset->atlas, atlas_page(tileset->atlas, tile_index)),
+		xy.x1, xy.y1);
 }
 
 bool
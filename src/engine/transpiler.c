@@ -2,16 +2,39 @@
 #include "transpiler.h"
 
 #include "debugger.h"
+#include "utility.h"
 
-static bool load_coffeescript (void);
-static bool load_typescript   (void);
+// the compilers are large and slow to evaluate, so they aren't loaded until
+// the first script which needs one comes along.  the JS they produce is cached
+// on disk, keyed on the compiler, its options and the file it came from.
+
+struct compiler
+{
+	const char* name;
+	const char* script;
+	bool        (*load)(void);
+	bool        is_hashed;
+	bool        is_tried;
+	bool        is_loaded;
+	uint64_t    hash;
+};
+
+static bool       load_coffeescript (void);
+static bool       load_typescript   (void);
+static bool       use_compiler      (struct compiler* compiler);
+static char*      make_cache_key    (struct compiler* compiler, const char* filename, const char* options);
+static lstring_t* read_cached_js    (struct compiler* compiler, const char* filename, const char* options, const lstring_t* source);
+static void       write_cached_js   (struct compiler* compiler, const char* filename, const char* options, const lstring_t* source, const lstring_t* js_text);
+
+static struct compiler s_coffeescript = { "CoffeeScript", "#/coffee-script.js", load_coffeescript };
+static struct compiler s_typescript = { "TypeScript", "#/typescriptServices.js", load_typescript };
 
 void
 initialize_transpiler(void)
 {
 	console_log(1, "initializing JS transpiler");
-	load_coffeescript();
-	load_typescript();
+	s_coffeescript.is_hashed = s_coffeescript.is_tried = s_coffeescript.is_loaded = false;
+	s_typescript.is_hashed = s_typescript.is_tried = s_typescript.is_loaded = false;
 }
 
 void
@@ -30,7 +53,9 @@ transpile_to_js(lstring_t** p_source, const char* filename)
 	// now, Monster drinks on the other hand...
 	extension = strrchr(filename, '.');
 	if (extension != NULL && strcasecmp(extension, ".coffee") == 0) {
-		if (!duk_get_global_string(g_duk, "CoffeeScript")) {
+		if (js_text = read_cached_js(&s_coffeescript, filename, "bare", *p_source))
+			goto have_js;
+		if (!use_compiler(&s_coffeescript) || !duk_get_global_string(g_duk, "CoffeeScript")) {
 			duk_pop(g_duk);
 			duk_push_error_object(g_duk, DUK_ERR_ERROR, "no CoffeeScript support (%s)", filename);
 			goto on_error;
@@ -47,14 +72,15 @@ transpile_to_js(lstring_t** p_source, const char* filename)
 			goto on_error;
 		}
 		js_text = duk_require_lstring_t(g_duk, -1);
-		cache_source(filename, js_text);
 		duk_pop_2(g_duk);
-		lstr_free(*p_source);
-		*p_source = js_text;
+		write_cached_js(&s_coffeescript, filename, "bare", *p_source, js_text);
+		goto have_js;
 	}
 	// TypeScript?
 	else if (extension != NULL && strcasecmp(extension, ".ts") == 0) {
-		if (!duk_get_global_string(g_duk, "ts")) {
+		if (js_text = read_cached_js(&s_typescript, filename, "noImplicitUseStrict", *p_source))
+			goto have_js;
+		if (!use_compiler(&s_typescript) || !duk_get_global_string(g_duk, "ts")) {
 			duk_pop(g_duk);
 			duk_push_error_object(g_duk, DUK_ERR_ERROR, "no TypeScript support (%s)", filename);
 			goto on_error;
@@ -70,13 +96,18 @@ transpile_to_js(lstring_t** p_source, const char* filename)
 			goto on_error;
 		}
 		js_text = duk_require_lstring_t(g_duk, -1);
-		cache_source(filename, js_text);
 		duk_pop_2(g_duk);
-		lstr_free(*p_source);
-		*p_source = js_text;
+		write_cached_js(&s_typescript, filename, "noImplicitUseStrict", *p_source, js_text);
+		goto have_js;
 	}
 	return true;
 
+have_js:
+	cache_source(filename, js_text);
+	lstr_free(*p_source);
+	*p_source = js_text;
+	return true;
+
 on_error:
 	// note: when we return false, the caller expects the JS error which caused the
 	//       operation to fail to be left on top of the Duktape value stack.
@@ -146,3 +177,66 @@ on_error:
 	console_log(1, "    TypeScript support not enabled");
 	return false;
 }
+
+static bool
+use_compiler(struct compiler* compiler)
+{
+	if (!compiler->is_tried) {
+		compiler->is_tried = true;
+		console_log(1, "loading %s compiler on first use", compiler->name);
+		compiler->is_loaded = compiler->load();
+	}
+	return compiler->is_loaded;
+}
+
+static char*
+make_cache_key(struct compiler* compiler, const char* filename, const char* options)
+{
+	void*  slurp;
+	size_t size;
+
+	// the hash of the compiler script stands in for its version, since reading
+	// the version means evaluating the compiler, which is what the cache is
+	// there to avoid.
+	if (!compiler->is_hashed) {
+		if (!(slurp = sfs_fslurp(g_fs, compiler->script, NULL, &size)))
+			return NULL;
+		compiler->hash = memhash(slurp, size);
+		compiler->is_hashed = true;
+		free(slurp);
+	}
+	return strnewf("%s|%016llx|%s|%s|%s", compiler->name, (unsigned long long)compiler->hash,
+		options, path_cstr(g_game_path), filename);
+}
+
+static lstring_t*
+read_cached_js(struct compiler* compiler, const char* filename, const char* options, const lstring_t* source)
+{
+	void*      buffer;
+	char*      cache_key;
+	lstring_t* js_text;
+	size_t     size;
+
+	if (!(cache_key = make_cache_key(compiler, filename, options)))
+		return NULL;
+	buffer = read_cache_file("transpile", cache_key, memhash(lstr_cstr(source), lstr_len(source)), &size);
+	free(cache_key);
+	if (buffer == NULL)
+		return NULL;
+	js_text = lstr_from_buf(buffer, size);
+	free(buffer);
+	console_log(3, "using cached %s output for `%s`", compiler->name, filename);
+	return js_text;
+}
+
+static void
+write_cached_js(struct compiler* compiler, const char* filename, const char* options, const lstring_t* source, const lstring_t* js_text)
+{
+	char* cache_key;
+
+	if (!(cache_key = make_cache_key(compiler, filename, options)))
+		return;
+	write_cache_file("transpile", cache_key, memhash(lstr_cstr(source), lstr_len(source)),
+		lstr_cstr(js_text), lstr_len(js_text));
+	free(cache_key);
+}
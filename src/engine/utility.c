@@ -3,6 +3,22 @@
 
 #include "utility.h"
 
+#pragma pack(push, 1)
+struct cache_header
+{
+	char     signature[4];
+	char     engine[32];
+	uint64_t hash;
+	uint64_t data_hash;
+	uint32_t data_size;
+	uint16_t key_length;
+	uint8_t  reserved[2];
+};
+#pragma pack(pop)
+
+static path_t* make_cache_path   (const char* category, const char* key);
+static void    get_cache_version (char out_version[32]);
+
 const path_t*
 enginepath(void)
 {
@@ -112,6 +128,134 @@ strnewf(const char* fmt, ...)
 	return buffer;
 }
 
+uint64_t
+memhash(const void* buffer, size_t size)
+{
+	// 64-bit FNV-1a.  this isn't cryptographic, it's only used to tell whether
+	// something has changed.
+
+	const uint8_t* p = buffer;
+	uint64_t       hash = 14695981039346656037ULL;
+
+	size_t i;
+
+	for (i = 0; i < size; ++i)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	return hash;
+}
+
+void*
+read_cache_file(const char* category, const char* key, uint64_t hash, size_t* out_size)
+{
+	// reads back data saved by write_cache_file() under the same category and
+	// key.  returns NULL if there's no cache entry or it's stale: it was saved
+	// for a different `hash`, by another engine or Duktape version, or it's
+	// been corrupted.
+
+	void*               buffer = NULL;
+	ALLEGRO_FILE*       file = NULL;
+	struct cache_header header;
+	char*               key_buffer = NULL;
+	path_t*             path;
+	char                version[32];
+
+	path = make_cache_path(category, key);
+	if (!(file = al_fopen(path_cstr(path), "rb")))
+		goto on_error;
+	get_cache_version(version);
+	if (al_fread(file, &header, sizeof(struct cache_header)) != sizeof(struct cache_header))
+		goto on_error;
+	if (memcmp(header.signature, ".msc", 4) != 0 || memcmp(header.engine, version, 32) != 0)
+		goto on_error;
+	if (header.hash != hash || header.key_length != strlen(key))
+		goto on_error;
+	if (!(key_buffer = malloc(header.key_length)) || !(buffer = malloc(header.data_size + 1)))
+		goto on_error;
+	if (al_fread(file, key_buffer, header.key_length) != header.key_length
+		|| memcmp(key_buffer, key, header.key_length) != 0)
+	{
+		goto on_error;
+	}
+	if (al_fread(file, buffer, header.data_size) != header.data_size)
+		goto on_error;
+	if (memhash(buffer, header.data_size) != header.data_hash)
+		goto on_error;
+	al_fclose(file);
+	free(key_buffer);
+	path_free(path);
+	*out_size = header.data_size;
+	return buffer;
+
+on_error:
+	if (file != NULL)
+		al_fclose(file);
+	free(buffer);
+	free(key_buffer);
+	path_free(path);
+	return NULL;
+}
+
+bool
+write_cache_file(const char* category, const char* key, uint64_t hash, const void* data, size_t size)
+{
+	// the file is written under a temporary name first, so an engine which is
+	// killed partway through can never leave a truncated entry behind.
+
+	ALLEGRO_FILE*       file = NULL;
+	char*               filename = NULL;
+	struct cache_header header;
+	path_t*             path;
+
+	if (size > UINT32_MAX || strlen(key) > UINT16_MAX)
+		return false;
+	path = make_cache_path(category, key);
+	path_mkdir(path);
+	filename = strnewf("%s.tmp", path_cstr(path));
+	memset(&header, 0, sizeof(struct cache_header));
+	memcpy(header.signature, ".msc", 4);
+	get_cache_version(header.engine);
+	header.hash = hash;
+	header.data_hash = memhash(data, size);
+	header.data_size = (uint32_t)size;
+	header.key_length = (uint16_t)strlen(key);
+	if (!(file = al_fopen(filename, "wb")))
+		goto on_error;
+	if (al_fwrite(file, &header, sizeof(struct cache_header)) != sizeof(struct cache_header)
+		|| al_fwrite(file, key, header.key_length) != header.key_length
+		|| al_fwrite(file, data, size) != size)
+	{
+		goto on_error;
+	}
+	al_fclose(file); file = NULL;
+	remove(path_cstr(path));
+	if (rename(filename, path_cstr(path)) != 0)
+		goto on_error;
+	free(filename);
+	path_free(path);
+	return true;
+
+on_error:
+	console_log(2, "unable to write `%s` to %s cache", key, category);
+	if (file != NULL)
+		al_fclose(file);
+	remove(filename);
+	free(filename);
+	path_free(path);
+	return false;
+}
+
+uint32_t
+strhash(const char* string)
+{
+	// 32-bit FNV-1a, good enough for cache keys
+
+	uint32_t hash = 2166136261u;
+
+	while (*string != '\0')
+		hash = (hash ^ (uint8_t)*string++) * 16777619u;
+	return hash;
+}
+
 void
 duk_push_lstring_t(duk_context* ctx, const lstring_t* string)
 {
@@ -150,3 +294,26 @@ duk_require_path(duk_context* ctx, duk_idx_t index, const char* origin_name, boo
 	s_index = (s_index + 1) % 10;
 	return path_cstr(path);
 }
+
+static path_t*
+make_cache_path(const char* category, const char* key)
+{
+	// cache entries are named after a hash of the key.  the key itself is also
+	// stored in the file, so a hash collision just looks like a stale entry.
+
+	char    filename[32];
+	path_t* path;
+
+	sprintf(filename, "%016llx.bin", (unsigned long long)memhash(key, strlen(key)));
+	path = path_rebase(path_new("minisphere/.cache/"), homepath());
+	path_append_dir(path, category);
+	path_append(path, filename);
+	return path;
+}
+
+static void
+get_cache_version(char out_version[32])
+{
+	memset(out_version, 0, 32);
+	snprintf(out_version, 32, "%s %s/%ld", PRODUCT_NAME, VERSION_NAME, (long)DUK_VERSION);
+}
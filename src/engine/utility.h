@@ -9,8 +9,12 @@ bool        is_cpu_little_endian  (void);
 void        duk_push_lstring_t    (duk_context* ctx, const lstring_t* string);
 lstring_t*  duk_require_lstring_t (duk_context* ctx, duk_idx_t index);
 const char* duk_require_path      (duk_context* ctx, duk_idx_t index, const char* origin_name, bool legacy);
+uint64_t    memhash               (const void* buffer, size_t size);
+void*       read_cache_file       (const char* category, const char* key, uint64_t hash, size_t* out_size);
 lstring_t*  read_lstring          (sfs_file_t* file, bool trim_null);
 lstring_t*  read_lstring_raw      (sfs_file_t* file, size_t length, bool trim_null);
 char*       strnewf               (const char* fmt, ...);
+uint32_t    strhash               (const char* string);
+bool        write_cache_file      (const char* category, const char* key, uint64_t hash, const void* data, size_t size);
 
 #endif // MINISPHERE__UTILITY_H__INCLUDED
@@ -1,5 +1,6 @@
 #include "minisphere.h"
 #include "api.h"
+#include "atlas.h"
 #include "color.h"
 #include "image.h"
 
@@ -14,6 +15,9 @@ static duk_ret_t js_WindowStyle_set_colorMask (duk_context* ctx);
 static duk_ret_t js_WindowStyle_toString      (duk_context* ctx);
 static duk_ret_t js_WindowStyle_drawWindow    (duk_context* ctx);
 
+#define MAX_WINDOW_MESHES 8
+#define MAX_WINDOW_QUADS  4096
+
 static windowstyle_t* s_sys_winstyle = NULL;
 
 enum wstyle_bg_type
@@ -27,10 +31,23 @@ enum wstyle_bg_type
 
 struct windowstyle
 {
-	int       refcount;
-	int       bg_style;
-	color_t   gradient[4];
-	image_t*  images[9];
+	int          refcount;
+	int          bg_style;
+	color_t      gradient[4];
+	image_t*     images[9];
+	vector_t*    meshes;
+	image_t*     texture;
+	float_rect_t uv[10];
+};
+
+struct window_mesh
+{
+	int             width;
+	int             height;
+	color_t         mask;
+	int             num_vertices;
+	ALLEGRO_VERTEX* vertices;
+	int             x, y;
 };
 
 #pragma pack(push, 1)
@@ -51,41 +68,79 @@ struct rws_header
 };
 #pragma pack(pop)
 
+static struct window_mesh* create_window_mesh (const windowstyle_t* winstyle, int width, int height, color_t mask);
+static void                free_window_mesh   (struct window_mesh* mesh);
+static struct window_mesh* find_window_mesh   (windowstyle_t* winstyle, int width, int height, color_t mask);
+static ALLEGRO_VERTEX*     put_quad           (ALLEGRO_VERTEX* v, float x1, float y1, float x2, float y2, float_rect_t uv, ALLEGRO_COLOR color);
+static ALLEGRO_VERTEX*     put_tiles          (ALLEGRO_VERTEX* v, const windowstyle_t* winstyle, int part, int x, int y, int width, int height, ALLEGRO_COLOR color);
+
 windowstyle_t*
 load_windowstyle(const char* filename)
 {
+	// the nine parts are packed into an atlas along with a single white pixel,
+	// which lets the gradient be drawn from the same texture as everything
+	// else.  draw_window() can then send a whole window in one call.
+
+	atlas_t*          atlas = NULL;
+	long              data_pos;
 	sfs_file_t*       file;
+	int               heights[10];
 	image_t*          image;
 	struct rws_header rws;
 	int16_t           w, h;
+	int               widths[10];
 	windowstyle_t*    winstyle = NULL;
-	int               i;
+	
+	int i;
 
 	if (!(file = sfs_fopen(g_fs, filename, NULL, "rb"))) goto on_error;
 	if ((winstyle = calloc(1, sizeof(windowstyle_t))) == NULL) goto on_error;
 	if (sfs_fread(&rws, sizeof(struct rws_header), 1, file) != 1)
 		goto on_error;
 	if (memcmp(rws.signature, ".rws", 4) != 0) goto on_error;
+	data_pos = sfs_ftell(file);
 	switch (rws.version) {
 	case 1:
 		for (i = 0; i < 9; ++i) {
-			if (!(image = read_image(file, rws.edge_w_h, rws.edge_w_h)))
-				goto on_error;
-			winstyle->images[i] = image;
+			widths[i] = rws.edge_w_h;
+			heights[i] = rws.edge_w_h;
 		}
 		break;
 	case 2:
 		for (i = 0; i < 9; ++i) {
 			if (sfs_fread(&w, 2, 1, file) != 1 || sfs_fread(&h, 2, 1, file) != 1)
 				goto on_error;
-			if (!(image = read_image(file, w, h))) goto on_error;
-			winstyle->images[i] = image;
+			widths[i] = w;
+			heights[i] = h;
+			sfs_fseek(file, w * h * 4, SFS_SEEK_CUR);
 		}
 		break;
 	default:  // invalid version number
 		goto on_error;
 	}
+	widths[9] = heights[9] = 1;
+	if (!(atlas = atlas_new_packed(10, widths, heights, NULL)))
+		goto on_error;
+	sfs_fseek(file, data_pos, SFS_SEEK_SET);
+	atlas_lock(atlas);
+	for (i = 0; i < 9; ++i) {
+		if (rws.version == 2)
+			sfs_fseek(file, 4, SFS_SEEK_CUR);  // part size, already known
+		if (!(image = atlas_load(atlas, file, i, widths[i], heights[i])))
+			goto on_error;
+		winstyle->images[i] = image;
+		winstyle->uv[i] = atlas_uv(atlas, i);
+	}
+	atlas_unlock(atlas);
 	sfs_fclose(file);
+	file = NULL;
+	winstyle->uv[9] = atlas_uv(atlas, 9);
+	if (atlas_num_pages(atlas) == 1) {
+		winstyle->texture = ref_image(atlas_image(atlas, 0));
+		set_image_pixel(winstyle->texture, winstyle->uv[9].x1, winstyle->uv[9].y1,
+			color_new(255, 255, 255, 255));
+	}
+	atlas_free(atlas);
 	winstyle->bg_style = rws.background_mode;
 	for (i = 0; i < 4; ++i) {
 		winstyle->gradient[i] = color_new(
@@ -98,6 +153,7 @@ load_windowstyle(const char* filename)
 
 on_error:
 	if (file != NULL) sfs_fclose(file);
+	atlas_free(atlas);
 	if (winstyle != NULL) {
 		for (i = 0; i < 9; ++i)
 			free_image(winstyle->images[i]);
@@ -116,24 +172,58 @@ ref_windowstyle(windowstyle_t* winstyle)
 void
 free_windowstyle(windowstyle_t* winstyle)
 {
+	iter_t               iter;
+	struct window_mesh** p_mesh;
+
 	int i;
 
 	if (winstyle == NULL || --winstyle->refcount > 0)
 		return;
+	if (winstyle->meshes != NULL) {
+		iter = vector_enum(winstyle->meshes);
+		while (p_mesh = vector_next(&iter))
+			free_window_mesh(*p_mesh);
+		vector_free(winstyle->meshes);
+	}
 	for (i = 0; i < 9; ++i) {
 		free_image(winstyle->images[i]);
 	}
+	free_image(winstyle->texture);
 	free(winstyle);
 }
 
 void
 draw_window(windowstyle_t* winstyle, color_t mask, int x, int y, int width, int height)
 {
-	color_t gradient[4];
-	int     w[9], h[9];
+	color_t             gradient[4];
+	bool                is_drawing_held;
+	struct window_mesh* mesh;
+	int                 w[9], h[9];
+	float               x_off, y_off;
 	
 	int i;
 	
+	if (mesh = find_window_mesh(winstyle, width, height, mask)) {
+		// menus redraw the same windows every frame, so the geometry is kept
+		// and only moved when the window does.
+		if (x != mesh->x || y != mesh->y) {
+			x_off = x - mesh->x;
+			y_off = y - mesh->y;
+			for (i = 0; i < mesh->num_vertices; ++i) {
+				mesh->vertices[i].x += x_off;
+				mesh->vertices[i].y += y_off;
+			}
+			mesh->x = x;
+			mesh->y = y;
+		}
+		is_drawing_held = al_is_bitmap_drawing_held();
+		al_hold_bitmap_drawing(false);
+		al_draw_prim(mesh->vertices, NULL, get_image_bitmap(winstyle->texture),
+			0, mesh->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+		al_hold_bitmap_drawing(is_drawing_held);
+		return;
+	}
+	
 	// 0 - upper left
 	// 1 - top
 	// 2 - upper right
@@ -190,6 +280,201 @@ draw_window(windowstyle_t* winstyle, color_t mask, int x, int y, int width, int
 	draw_image_tiled_masked(winstyle->images[7], mask, x - w[7], y, w[7], height);
 }
 
+static struct window_mesh*
+create_window_mesh(const windowstyle_t* winstyle, int width, int height, color_t mask)
+{
+	// builds a triangle list for a window at (0,0).  the parts are emitted in
+	// the same order draw_window() used to draw them, so blending comes out the
+	// same.  tiled parts are laid out as one quad per tile, with the last one
+	// in each row or column cropped.  returns NULL if that would take more than
+	// MAX_WINDOW_QUADS quads, e.g. for a tiny background tile, in which case the
+	// window is drawn part by part instead.
+
+	color_t             gradient[4];
+	bool                has_gradient;
+	ALLEGRO_COLOR       native_mask;
+	struct window_mesh* mesh;
+	long                num_quads = 4;
+	float_rect_t        uv;
+	ALLEGRO_VERTEX*     v;
+	int                 w[9], h[9];
+
+	int i;
+
+	// 0 - upper left
+	// 1 - top
+	// 2 - upper right
+	// 3 - right
+	// 4 - lower right
+	// 5 - bottom
+	// 6 - lower left
+	// 7 - left
+	// 8 - background
+
+	width = width > 0 ? width : 0;
+	height = height > 0 ? height : 0;
+	for (i = 0; i < 9; ++i) {
+		w[i] = winstyle->uv[i].x2 - winstyle->uv[i].x1;
+		h[i] = winstyle->uv[i].y2 - winstyle->uv[i].y1;
+		if (w[i] <= 0 || h[i] <= 0)
+			return NULL;
+	}
+	if (winstyle->bg_style == WSTYLE_BG_TILE || winstyle->bg_style == WSTYLE_BG_TILE_GRADIENT)
+		num_quads += (long)((width + w[8] - 1) / w[8]) * ((height + h[8] - 1) / h[8]);
+	else if (winstyle->bg_style == WSTYLE_BG_STRETCH || winstyle->bg_style == WSTYLE_BG_STRETCH_GRADIENT)
+		num_quads += 1;
+	has_gradient = winstyle->bg_style == WSTYLE_BG_GRADIENT
+		|| winstyle->bg_style == WSTYLE_BG_TILE_GRADIENT
+		|| winstyle->bg_style == WSTYLE_BG_STRETCH_GRADIENT;
+	if (has_gradient)
+		num_quads += 1;
+	num_quads += (width + w[1] - 1) / w[1] + (height + h[3] - 1) / h[3]
+		+ (width + w[5] - 1) / w[5] + (height + h[7] - 1) / h[7];
+	if (num_quads > MAX_WINDOW_QUADS)
+		return NULL;
+
+	if (!(mesh = calloc(1, sizeof(struct window_mesh))))
+		return NULL;
+	if (!(mesh->vertices = malloc(num_quads * 6 * sizeof(ALLEGRO_VERTEX)))) {
+		free(mesh);
+		return NULL;
+	}
+	mesh->width = width;
+	mesh->height = height;
+	mesh->mask = mask;
+	native_mask = nativecolor(mask);
+	v = mesh->vertices;
+	switch (winstyle->bg_style) {
+	case WSTYLE_BG_TILE:
+	case WSTYLE_BG_TILE_GRADIENT:
+		v = put_tiles(v, winstyle, 8, 0, 0, width, height, native_mask);
+		break;
+	case WSTYLE_BG_STRETCH:
+	case WSTYLE_BG_STRETCH_GRADIENT:
+		v = put_quad(v, 0, 0, width, height, winstyle->uv[8], native_mask);
+		break;
+	}
+	if (has_gradient) {
+		// the gradient samples the white pixel so only the vertex colors show
+		for (i = 0; i < 4; ++i) {
+			gradient[i].r = mask.r * winstyle->gradient[i].r / 255;
+			gradient[i].g = mask.g * winstyle->gradient[i].g / 255;
+			gradient[i].b = mask.b * winstyle->gradient[i].b / 255;
+			gradient[i].alpha = mask.alpha * winstyle->gradient[i].alpha / 255;
+		}
+		uv = winstyle->uv[9];
+		uv.x1 = uv.x2 = uv.x1 + 0.5;
+		uv.y1 = uv.y2 = uv.y1 + 0.5;
+		v = put_quad(v, 0, 0, width, height, uv, native_mask);
+		v[-6].color = nativecolor(gradient[0]);
+		v[-5].color = nativecolor(gradient[1]);
+		v[-4].color = nativecolor(gradient[2]);
+		v[-3].color = nativecolor(gradient[1]);
+		v[-2].color = nativecolor(gradient[3]);
+		v[-1].color = nativecolor(gradient[2]);
+	}
+	v = put_quad(v, -w[0], -h[0], 0, 0, winstyle->uv[0], native_mask);
+	v = put_quad(v, width, -h[2], width + w[2], 0, winstyle->uv[2], native_mask);
+	v = put_quad(v, width, height, width + w[4], height + h[4], winstyle->uv[4], native_mask);
+	v = put_quad(v, -w[6], height, 0, height + h[6], winstyle->uv[6], native_mask);
+	v = put_tiles(v, winstyle, 1, 0, -h[1], width, h[1], native_mask);
+	v = put_tiles(v, winstyle, 3, width, 0, w[3], height, native_mask);
+	v = put_tiles(v, winstyle, 5, 0, height, width, h[5], native_mask);
+	v = put_tiles(v, winstyle, 7, -w[7], 0, w[7], height, native_mask);
+	mesh->num_vertices = v - mesh->vertices;
+	return mesh;
+}
+
+static void
+free_window_mesh(struct window_mesh* mesh)
+{
+	if (mesh == NULL)
+		return;
+	free(mesh->vertices);
+	free(mesh);
+}
+
+static struct window_mesh*
+find_window_mesh(windowstyle_t* winstyle, int width, int height, color_t mask)
+{
+	// looks up the mesh for a window size and color mask, creating it if it
+	// isn't cached.  the cache is kept in LRU order with the most recently used
+	// mesh last.  returns NULL if the window has to be drawn part by part.
+
+	iter_t               iter;
+	struct window_mesh*  mesh;
+	struct window_mesh** p_mesh;
+
+	if (winstyle->texture == NULL)
+		return NULL;
+	if (winstyle->meshes == NULL && !(winstyle->meshes = vector_new(sizeof(struct window_mesh*))))
+		return NULL;
+	iter = vector_enum(winstyle->meshes);
+	while (p_mesh = vector_next(&iter)) {
+		mesh = *p_mesh;
+		if (mesh->width != width || mesh->height != height || memcmp(&mesh->mask, &mask, sizeof(color_t)) != 0)
+			continue;
+		if (iter.index < (ptrdiff_t)vector_len(winstyle->meshes) - 1) {
+			iter_remove(&iter);
+			vector_push(winstyle->meshes, &mesh);
+		}
+		return mesh;
+	}
+	if (!(mesh = create_window_mesh(winstyle, width, height, mask)))
+		return NULL;
+	if (vector_len(winstyle->meshes) >= MAX_WINDOW_MESHES) {
+		free_window_mesh(*(struct window_mesh**)vector_get(winstyle->meshes, 0));
+		vector_remove(winstyle->meshes, 0);
+	}
+	if (!vector_push(winstyle->meshes, &mesh)) {
+		free_window_mesh(mesh);
+		return NULL;
+	}
+	return mesh;
+}
+
+static ALLEGRO_VERTEX*
+put_quad(ALLEGRO_VERTEX* v, float x1, float y1, float x2, float y2, float_rect_t uv, ALLEGRO_COLOR color)
+{
+	int i;
+
+	v[0].x = x1; v[0].y = y1; v[0].u = uv.x1; v[0].v = uv.y1;
+	v[1].x = x2; v[1].y = y1; v[1].u = uv.x2; v[1].v = uv.y1;
+	v[2].x = x1; v[2].y = y2; v[2].u = uv.x1; v[2].v = uv.y2;
+	v[3].x = x2; v[3].y = y1; v[3].u = uv.x2; v[3].v = uv.y1;
+	v[4].x = x2; v[4].y = y2; v[4].u = uv.x2; v[4].v = uv.y2;
+	v[5].x = x1; v[5].y = y2; v[5].u = uv.x1; v[5].v = uv.y2;
+	for (i = 0; i < 6; ++i) {
+		v[i].z = 0.0;
+		v[i].color = color;
+	}
+	return v + 6;
+}
+
+static ALLEGRO_VERTEX*
+put_tiles(ALLEGRO_VERTEX* v, const windowstyle_t* winstyle, int part, int x, int y, int width, int height, ALLEGRO_COLOR color)
+{
+	int          tile_w, tile_h;
+	float_rect_t uv;
+	int          w, h;
+
+	int i_x, i_y;
+
+	w = winstyle->uv[part].x2 - winstyle->uv[part].x1;
+	h = winstyle->uv[part].y2 - winstyle->uv[part].y1;
+	for (i_y = 0; i_y < height; i_y += h) {
+		for (i_x = 0; i_x < width; i_x += w) {
+			tile_w = fmin(w, width - i_x);
+			tile_h = fmin(h, height - i_y);
+			uv = winstyle->uv[part];
+			uv.x2 = uv.x1 + tile_w;
+			uv.y2 = uv.y1 + tile_h;
+			v = put_quad(v, x + i_x, y + i_y, x + i_x + tile_w, y + i_y + tile_h, uv, color);
+		}
+	}
+	return v;
+}
+
 void
 init_windowstyle_api(void)
 {